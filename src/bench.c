@@ -0,0 +1,989 @@
+/*
+ * bench.c - Performance benchmarks
+ *
+ * Usage: ./run_bench [name] [maxNodes]
+ *   name      - which benchmark to run (default: all)
+ *   maxNodes  - largest tree size to try (default: 1000000)
+ *
+ * Each benchmark grows the input by 10x per step starting at 1000 so
+ * that scaling (linear vs. quadratic) is visible from the ns/node column.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <ctype.h>
+#include <malloc.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include <sys/wait.h>
+#include "lab5.h"
+
+#define BENCH_FILE "bench.dat"
+
+static double now_sec() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+/* Build a complete binary tree with n nodes (n is rounded up to odd so
+ * every question has two children). Node i has children 2i+1 and 2i+2.
+ * Built from an array so no recursion is needed even for huge n.
+ */
+static Node *build_bench_tree(int n) {
+    if (n % 2 == 0) n++;
+    Node **nodes = malloc(n * sizeof(Node*));
+    char text[32];
+    for (int i = 0; i < n; i++) {
+        if (2 * i + 2 < n) {
+            snprintf(text, sizeof(text), "Question %d?", i);
+            nodes[i] = create_question_node(text);
+        } else {
+            snprintf(text, sizeof(text), "Animal %d", i);
+            nodes[i] = create_animal_node(text);
+        }
+    }
+    for (int i = 0; 2 * i + 2 < n; i++) {
+        nodes[i]->yes = nodes[2 * i + 1];
+        nodes[i]->no = nodes[2 * i + 2];
+    }
+    Node *root = nodes[0];
+    free(nodes);
+    return root;
+}
+
+/* save_tree: should scale linearly (constant ns/node) */
+static void bench_save(int maxNodes) {
+    const char *names[] = {"fd", "O_DIRECT", "io_uring"};
+    for (int backend = IO_FD; backend <= IO_URING; backend++) {
+        set_io_backend((IoBackend)backend);
+        printf("save_tree (%s):\n", names[backend]);
+        printf("  %10s %12s %12s\n", "nodes", "seconds", "ns/node");
+        for (int n = 1000; n <= maxNodes; n *= 10) {
+            Node *saved = g_root;
+            g_root = build_bench_tree(n);
+            int count = count_nodes(g_root);
+
+            double start = now_sec();
+            int ok = save_tree(BENCH_FILE);
+            double elapsed = now_sec() - start;
+
+            printf("  %10d %12.4f %12.1f%s\n", count, elapsed,
+                   elapsed * 1e9 / count, ok ? "" : "  (FAILED)");
+
+            free_tree(g_root);
+            g_root = saved;
+        }
+    }
+    set_io_backend(IO_FD);
+    remove(BENCH_FILE);
+}
+
+/* load_tree + teardown: pooled trees load with a few big allocations
+ * and are released wholesale. VERSION 2+ files are mapped, not parsed.
+ */
+static void bench_load(int maxNodes, int version) {
+    printf("load_tree (VERSION %d):\n", version);
+    printf("  %10s %12s %12s %12s\n", "nodes", "load s", "ns/node", "release s");
+    for (int n = 1000; n <= maxNodes; n *= 10) {
+        Node *saved = g_root;
+        g_root = build_bench_tree(n);
+        int count = count_nodes(g_root);
+        save_tree_version(BENCH_FILE, version);
+        free_tree(g_root);
+        g_root = NULL;
+
+        double start = now_sec();
+        int ok = load_tree(BENCH_FILE);
+        double elapsed = now_sec() - start;
+
+        // VERSION 4's share of that spent checking the CRC (pages are
+        // faulted in by now, as the node table pass would fault them)
+        char share[32] = "";
+        if (ok && version == 4) {
+            start = now_sec();
+            crc32c(0, g_pool.map, g_pool.mapLength - sizeof(uint32_t));
+            snprintf(share, sizeof(share), "  (crc %.1f%%)",
+                     (now_sec() - start) / elapsed * 100);
+        }
+
+        start = now_sec();
+        tree_release();
+        double released = now_sec() - start;
+
+        printf("  %10d %12.4f %12.1f %12.6f%s%s\n", count, elapsed,
+               elapsed * 1e9 / count, released, share, ok ? "" : "  (FAILED)");
+        g_root = saved;
+    }
+    remove(BENCH_FILE);
+}
+
+/* Like build_bench_tree, but with the repetition of a real knowledge
+ * base: questions come from a 2000-entry vocabulary and animals from
+ * n/20 names, so most texts appear many times.
+ */
+static Node *build_repetitive_tree(int n) {
+    if (n % 2 == 0) n++;
+    Node **nodes = malloc(n * sizeof(Node*));
+    int animals = n / 20 > 0 ? n / 20 : 1;
+    unsigned seed = 2023;
+    char text[64];
+    for (int i = 0; i < n; i++) {
+        seed = seed * 1103515245u + 12345u;
+        if (2 * i + 2 < n) {
+            snprintf(text, sizeof(text), "Does it have feature number %u?", (seed >> 8) % 2000);
+            nodes[i] = create_question_node(text);
+        } else {
+            snprintf(text, sizeof(text), "Animal species %u", (seed >> 8) % animals);
+            nodes[i] = create_animal_node(text);
+        }
+    }
+    for (int i = 0; 2 * i + 2 < n; i++) {
+        nodes[i]->yes = nodes[2 * i + 1];
+        nodes[i]->no = nodes[2 * i + 2];
+    }
+    Node *root = nodes[0];
+    free(nodes);
+    return root;
+}
+
+/* Resident set size of this process in KB */
+static long rss_kb() {
+    long pages = 0, resident = 0;
+    FILE *fp = fopen("/proc/self/statm", "r");
+    if (fp != NULL) {
+        if (fscanf(fp, "%ld %ld", &pages, &resident) != 2) resident = 0;
+        fclose(fp);
+    }
+    return resident * (sysconf(_SC_PAGESIZE) / 1024);
+}
+
+/* RSS growth across load_tree of path, measured in a child so every
+ * load starts from the same heap
+ */
+static long load_rss_kb(const char *path) {
+    int fds[2];
+    long grown = -1;
+    if (pipe(fds) != 0) return -1;
+    pid_t pid = fork();
+    if (pid == 0) {
+        close(fds[0]);
+        g_root = NULL;
+        long before = rss_kb();
+        long delta = load_tree(path) ? rss_kb() - before : -1;
+        if (write(fds[1], &delta, sizeof(delta)) != sizeof(delta)) _exit(1);
+        _exit(0);
+    }
+    close(fds[1]);
+    if (pid > 0) {
+        if (read(fds[0], &grown, sizeof(grown)) != sizeof(grown)) grown = -1;
+        waitpid(pid, NULL, 0);
+    }
+    close(fds[0]);
+    return grown;
+}
+
+/* VERSION 4 (one string per node) vs VERSION 5 (one per distinct text)
+ * on a repetitive tree: file size and the RSS a load adds
+ */
+static void bench_intern(int maxNodes) {
+    printf("interned strings (VERSION 4 vs 5):\n");
+    printf("  %10s %10s %12s %12s %12s %12s\n", "nodes", "distinct",
+           "v4 file KB", "v5 file KB", "v4 load KB", "v5 load KB");
+    for (int n = 1000; n <= maxNodes; n *= 10) {
+        Node *saved = g_root;
+        g_root = build_repetitive_tree(n);
+        int count = count_nodes(g_root);
+        const char *paths[2] = {BENCH_FILE, BENCH_FILE "5"};
+        long fileKb[2], loadKb[2];
+        for (int v = 0; v < 2; v++) {
+            struct stat st;
+            save_tree_version(paths[v], 4 + v);
+            fileKb[v] = stat(paths[v], &st) == 0 ? (long)(st.st_size / 1024) : -1;
+        }
+        // Hand the tree's pages back so the loads can't reuse them
+        free_tree(g_root);
+        malloc_trim(0);
+        for (int v = 0; v < 2; v++) {
+            loadKb[v] = load_rss_kb(paths[v]);
+        }
+        // The saved file's string table holds one entry per distinct text
+        int distinct = 0;
+        FILE *fp = fopen(paths[1], "rb");
+        if (fp != NULL) {
+            uint32_t header[8];
+            if (fread(header, sizeof(header), 1, fp) == 1) distinct = (int)header[6];
+            fclose(fp);
+        }
+        printf("  %10d %10d %12ld %12ld %12ld %12ld\n", count, distinct,
+               fileKb[0], fileKb[1], loadKb[0], loadKb[1]);
+        g_root = saved;
+    }
+    remove(BENCH_FILE);
+    remove(BENCH_FILE "5");
+}
+
+/* VERSION 6 (compressed blocks) against the uncompressed formats on a
+ * repetitive tree: file size, ratio to VERSION 4, and save and load
+ * times (best of 3 each)
+ */
+static void bench_compress(int maxNodes) {
+    printf("compressed snapshots:\n");
+    printf("  %10s %8s %12s %8s %10s %10s\n", "nodes", "version", "file KB", "ratio",
+           "save ns", "load ns");
+    for (int n = 1000; n <= maxNodes; n *= 10) {
+        Node *saved = g_root;
+        Node *tree = build_repetitive_tree(n);
+        int count = count_nodes(tree);
+        long v4Bytes = 0;
+        for (int version = 4; version <= 6; version++) {
+            double saveBest = 1e9, loadBest = 1e9;
+            struct stat st;
+            for (int rep = 0; rep < 3; rep++) {
+                g_root = tree;
+                double start = now_sec();
+                save_tree_version(BENCH_FILE, version);
+                double elapsed = now_sec() - start;
+                if (elapsed < saveBest) saveBest = elapsed;
+            }
+            long bytes = stat(BENCH_FILE, &st) == 0 ? (long)st.st_size : 0;
+            if (version == 4) v4Bytes = bytes;
+            int ok = 1;
+            for (int rep = 0; rep < 3; rep++) {
+                g_root = NULL;
+                double start = now_sec();
+                ok = ok && load_tree(BENCH_FILE);
+                double elapsed = now_sec() - start;
+                if (elapsed < loadBest) loadBest = elapsed;
+                tree_release();
+            }
+            printf("  %10d %8d %12ld %8.2f %10.1f %10.1f%s\n", count, version, bytes / 1024,
+                   bytes ? (double)v4Bytes / bytes : 0.0, saveBest * 1e9 / count,
+                   loadBest * 1e9 / count, ok ? "" : "  (FAILED)");
+        }
+        free_tree(tree);
+        g_root = saved;
+    }
+    remove(BENCH_FILE);
+}
+
+/* A tree grown the way learning grows one: each new animal splits a
+ * random leaf, or with deep set always the newest one (a chain). Animal
+ * names are unique ("Animal 0", "Animal 1", ...). A leaf's id holds its
+ * slot in the leaf array while building.
+ */
+static Node *build_learned_tree(int animals, int deep) {
+    Node **leaves = malloc(animals * sizeof(Node*));
+    char text[32];
+    Node *root = create_animal_node("Animal 0");
+    root->id = 0;
+    leaves[0] = root;
+    unsigned seed = 99;
+    for (int i = 1; i < animals; i++) {
+        seed = seed * 1103515245u + 12345u;
+        Node *leaf = deep ? leaves[i - 1] : leaves[(seed >> 8) % i];
+        // The leaf becomes the question, its animal moves down a level
+        Node *moved = create_animal_node(leaf->text);
+        snprintf(text, sizeof(text), "Animal %d", i);
+        Node *added = create_animal_node(text);
+        snprintf(text, sizeof(text), "Question %d?", i);
+        free(leaf->text);
+        leaf->text = strdup(text);
+        leaf->isQuestion = 1;
+        leaf->yes = (i & 1) ? added : moved;
+        leaf->no = (i & 1) ? moved : added;
+        moved->id = leaf->id;
+        leaves[moved->id] = moved;
+        added->id = i;
+        leaves[i] = added;
+        leaf->id = -1;
+    }
+    for (int i = 0; i < animals; i++) {
+        leaves[i]->id = -1;
+    }
+    free(leaves);
+    return root;
+}
+
+/* path_index_build and random animal pairs: path_lca on their leaves
+ * (O(1)), then by name the question that splits them (two lookups plus
+ * the LCA) and the whole question path between them (O(path)). For
+ * reference, "walk" finds the LCA by climbing parent links from both
+ * leaves, O(depth) per pair. On the deep tree the O(path) columns use
+ * 1000 pairs.
+ */
+static void bench_lca(int maxNodes) {
+    const char *shapes[] = {"complete", "learned", "deep"};
+    int pairs = 1000000;
+    for (int shape = 0; shape < 3; shape++) {
+        printf("path index (%s tree, %d random pairs):\n", shapes[shape], pairs);
+        printf("  %10s %10s %10s %10s %10s %10s %10s %10s\n", "nodes", "build ms", "lca ns",
+               "split ns", "path ns", "walk ns", "mean steps", "max depth");
+        for (int n = 1000; n <= maxNodes; n *= 10) {
+            Node *root = shape == 0 ? build_bench_tree(n) : build_learned_tree(n / 2 + 1, shape == 2);
+            PathIndex pi;
+            double start = now_sec();
+            path_index_build(&pi, root);
+            double built = now_sec() - start;
+            
+            int *leafIds = malloc(pi.count * sizeof(int));
+            int leafCount = 0, maxDepth = 0;
+            for (int i = 0; i < pi.count; i++) {
+                if (!pi.nodes[i]->isQuestion) leafIds[leafCount++] = i;
+                if (pi.depth[i] > maxDepth) maxDepth = pi.depth[i];
+            }
+            const char **names1 = malloc(pairs * sizeof(char*));
+            const char **names2 = malloc(pairs * sizeof(char*));
+            int *u = malloc(pairs * sizeof(int));
+            int *v = malloc(pairs * sizeof(int));
+            unsigned seed = 7;
+            for (int i = 0; i < pairs; i++) {
+                seed = seed * 1103515245u + 12345u;
+                u[i] = leafIds[(seed >> 4) % leafCount];
+                seed = seed * 1103515245u + 12345u;
+                v[i] = leafIds[(seed >> 4) % leafCount];
+                names1[i] = pi.nodes[u[i]]->text;
+                names2[i] = pi.nodes[v[i]]->text;
+            }
+            
+            long check = 0;
+            start = now_sec();
+            for (int i = 0; i < pairs; i++) {
+                check += path_lca(&pi, u[i], v[i]);
+            }
+            double lcaTime = now_sec() - start;
+            
+            PathStep split;
+            long total = 0;
+            start = now_sec();
+            for (int i = 0; i < pairs; i++) {
+                total += path_between(&pi, names1[i], names2[i], &split, 1);
+            }
+            double splitTime = now_sec() - start;
+            
+            int slowPairs = shape == 2 ? 1000 : pairs;
+            PathStep *steps = malloc(pi.count * sizeof(PathStep));
+            start = now_sec();
+            for (int i = 0; i < slowPairs; i++) {
+                path_between(&pi, names1[i], names2[i], steps, pi.count);
+            }
+            double pathTime = now_sec() - start;
+            
+            int mismatches = 0;
+            start = now_sec();
+            for (int i = 0; i < slowPairs; i++) {
+                int a = u[i], b = v[i];
+                while (pi.depth[a] > pi.depth[b]) a = pi.parent[a];
+                while (pi.depth[b] > pi.depth[a]) b = pi.parent[b];
+                while (a != b) {
+                    a = pi.parent[a];
+                    b = pi.parent[b];
+                }
+                mismatches += a != path_lca(&pi, u[i], v[i]);
+            }
+            double walk = now_sec() - start;
+            
+            printf("  %10d %10.1f %10.1f %10.1f %10.1f %10.1f %10.1f %10d%s\n", pi.count,
+                   built * 1e3, lcaTime * 1e9 / pairs, splitTime * 1e9 / pairs, pathTime * 1e9 / slowPairs, walk * 1e9 / slowPairs,
+                   (double)total / pairs, maxDepth, mismatches || check < 0 ? "  (MISMATCH)" : "");
+            free(steps);
+            free(leafIds);
+            free(names1);
+            free(names2);
+            free(u);
+            free(v);
+            path_index_free(&pi);
+            free_tree(root);
+        }
+    }
+}
+
+/* load_tree at 1, 2, 4 and 8 load threads on one maxNodes-node file.
+ * The threads split checksumming, parsing, node construction and
+ * linking; "rebuild" is the serial index and stats rebuild that every
+ * load ends with, timed again on its own for reference.
+ */
+static void bench_parallel_load(int maxNodes, int version) {
+    Node *saved = g_root;
+    g_root = build_bench_tree(maxNodes);
+    int count = count_nodes(g_root);
+    save_tree_version(BENCH_FILE, version);
+    free_tree(g_root);
+    g_root = NULL;
+
+    printf("parallel load_tree (VERSION %d, %d nodes, best of 3):\n", version, count);
+    printf("  %8s %10s %10s %10s\n", "threads", "load s", "rebuild s", "speedup");
+    load_tree(BENCH_FILE);  // Warm the page cache and the allocator
+    tree_release();
+    double base = 0;
+    for (int threads = 1; threads <= 8; threads *= 2) {
+        set_load_threads(threads);
+        double elapsed = 0, rebuild = 0;
+        int ok = 1;
+        for (int run = 0; run < 3; run++) {
+            double start = now_sec();
+            ok &= load_tree(BENCH_FILE);
+            double loaded = now_sec() - start;
+
+            start = now_sec();
+            index_rebuild();
+            stats_rebuild();
+            double rebuilt = now_sec() - start;
+            if (run == 0 || loaded < elapsed) elapsed = loaded;
+            if (run == 0 || rebuilt < rebuild) rebuild = rebuilt;
+            tree_release();
+        }
+        if (threads == 1) {
+            base = elapsed;
+        }
+        printf("  %8d %10.4f %10.4f %9.2fx%s\n", threads, elapsed, rebuild, base / elapsed,
+               ok ? "" : "  (FAILED)");
+    }
+    set_load_threads(0);
+    g_root = saved;
+    remove(BENCH_FILE);
+}
+
+/* crc32c throughput over a 64 MB buffer (the VERSION 4 load check) */
+static void bench_crc() {
+    size_t len = 64u << 20;
+    unsigned char *buf = malloc(len);
+    for (size_t i = 0; i < len; i++) {
+        buf[i] = (unsigned char)(i * 2654435761u >> 24);
+    }
+    crc32c(0, buf, 4096);  // Pick the implementation outside the timing
+    double start = now_sec();
+    uint32_t crc = crc32c(0, buf, len);
+    double elapsed = now_sec() - start;
+    printf("crc32c: %.2f GB/s (crc %08x)\n", len / elapsed / 1e9, crc);
+    free(buf);
+}
+
+/* Bytes currently allocated from the heap, including mmapped chunks */
+static size_t heap_bytes() {
+    struct mallinfo2 mi = mallinfo2();
+    return mi.uordblks + mi.hblkhd;
+}
+
+/* h_put / h_get_ids: lookup latency should stay flat as keys grow.
+ * bytes/key is the heap the table holds per key (one id each, as most
+ * questions distinguish a single animal).
+ */
+static void bench_hash(int maxKeys) {
+    printf("hash lookup:\n");
+    printf("  %10s %12s %12s %12s %10s\n", "keys", "put ns/key", "hit ns", "miss ns",
+           "bytes/key");
+    for (int n = 1000; n <= maxKeys; n *= 100) {
+        Hash h;
+        size_t heapBefore = heap_bytes();
+        h_init(&h, 31);
+        char key[64];
+
+        double start = now_sec();
+        for (int i = 0; i < n; i++) {
+            snprintf(key, sizeof(key), "does_it_have_feature_%d", i);
+            h_put(&h, key, i);
+        }
+        double put = now_sec() - start;
+        double bytesPerKey = (double)(heap_bytes() - heapBefore) / n;
+
+        // Time a fixed number of lookups spread over the key space;
+        // keys are formatted up front so only the lookups are timed
+        int lookups = 1000000;
+        char (*hits)[48] = malloc(lookups * sizeof(*hits));
+        char (*misses)[48] = malloc(lookups * sizeof(*misses));
+        for (int i = 0; i < lookups; i++) {
+            snprintf(hits[i], sizeof(hits[i]), "does_it_have_feature_%d",
+                     (int)((i * 2654435761u) % n));
+            snprintf(misses[i], sizeof(misses[i]), "does_it_lack_feature_%d", i);
+        }
+
+        long found = 0;
+        start = now_sec();
+        for (int i = 0; i < lookups; i++) {
+            int count;
+            h_get_ids(&h, hits[i], &count);
+            found += count;
+        }
+        double hit = now_sec() - start;
+
+        start = now_sec();
+        for (int i = 0; i < lookups; i++) {
+            int count;
+            h_get_ids(&h, misses[i], &count);
+            found += count;
+        }
+        double miss = now_sec() - start;
+        free(hits);
+        free(misses);
+
+        printf("  %10d %12.1f %12.1f %12.1f %10.1f%s\n", n, put * 1e9 / n,
+               hit * 1e9 / lookups, miss * 1e9 / lookups, bytesPerKey,
+               found == lookups ? "" : "  (MISMATCH)");
+        h_free(&h);
+    }
+}
+
+/* Flat tree vs. pointer tree: integrity check and bulk game replay.
+ * Each replay follows a pseudo-random answer sequence from the root to
+ * a leaf; the flattening cost is reported separately.
+ */
+static void bench_flat(int maxNodes) {
+    printf("flat tree:\n");
+    printf("  %10s %10s %12s %12s %12s %12s\n", "nodes", "flatten ns",
+           "check ns", "flat check", "replay ns", "flat replay");
+    int replays = 1000000;
+    for (int n = 1000; n <= maxNodes; n *= 10) {
+        Node *saved = g_root;
+        g_root = build_bench_tree(n);
+        int count = count_nodes(g_root);
+
+        FlatTree ft;
+        double start = now_sec();
+        int ok = flat_from_tree(&ft, g_root);
+        double flatten = now_sec() - start;
+
+        start = now_sec();
+        ok &= check_integrity();
+        double check = now_sec() - start;
+
+        start = now_sec();
+        ok &= flat_check_integrity(&ft);
+        double flatCheck = now_sec() - start;
+
+        // Same answer sequences for both walks
+        unsigned seed = 12345;
+        long pointerSum = 0;
+        start = now_sec();
+        for (int r = 0; r < replays; r++) {
+            Node *node = g_root;
+            while (node->isQuestion) {
+                seed = seed * 1103515245u + 12345u;
+                node = (seed >> 16) & 1 ? node->yes : node->no;
+            }
+            pointerSum += node->id;
+        }
+        double replay = now_sec() - start;
+
+        seed = 12345;
+        long flatSum = 0;
+        start = now_sec();
+        for (int r = 0; r < replays; r++) {
+            int i = 0;
+            while (FLAT_IS_QUESTION(&ft, i)) {
+                seed = seed * 1103515245u + 12345u;
+                i = FLAT_CHILD(&ft, i, (seed >> 16) & 1);
+            }
+            flatSum += ft.ids[i];
+        }
+        double flatReplay = now_sec() - start;
+
+        printf("  %10d %10.1f %12.1f %12.1f %12.1f %12.1f%s\n", count,
+               flatten * 1e9 / count, check * 1e9 / count, flatCheck * 1e9 / count,
+               replay * 1e9 / replays, flatReplay * 1e9 / replays,
+               ok && pointerSum == flatSum ? "" : "  (MISMATCH)");
+        flat_free(&ft);
+        free_tree(g_root);
+        g_root = saved;
+    }
+}
+
+/* Headless game sessions on a pooled tree: play sessions answer random
+ * questions and confirm the guess; learn sessions reject it and teach a
+ * new animal (so the tree grows by two nodes each).
+ */
+static void bench_game(int maxNodes) {
+    printf("game engine:\n");
+    printf("  %10s %14s %14s\n", "nodes", "play/sec", "learn/sec");
+    int sessions = 1000000;
+    for (int n = 1000; n <= maxNodes; n *= 10) {
+        Node *saved = g_root;
+        Node *heapTree = build_bench_tree(n);
+        FlatTree ft;
+        flat_from_tree(&ft, heapTree);
+        free_tree(heapTree);
+        pool_init(&g_pool);
+        g_root = flat_to_tree(&ft, &g_pool);
+        flat_free(&ft);
+        index_rebuild();
+        stats_rebuild();
+
+        GameSession g;
+        unsigned seed = 12345;
+        long won = 0;
+        double start = now_sec();
+        for (int s = 0; s < sessions; s++) {
+            game_start(&g);
+            while (g.state == GAME_QUESTION) {
+                seed = seed * 1103515245u + 12345u;
+                game_answer(&g, (seed >> 16) & 1);
+            }
+            game_answer(&g, 1);
+            won += g.state == GAME_WON;
+        }
+        double play = now_sec() - start;
+
+        int learns = sessions / 10;
+        char animal[32], question[32];
+        start = now_sec();
+        for (int s = 0; s < learns; s++) {
+            game_start(&g);
+            while (g.state == GAME_QUESTION) {
+                seed = seed * 1103515245u + 12345u;
+                game_answer(&g, (seed >> 16) & 1);
+            }
+            game_answer(&g, 0);
+            snprintf(animal, sizeof(animal), "Learned %d", s);
+            snprintf(question, sizeof(question), "Is it learned %d?", s);
+            game_learn(&g, animal, question, s & 1);
+        }
+        double learn = now_sec() - start;
+
+        printf("  %10d %14.0f %14.0f%s\n", n, sessions / play, learns / learn,
+               won == sessions && check_integrity() ? "" : "  (MISMATCH)");
+        tree_release();
+        g_root = saved;
+    }
+}
+
+typedef struct {
+    SnapshotStore *store;
+    int reader;
+    int walks;
+    long leafSum;
+    int *done;  /* readers finished so far */
+} SnapBenchReader;
+
+static void *snap_bench_reader(void *arg) {
+    SnapBenchReader *r = arg;
+    unsigned seed = 12345 + r->reader;
+    for (int w = 0; w < r->walks; w++) {
+        const Snapshot *snap = snap_enter(r->store, r->reader);
+        const FlatTree *ft = &snap->tree;
+        int i = 0;
+        while (FLAT_IS_QUESTION(ft, i)) {
+            seed = seed * 1103515245u + 12345u;
+            i = FLAT_CHILD(ft, i, (seed >> 16) & 1);
+        }
+        r->leafSum += ft->ids[i];
+        snap_exit(r->store, r->reader);
+    }
+    __atomic_add_fetch(r->done, 1, __ATOMIC_RELEASE);
+    return NULL;
+}
+
+/* Readers walking a shared snapshot on 1..8 threads, alone and while
+ * the main thread keeps republishing (what a learn costs everyone)
+ */
+static void bench_snapshot(int maxNodes) {
+    printf("snapshot readers (%d nodes):\n", maxNodes);
+    printf("  %8s %14s %16s %12s\n", "threads", "walks/sec", "with publishes",
+           "publishes");
+    Node *saved = g_root;
+    g_root = build_bench_tree(maxNodes);
+    SnapshotStore store;
+    snap_init(&store, 8);
+    double start = now_sec();
+    snap_publish(&store, g_root);
+    double publish = now_sec() - start;
+
+    int walksPerThread = 1000000;
+    for (int threads = 1; threads <= 8; threads *= 2) {
+        double rates[2];
+        long publishes = 0;
+        for (int withWriter = 0; withWriter < 2; withWriter++) {
+            SnapBenchReader readers[8];
+            pthread_t ids[8];
+            int done = 0;
+            start = now_sec();
+            for (int t = 0; t < threads; t++) {
+                readers[t] = (SnapBenchReader){&store, t, walksPerThread, 0, &done};
+                pthread_create(&ids[t], NULL, snap_bench_reader, &readers[t]);
+            }
+            // The main thread is the writer until the readers finish
+            while (withWriter && __atomic_load_n(&done, __ATOMIC_ACQUIRE) < threads) {
+                snap_publish(&store, g_root);
+                publishes++;
+            }
+            for (int t = 0; t < threads; t++) {
+                pthread_join(ids[t], NULL);
+            }
+            rates[withWriter] = (double)threads * walksPerThread / (now_sec() - start);
+        }
+        printf("  %8d %14.0f %16.0f %12ld\n", threads, rates[0], rates[1], publishes);
+    }
+    printf("  publish (flatten + swap): %.1f ms\n", publish * 1e3);
+
+    snap_free(&store);
+    free_tree(g_root);
+    g_root = saved;
+}
+
+/* Learn one animal along a pseudo-random path */
+static void bench_learn(unsigned *seed, int i) {
+    GameSession g;
+    char animal[32], question[32];
+    game_start(&g);
+    while (g.state == GAME_QUESTION) {
+        *seed = *seed * 1103515245u + 12345u;
+        game_answer(&g, (*seed >> 16) & 1);
+    }
+    game_answer(&g, 0);
+    snprintf(animal, sizeof(animal), "Journaled %d", i);
+    snprintf(question, sizeof(question), "Is it journaled %d?", i);
+    game_learn(&g, animal, question, i & 1);
+}
+
+/* Persisting one learn: a full save_tree vs. a journal record, fsync'd
+ * per record or in batches of 64
+ */
+static void bench_journal(int maxNodes) {
+    printf("persist one learn (us):\n");
+    printf("  %10s %12s %12s %12s\n", "nodes", "save_tree", "journal", "journal/64");
+    for (int n = 1000; n <= maxNodes; n *= 10) {
+        Node *saved = g_root;
+        g_root = build_bench_tree(n);
+        save_tree(BENCH_FILE);
+        free_tree(g_root);
+        g_root = NULL;
+        load_tree(BENCH_FILE);
+        unsigned seed = 1;
+
+        int saves = 20;
+        double start = now_sec();
+        for (int i = 0; i < saves; i++) {
+            bench_learn(&seed, i);
+            save_tree(BENCH_FILE);
+        }
+        double save = (now_sec() - start) / saves;
+
+        double perSync[2];
+        int syncs[2] = {1, 64};
+        int learns = 2000;
+        for (int k = 0; k < 2; k++) {
+            journal_open(BENCH_FILE, syncs[k], 0);
+            start = now_sec();
+            for (int i = 0; i < learns; i++) {
+                bench_learn(&seed, saves + k * learns + i);
+            }
+            journal_sync();
+            perSync[k] = (now_sec() - start) / learns;
+            journal_close();
+        }
+
+        printf("  %10d %12.1f %12.1f %12.1f\n", n, save * 1e6, perSync[0] * 1e6,
+               perSync[1] * 1e6);
+        tree_release();
+        g_root = saved;
+    }
+    remove(BENCH_FILE);
+    remove(BENCH_FILE ".journal");
+}
+
+/* The byte-at-a-time ctype loop canonicalize used to be, as a baseline */
+static size_t canon_ctype(const char *s, char *out) {
+    size_t j = 0;
+    for (size_t i = 0; s[i] != '\0'; i++) {
+        unsigned char c = s[i];
+        if (isalnum(c)) out[j++] = tolower(c);
+        else if (isspace(c)) out[j++] = '_';
+    }
+    out[j] = '\0';
+    return j;
+}
+
+/* canonicalize throughput over a corpus of question-like strings of
+ * mixed length, in MB of input per second
+ */
+static void bench_canon(int maxStrings) {
+    const char *words[] = {"Does", "it", "have", "STRIPES", "and", "live", "in",
+                           "the", "Water?", "Can", "fly,", "eat", "fish", "42"};
+    int nwords = sizeof(words) / sizeof(words[0]);
+    int n = maxStrings < 1000000 ? maxStrings : 1000000;
+    char **corpus = malloc(n * sizeof(char*));
+    size_t totalBytes = 0;
+    unsigned seed = 7;
+    for (int i = 0; i < n; i++) {
+        char text[256];
+        size_t len = 0;
+        int count = 3 + i % 12;
+        for (int w = 0; w < count; w++) {
+            seed = seed * 1103515245u + 12345u;
+            len += snprintf(text + len, sizeof(text) - len, "%s%s", w ? " " : "",
+                            words[(seed >> 16) % nwords]);
+        }
+        corpus[i] = strdup(text);
+        totalBytes += len;
+    }
+    char *out = malloc(256);
+    size_t check[3] = {0, 0, 0};
+    double seconds[3];
+
+    double start = now_sec();
+    for (int i = 0; i < n; i++) check[0] += canon_ctype(corpus[i], out);
+    seconds[0] = now_sec() - start;
+
+    start = now_sec();
+    for (int i = 0; i < n; i++) {
+        char *key = canonicalize(corpus[i]);
+        check[1] += strlen(key);
+        free(key);
+    }
+    seconds[1] = now_sec() - start;
+
+    start = now_sec();
+    for (int i = 0; i < n; i++) check[2] += canonicalize_into(corpus[i], out);
+    seconds[2] = now_sec() - start;
+
+    printf("canonicalize (%d strings, %.1f bytes avg):\n", n, (double)totalBytes / n);
+    printf("  %-26s %10s\n", "variant", "MB/s");
+    const char *names[] = {"ctype loop (old)", "canonicalize (malloc)", "canonicalize_into"};
+    for (int v = 0; v < 3; v++) {
+        printf("  %-26s %10.1f%s\n", names[v], totalBytes / seconds[v] / 1e6,
+               check[v] == check[0] ? "" : "  (MISMATCH)");
+    }
+
+    // Long input: the corpus joined into one 1MB string, where the
+    // vector blocks dominate instead of per-call overhead
+    size_t bigLen = 1 << 20;
+    char *big = malloc(bigLen + 1);
+    char *bigOut = malloc(bigLen + 1);
+    size_t pos = 0;
+    for (int i = 0; pos < bigLen; i = (i + 1) % n) {
+        size_t len = strlen(corpus[i]);
+        if (len + 1 > bigLen - pos) len = bigLen - pos - 1;
+        memcpy(big + pos, corpus[i], len);
+        big[pos + len] = ' ';
+        pos += len + 1;
+    }
+    big[bigLen] = '\0';
+    int reps = 100;
+    start = now_sec();
+    for (int r = 0; r < reps; r++) check[0] = canon_ctype(big, bigOut);
+    double ctypeLong = now_sec() - start;
+    start = now_sec();
+    for (int r = 0; r < reps; r++) check[2] = canonicalize_into(big, bigOut);
+    double intoLong = now_sec() - start;
+    printf("  %-26s %10.1f\n", "ctype loop, 1MB input", bigLen * reps / ctypeLong / 1e6);
+    printf("  %-26s %10.1f%s\n", "canonicalize_into, 1MB", bigLen * reps / intoLong / 1e6,
+           check[2] == check[0] ? "" : "  (MISMATCH)");
+    free(big);
+    free(bigOut);
+
+    for (int i = 0; i < n; i++) free(corpus[i]);
+    free(corpus);
+    free(out);
+}
+
+/* The linked-list queue the ring buffer replaced (one malloc/free per
+ * element), kept here as the baseline for bench_queue.
+ */
+typedef struct ListItem {
+    Node *node;
+    int id;
+    struct ListItem *next;
+} ListItem;
+
+typedef struct {
+    ListItem *front, *rear;
+} ListQueue;
+
+static void lq_enqueue(ListQueue *q, Node *node, int id) {
+    ListItem *item = malloc(sizeof(ListItem));
+    item->node = node;
+    item->id = id;
+    item->next = NULL;
+    if (q->rear == NULL) q->front = item;
+    else q->rear->next = item;
+    q->rear = item;
+}
+
+static int lq_dequeue(ListQueue *q, Node **node, int *id) {
+    ListItem *item = q->front;
+    if (item == NULL) return 0;
+    *node = item->node;
+    *id = item->id;
+    q->front = item->next;
+    if (q->front == NULL) q->rear = NULL;
+    free(item);
+    return 1;
+}
+
+/* BFS throughput: ring-buffer Queue vs. the old per-element mallocs */
+static void bench_queue(int maxNodes) {
+    printf("BFS queue:\n");
+    printf("  %10s %12s %12s %10s\n", "nodes", "list ns", "ring ns", "speedup");
+    for (int n = 1000; n <= maxNodes; n *= 10) {
+        Node *root = build_bench_tree(n);
+        Node *node;
+        int id;
+
+        long listVisited = 0;
+        ListQueue lq = {NULL, NULL};
+        double start = now_sec();
+        lq_enqueue(&lq, root, 0);
+        while (lq_dequeue(&lq, &node, &id)) {
+            listVisited++;
+            if (node->isQuestion) {
+                lq_enqueue(&lq, node->yes, id + 1);
+                lq_enqueue(&lq, node->no, id + 1);
+            }
+        }
+        double list = now_sec() - start;
+
+        long ringVisited = 0;
+        Queue q;
+        start = now_sec();
+        q_init(&q);
+        q_enqueue(&q, root, 0);
+        while (q_dequeue(&q, &node, &id)) {
+            ringVisited++;
+            if (node->isQuestion) {
+                q_enqueue(&q, node->yes, id + 1);
+                q_enqueue(&q, node->no, id + 1);
+            }
+        }
+        q_free(&q);
+        double ring = now_sec() - start;
+
+        printf("  %10ld %12.1f %12.1f %9.1fx%s\n", ringVisited,
+               list * 1e9 / listVisited, ring * 1e9 / ringVisited, list / ring,
+               listVisited == ringVisited ? "" : "  (MISMATCH)");
+        free_tree(root);
+    }
+}
+
+int main(int argc, char **argv) {
+    const char *name = argc > 1 ? argv[1] : "all";
+    int maxNodes = argc > 2 ? atoi(argv[2]) : 1000000;
+    int all = strcmp(name, "all") == 0;
+
+    if (all || strcmp(name, "save") == 0) bench_save(maxNodes);
+    if (all || strcmp(name, "load") == 0) {
+        bench_load(maxNodes, 1);
+        bench_load(maxNodes, 3);
+        bench_load(maxNodes, 4);
+        bench_load(maxNodes, 5);
+        bench_load(maxNodes, 6);
+    }
+    if (all || strcmp(name, "hash") == 0) bench_hash(maxNodes);
+    if (all || strcmp(name, "queue") == 0) bench_queue(maxNodes);
+    if (all || strcmp(name, "flat") == 0) bench_flat(maxNodes);
+    if (all || strcmp(name, "canon") == 0) bench_canon(maxNodes);
+    if (all || strcmp(name, "game") == 0) bench_game(maxNodes);
+    if (all || strcmp(name, "snapshot") == 0) bench_snapshot(maxNodes);
+    if (all || strcmp(name, "journal") == 0) bench_journal(maxNodes);
+    if (all || strcmp(name, "crc") == 0) bench_crc();
+    if (all || strcmp(name, "intern") == 0) bench_intern(maxNodes);
+    if (all || strcmp(name, "compress") == 0) bench_compress(maxNodes);
+    if (all || strcmp(name, "lca") == 0) bench_lca(maxNodes);
+    if (all || strcmp(name, "pload") == 0) {
+        bench_parallel_load(maxNodes, 1);
+        bench_parallel_load(maxNodes, 4);
+        bench_parallel_load(maxNodes, 6);
+    }
+
+    return 0;
+}
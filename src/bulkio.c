@@ -0,0 +1,411 @@
+#define _GNU_SOURCE  /* O_DIRECT */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#ifdef __linux__
+#include <sys/syscall.h>
+#include <linux/io_uring.h>
+#endif
+#include "lab5.h"
+
+/* ========== Bulk I/O ========== */
+
+/* A BulkWriter encodes straight into a large aligned buffer and hands
+ * the kernel one BULK_BUFFER block at a time, instead of a stdio call
+ * (and lock) per field. Back ends:
+ *   IO_FD      write(2) per block
+ *   IO_DIRECT  the same through O_DIRECT, bypassing the page cache;
+ *              the last partial block is padded to the alignment and
+ *              the file truncated back to its real length
+ *   IO_URING   blocks are queued on an io_uring while the next one is
+ *              filled (two buffers in flight)
+ * bw_open falls back to IO_FD when the requested back end isn't
+ * available (no io_uring in the kernel, a filesystem without O_DIRECT);
+ * w->backend says which one is in use.
+ */
+
+#define BULK_BUFFER (1 << 20)
+#define BULK_ALIGN 4096  /* O_DIRECT offset, length and address alignment */
+
+#ifdef __linux__
+/* The parts of an io_uring the writer touches: both rings are mapped
+ * from the ring fd, and their head/tail indices are shared with the
+ * kernel (acquire/release on the side the other party writes).
+ */
+struct BulkRing {
+    int fd;
+    void *sqMap;
+    size_t sqMapLen;
+    void *cqMap;
+    size_t cqMapLen;
+    struct io_uring_sqe *sqes;
+    size_t sqesLen;
+    unsigned *sqHead, *sqTail, *sqMask, *sqArray;
+    unsigned *cqHead, *cqTail, *cqMask;
+    struct io_uring_cqe *cqes;
+};
+
+static void ring_free(BulkRing *r)
+{
+    if (r->sqes != NULL) munmap(r->sqes, r->sqesLen);
+    if (r->cqMap != NULL && r->cqMap != r->sqMap) munmap(r->cqMap, r->cqMapLen);
+    if (r->sqMap != NULL) munmap(r->sqMap, r->sqMapLen);
+    if (r->fd >= 0) close(r->fd);
+    free(r);
+}
+
+static BulkRing *ring_new(unsigned entries)
+{
+    struct io_uring_params p;
+    memset(&p, 0, sizeof(p));
+    int fd = (int)syscall(__NR_io_uring_setup, entries, &p);
+    if (fd < 0) {
+        return NULL;  // No io_uring here (old kernel, seccomp, ...)
+    }
+    BulkRing *r = calloc(1, sizeof(BulkRing));
+    if (r == NULL) {
+        close(fd);
+        return NULL;
+    }
+    r->fd = fd;
+    r->sqMapLen = p.sq_off.array + p.sq_entries * sizeof(unsigned);
+    r->cqMapLen = p.cq_off.cqes + p.cq_entries * sizeof(struct io_uring_cqe);
+    if (p.features & IORING_FEAT_SINGLE_MMAP) {
+        if (r->cqMapLen > r->sqMapLen) r->sqMapLen = r->cqMapLen;
+        r->cqMapLen = r->sqMapLen;
+    }
+    r->sqMap = mmap(NULL, r->sqMapLen, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE,
+                    fd, IORING_OFF_SQ_RING);
+    if (r->sqMap == MAP_FAILED) {
+        r->sqMap = NULL;
+        ring_free(r);
+        return NULL;
+    }
+    if (p.features & IORING_FEAT_SINGLE_MMAP) {
+        r->cqMap = r->sqMap;
+    } else {
+        r->cqMap = mmap(NULL, r->cqMapLen, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE,
+                        fd, IORING_OFF_CQ_RING);
+        if (r->cqMap == MAP_FAILED) {
+            r->cqMap = NULL;
+            ring_free(r);
+            return NULL;
+        }
+    }
+    r->sqesLen = p.sq_entries * sizeof(struct io_uring_sqe);
+    r->sqes = mmap(NULL, r->sqesLen, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE,
+                   fd, IORING_OFF_SQES);
+    if (r->sqes == MAP_FAILED) {
+        r->sqes = NULL;
+        ring_free(r);
+        return NULL;
+    }
+    char *sq = r->sqMap;
+    char *cq = r->cqMap;
+    r->sqHead = (unsigned *)(sq + p.sq_off.head);
+    r->sqTail = (unsigned *)(sq + p.sq_off.tail);
+    r->sqMask = (unsigned *)(sq + p.sq_off.ring_mask);
+    r->sqArray = (unsigned *)(sq + p.sq_off.array);
+    r->cqHead = (unsigned *)(cq + p.cq_off.head);
+    r->cqTail = (unsigned *)(cq + p.cq_off.tail);
+    r->cqMask = (unsigned *)(cq + p.cq_off.ring_mask);
+    r->cqes = (struct io_uring_cqe *)(cq + p.cq_off.cqes);
+    return r;
+}
+
+/* Queue and submit one write. Returns 0 if the kernel refused it. */
+static int ring_write(BulkRing *r, int fd, const void *data, size_t len, uint64_t offset,
+                      uint64_t tag)
+{
+    unsigned tail = *r->sqTail;
+    unsigned index = tail & *r->sqMask;
+    struct io_uring_sqe *sqe = &r->sqes[index];
+    memset(sqe, 0, sizeof(*sqe));
+    sqe->opcode = IORING_OP_WRITE;
+    sqe->fd = fd;
+    sqe->addr = (uint64_t)(uintptr_t)data;
+    sqe->len = (uint32_t)len;
+    sqe->off = offset;
+    sqe->user_data = tag;
+    r->sqArray[index] = index;
+    __atomic_store_n(r->sqTail, tail + 1, __ATOMIC_RELEASE);
+    int submitted;
+    do {
+        submitted = (int)syscall(__NR_io_uring_enter, r->fd, 1, 0, 0, NULL, 0);
+    } while (submitted < 0 && errno == EINTR);
+    return submitted == 1;
+}
+
+/* Wait for one completion: its tag and result (bytes or -errno) */
+static int ring_wait(BulkRing *r, uint64_t *tag, int *res)
+{
+    unsigned head = *r->cqHead;
+    while (head == __atomic_load_n(r->cqTail, __ATOMIC_ACQUIRE)) {
+        if (syscall(__NR_io_uring_enter, r->fd, 0, 1, IORING_ENTER_GETEVENTS, NULL, 0) < 0 &&
+            errno != EINTR) {
+            return 0;
+        }
+    }
+    struct io_uring_cqe *cqe = &r->cqes[head & *r->cqMask];
+    *tag = cqe->user_data;
+    *res = cqe->res;
+    __atomic_store_n(r->cqHead, head + 1, __ATOMIC_RELEASE);
+    return 1;
+}
+#else
+struct BulkRing {
+    int unused;
+};
+
+static BulkRing *ring_new(unsigned entries)
+{
+    (void)entries;
+    return NULL;
+}
+
+static void ring_free(BulkRing *r)
+{
+    free(r);
+}
+#endif
+
+/* write(2) all of data at offset, retrying short writes */
+static int write_fully(int fd, const char *data, size_t len, uint64_t offset)
+{
+    while (len > 0) {
+        ssize_t n = pwrite(fd, data, len, (off_t)offset);
+        if (n < 0) {
+            if (errno == EINTR) continue;
+            return 0;
+        }
+        data += n;
+        len -= (size_t)n;
+        offset += (uint64_t)n;
+    }
+    return 1;
+}
+
+#ifdef __linux__
+/* Collect one finished write, completing it with pwrite if the kernel
+ * only wrote part of it. Returns -1 if waiting failed, 0 if the write
+ * did, 1 if it landed.
+ */
+static int ring_reap_one(BulkWriter *w)
+{
+    uint64_t tag;
+    int res;
+    if (!ring_wait(w->ring, &tag, &res)) {
+        return -1;
+    }
+    int slot = (int)tag;
+    size_t want = w->pending[slot];
+    w->pending[slot] = 0;
+    w->inFlight--;
+    if (res < 0) {
+        return 0;
+    }
+    if ((size_t)res < want &&
+        !write_fully(w->fd, w->buffers[slot] + res, want - (size_t)res,
+                     w->pendingAt[slot] + (uint64_t)res)) {
+        return 0;
+    }
+    return 1;
+}
+
+/* Wait until buffer slot is free to fill again */
+static int ring_reap(BulkWriter *w, int slot)
+{
+    while (w->pending[slot] > 0) {
+        if (ring_reap_one(w) != 1) {
+            return 0;
+        }
+    }
+    return 1;
+}
+#endif
+
+/* Hand the buffer to the back end. Until the final flush only whole
+ * BULK_ALIGN blocks go out (keeping O_DIRECT offsets aligned); the
+ * remainder moves to the front of the buffer filled next. The final
+ * flush writes everything, padded to a block for O_DIRECT.
+ */
+static int bw_flush(BulkWriter *w, int final)
+{
+    if (w->failed) {
+        return 0;
+    }
+    size_t len = final ? w->len : w->len / BULK_ALIGN * BULK_ALIGN;
+    size_t rest = w->len - len;
+    if (w->checksum) {
+        w->crc = crc32c(w->crc, w->buf, len);
+    }
+    size_t out = len;
+    if (final && w->backend == IO_DIRECT && len % BULK_ALIGN != 0) {
+        out = (len + BULK_ALIGN - 1) / BULK_ALIGN * BULK_ALIGN;
+        memset(w->buf + len, 0, out - len);
+    }
+    w->writes++;
+    
+    char *filled = w->buf;
+#ifdef __linux__
+    if (w->backend == IO_URING) {
+        int slot = w->current;
+        if (!ring_write(w->ring, w->fd, filled, out, w->offset, (uint64_t)slot)) {
+            w->failed = 1;
+            return 0;
+        }
+        w->pending[slot] = out;
+        w->pendingAt[slot] = w->offset;
+        w->inFlight++;
+        // Fill the other buffer next, once its own write has landed
+        w->current = 1 - slot;
+        w->buf = w->buffers[w->current];
+        if (!ring_reap(w, w->current)) {
+            w->failed = 1;
+            return 0;
+        }
+    } else
+#endif
+    if (!write_fully(w->fd, filled, out, w->offset)) {
+        w->failed = 1;
+        return 0;
+    }
+    memmove(w->buf, filled + len, rest);
+    w->offset += len;
+    w->len = rest;
+    return 1;
+}
+
+/* Create (or truncate) path for writing through backend, or the
+ * IO_FD fallback. Returns 1 on success.
+ */
+int bw_open(BulkWriter *w, const char *path, IoBackend backend)
+{
+    memset(w, 0, sizeof(*w));
+    w->fd = -1;
+    w->backend = IO_FD;
+#ifdef O_DIRECT
+    if (backend == IO_DIRECT) {
+        w->fd = open(path, O_WRONLY | O_CREAT | O_TRUNC | O_DIRECT, 0644);
+        if (w->fd >= 0) {
+            w->backend = IO_DIRECT;
+        }
+    }
+#endif
+    if (w->fd < 0) {
+        w->fd = open(path, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    }
+    if (w->fd < 0) {
+        return 0;
+    }
+    if (backend == IO_URING) {
+        w->ring = ring_new(4);
+        if (w->ring != NULL) {
+            w->backend = IO_URING;
+        }
+    }
+    int buffers = (w->backend == IO_URING) ? 2 : 1;
+    for (int i = 0; i < buffers; i++) {
+        if (posix_memalign((void **)&w->buffers[i], BULK_ALIGN, BULK_BUFFER) != 0) {
+            w->buffers[i] = NULL;
+            bw_close(w, 0);
+            return 0;
+        }
+    }
+    w->buf = w->buffers[0];
+    w->cap = BULK_BUFFER;
+    return 1;
+}
+
+/* Room for len contiguous bytes to encode into, flushing first if the
+ * buffer can't take them. Meant for records: len over BULK_BUFFER
+ * minus one block gets NULL (use bw_write), as does a failed writer.
+ */
+void *bw_reserve(BulkWriter *w, size_t len)
+{
+    if (w->cap - w->len < len && !bw_flush(w, 0)) {
+        return NULL;
+    }
+    if (w->cap - w->len < len) {
+        return NULL;
+    }
+    void *at = w->buf + w->len;
+    w->len += len;
+    return at;
+}
+
+/* Append len bytes, however many */
+int bw_write(BulkWriter *w, const void *data, size_t len)
+{
+    const char *p = data;
+    while (len > 0) {
+        if (w->len == w->cap && !bw_flush(w, 0)) {
+            return 0;
+        }
+        size_t n = w->cap - w->len;
+        if (n > len) {
+            n = len;
+        }
+        memcpy(w->buf + w->len, p, n);
+        w->len += n;
+        p += n;
+        len -= n;
+    }
+    return !w->failed;
+}
+
+/* crc32c of everything written so far (set w->checksum right after
+ * bw_open for it to cover the whole file)
+ */
+uint32_t bw_crc(const BulkWriter *w)
+{
+    return crc32c(w->crc, w->buf, w->len);
+}
+
+/* Flush, optionally fsync, and close. Returns 1 if every byte made it. */
+int bw_close(BulkWriter *w, int sync)
+{
+    int ok = !w->failed;
+    if (w->fd >= 0 && ok && w->len > 0) {
+        // O_DIRECT writes the tail padded to a whole block: cut it back
+        uint64_t size = w->offset + w->len;
+        ok = bw_flush(w, 1);
+        if (ok && w->backend == IO_DIRECT && ftruncate(w->fd, (off_t)size) != 0) {
+            ok = 0;
+        }
+    }
+#ifdef __linux__
+    // Drain the ring even after a failure: the kernel may still be
+    // reading the buffers
+    while (w->ring != NULL && w->inFlight > 0) {
+        int reaped = ring_reap_one(w);
+        if (reaped != 1) {
+            ok = 0;
+        }
+        if (reaped < 0) {
+            break;
+        }
+    }
+#endif
+    if (w->fd >= 0) {
+        if (ok && sync && fsync(w->fd) != 0) {
+            ok = 0;
+        }
+        if (close(w->fd) != 0) {
+            ok = 0;
+        }
+    }
+    if (w->ring != NULL) {
+        ring_free(w->ring);
+    }
+    free(w->buffers[0]);
+    free(w->buffers[1]);
+    memset(w, 0, sizeof(*w));
+    w->fd = -1;
+    return ok;
+}
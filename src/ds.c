@@ -1,7 +1,14 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
-#include <ctype.h>
+#include <sys/mman.h>
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+#if defined(__GNUC__) && defined(__x86_64__)
+#include <immintrin.h>
+#define CANON_HAVE_AVX2 1  /* compiled per function, picked at runtime */
+#endif
 #include "lab5.h"
 
 
@@ -28,6 +35,8 @@ Node *create_question_node(const char *question)
     newNode->yes = NULL;  // Will be set later when children are added
     newNode->no = NULL;   // Will be set later when children are added
     newNode->isQuestion = 1;  // Mark as question node (not a leaf)
+    newNode->isPooled = 0;    // Owned by the heap, released by free_tree
+    newNode->id = -1;         // Assigned when the node joins the tree
 
     return newNode;
 }
@@ -50,50 +59,396 @@ Node *create_animal_node(const char *animal)
     animalNode->yes = NULL;  // Leaf nodes have no children
     animalNode->no = NULL;   // Leaf nodes have no children
     animalNode->isQuestion = 0;  // Mark as leaf node (animal)
+    animalNode->isPooled = 0;    // Owned by the heap, released by free_tree
+    animalNode->id = -1;         // Assigned when the node joins the tree
 
     return animalNode;
 }
 
-/* TODO 3: Implement free_tree (recursive)
- * - This is one of the few recursive functions allowed
- * - Base case: if node is NULL, return
- * - Recursively free left subtree (yes)
- * - Recursively free right subtree (no)
- * - Free the text string
- * - Free the node itself
- * IMPORTANT: Free children before freeing the parent!
+/* TODO 3: Implement free_tree (iterative)
+ * Learned trees are often long chains (every new animal goes down the
+ * same side), so recursion here would overflow the stack. Instead free
+ * in O(1) extra space by rotating the tree into a right-leaning list:
+ * - Base case: if node is NULL or pooled, return (a NodePool owns the
+ *   whole subtree and releases it in one go)
+ * - While node is not NULL:
+ *   - If node has a heap yes child: rotate it up
+ *     (node->yes = yes->no, yes->no = node, node = yes)
+ *   - Otherwise node has no heap yes child: free its text and the node
+ *     and continue with its no child
+ * - Pooled children are simply dropped, never rotated, since their
+ *   links still belong to a live pool
  */
 void free_tree(Node *node) 
 {
-    // Base case: nothing to free if node is NULL
-    if(node==NULL)
+    // Pooled subtrees are released by pool_free, not node by node
+    if(node==NULL || node->isPooled)
     {
         return;
     }
-    
-    // Recursively free children first (post-order traversal)
-    free_tree(node->yes);  // Free left subtree
-    free_tree(node->no);   // Free right subtree
-    
-    // Then free this node's data
-    free(node->text);  // Free the string allocated by strdup
-    free(node);        // Free the node structure itself
+
+    while(node!=NULL)
+    {
+        Node *yes = node->yes;
+        if(yes!=NULL && !yes->isPooled)
+        {
+            // Rotate: yes child becomes the current node, node hangs off
+            // its no side, so the left spine shrinks by one each time
+            node->yes = yes->no;
+            yes->no = node;
+            node = yes;
+        }
+        else
+        {
+            // No heap yes child: free this node, continue down the no side
+            Node *next = node->no;
+            if(next!=NULL && next->isPooled)
+            {
+                next = NULL;  // Leave pooled subtrees to their pool
+            }
+            free(node->text);  // Free the string allocated by strdup
+            free(node);        // Free the node structure itself
+            node = next;
+        }
+    }
 }
 
-/* TODO 4: Implement count_nodes (recursive)
- * - Base case: if root is NULL, return 0
- * - Return 1 + count of left subtree + count of right subtree
+/* TODO 4: Implement count_nodes (iterative)
+ * - Return 0 for an empty tree
+ * - Walk the tree with an explicit FrameStack instead of recursion so
+ *   deep chains can't overflow the call stack
+ * - Count each popped node and push its non-NULL children
  */
 int count_nodes(Node *root) 
 {
-    // Base case: NULL tree has 0 nodes
+    // NULL tree has 0 nodes
     if(root==NULL)
     {
         return 0;
     }
 
-    // Count this node (1) plus all nodes in both subtrees
-    return 1 + count_nodes(root->yes) + count_nodes(root->no);
+    FrameStack stack;
+    fs_init(&stack);
+    fs_push(&stack, root, -1);
+
+    int count = 0;
+    while(!fs_empty(&stack))
+    {
+        // Count this node, then visit both subtrees
+        Node *node = fs_pop(&stack).node;
+        count++;
+        if(node->yes!=NULL)
+        {
+            fs_push(&stack, node->yes, 1);
+        }
+        if(node->no!=NULL)
+        {
+            fs_push(&stack, node->no, 0);
+        }
+    }
+
+    fs_free(&stack);
+    return count;
+}
+
+/* ========== Arena / Node Pool ========== */
+
+#define ARENA_MIN_BLOCK 4096
+#define ARENA_MAX_BLOCK (64 * 1024 * 1024)
+#define ARENA_ALIGN 16
+
+/* Round size up to a multiple of ARENA_ALIGN */
+static size_t arena_round(size_t size)
+{
+    return (size + ARENA_ALIGN - 1) & ~(size_t)(ARENA_ALIGN - 1);
+}
+
+/* Payload of a block starts right after its (aligned) header */
+static char *arena_payload(ArenaBlock *b)
+{
+    return (char*)b + arena_round(sizeof(ArenaBlock));
+}
+
+void arena_init(Arena *a)
+{
+    a->head = NULL;
+    a->nextBlockSize = ARENA_MIN_BLOCK;
+}
+
+/* Push a fresh block with at least size bytes of payload */
+static int arena_new_block(Arena *a, size_t size)
+{
+    size_t capacity = a->nextBlockSize;
+    if(capacity < size)
+    {
+        capacity = size;
+    }
+
+    ArenaBlock *b = (ArenaBlock*)malloc(arena_round(sizeof(ArenaBlock)) + capacity);
+    if(b==NULL)
+    {
+        return 0;  // Out of memory
+    }
+    b->used = 0;
+    b->capacity = capacity;
+    b->next = a->head;
+    a->head = b;
+
+    // Grow geometrically so n allocations need only O(log n) blocks
+    if(a->nextBlockSize < ARENA_MAX_BLOCK)
+    {
+        a->nextBlockSize *= 2;
+    }
+    return 1;
+}
+
+/* Bump-allocate size bytes (ARENA_ALIGN aligned) from the current block */
+void *arena_alloc(Arena *a, size_t size)
+{
+    size = arena_round(size);
+    if(a->head==NULL || a->head->capacity - a->head->used < size)
+    {
+        if(!arena_new_block(a, size))
+        {
+            return NULL;
+        }
+    }
+
+    void *ptr = arena_payload(a->head) + a->head->used;
+    a->head->used += size;
+    return ptr;
+}
+
+/* Make sure the next size bytes of allocations come from one block.
+ * Used by load_tree so a whole file lands in a single allocation.
+ */
+int arena_reserve(Arena *a, size_t size)
+{
+    size = arena_round(size);
+    if(a->head!=NULL && a->head->capacity - a->head->used >= size)
+    {
+        return 1;  // Already enough room
+    }
+    return arena_new_block(a, size);
+}
+
+/* Release every block at once */
+void arena_free(Arena *a)
+{
+    ArenaBlock *curr = a->head;
+    while(curr!=NULL)
+    {
+        ArenaBlock *next = curr->next;
+        free(curr);
+        curr = next;
+    }
+    arena_init(a);
+}
+
+/* ========== String Table ========== */
+
+#define ST_MIN_SLOTS 64
+
+void st_init(StringTable *t)
+{
+    memset(t, 0, sizeof(*t));
+}
+
+/* Slot holding key, or the empty slot where it would go */
+static size_t st_slot(const StringTable *t, const char *key, unsigned hash)
+{
+    size_t mask = t->capacity - 1;
+    size_t i = hash & mask;
+    while(t->keys[i]!=NULL)
+    {
+        if(t->hashes[i]==hash && strcmp(t->keys[i], key)==0)
+        {
+            break;
+        }
+        i = (i + 1) & mask;
+    }
+    return i;
+}
+
+/* Slot index of key, or -1 if it isn't in the table */
+long st_find(const StringTable *t, const char *key)
+{
+    if(t->count==0)
+    {
+        return -1;
+    }
+    size_t i = st_slot(t, key, h_hash(key));
+    return t->keys[i]!=NULL ? (long)i : -1;
+}
+
+/* Double the slot array (keeping load under 1/2) */
+static int st_grow(StringTable *t)
+{
+    size_t capacity = t->capacity ? t->capacity * 2 : ST_MIN_SLOTS;
+    StringTable bigger;
+    bigger.keys = (const char**)calloc(capacity, sizeof(const char*));
+    bigger.hashes = (unsigned*)malloc(capacity * sizeof(unsigned));
+    bigger.values = (int*)malloc(capacity * sizeof(int));
+    if(bigger.keys==NULL || bigger.hashes==NULL || bigger.values==NULL)
+    {
+        free(bigger.keys);
+        free(bigger.hashes);
+        free(bigger.values);
+        return 0;
+    }
+    bigger.capacity = capacity;
+    bigger.count = t->count;
+    for(size_t i = 0; i < t->capacity; i++)
+    {
+        if(t->keys[i]!=NULL)
+        {
+            size_t j = t->hashes[i] & (capacity - 1);
+            while(bigger.keys[j]!=NULL)
+            {
+                j = (j + 1) & (capacity - 1);
+            }
+            bigger.keys[j] = t->keys[i];
+            bigger.hashes[j] = t->hashes[i];
+            bigger.values[j] = t->values[i];
+        }
+    }
+    st_free(t);
+    *t = bigger;
+    return 1;
+}
+
+/* Add key (which must not be present yet) with value. Returns 0 if out
+ * of memory.
+ */
+int st_add(StringTable *t, const char *key, int value)
+{
+    if((t->count + 1) * 2 > t->capacity && !st_grow(t))
+    {
+        return 0;
+    }
+    unsigned hash = h_hash(key);
+    size_t i = st_slot(t, key, hash);
+    t->keys[i] = key;
+    t->hashes[i] = hash;
+    t->values[i] = value;
+    t->count++;
+    return 1;
+}
+
+void st_free(StringTable *t)
+{
+    free(t->keys);
+    free(t->hashes);
+    free(t->values);
+    st_init(t);
+}
+
+void pool_init(NodePool *p)
+{
+    arena_init(&p->nodes);
+    arena_init(&p->strings);
+    p->map = NULL;
+    p->mapLength = 0;
+    st_init(&p->interned);
+    p->seedBlob = NULL;
+    p->seedOffsets = NULL;
+    p->seedCount = 0;
+}
+
+/* The pool's one copy of text, made on first use. Returns NULL if out
+ * of memory.
+ */
+const char *pool_intern(NodePool *p, const char *text)
+{
+    // Strings the pool got from a loaded file join the table first
+    if(p->seedCount > 0)
+    {
+        for(uint32_t i = 0; i < p->seedCount; i++)
+        {
+            const char *seed = p->seedBlob + p->seedOffsets[i];
+            if(st_find(&p->interned, seed) < 0 && !st_add(&p->interned, seed, 0))
+            {
+                return NULL;
+            }
+        }
+        p->seedCount = 0;
+    }
+
+    long slot = st_find(&p->interned, text);
+    if(slot >= 0)
+    {
+        return p->interned.keys[slot];
+    }
+
+    // New text is copied into the paired string arena
+    size_t len = strlen(text);
+    char *copy = (char*)arena_alloc(&p->strings, len + 1);
+    if(copy==NULL)
+    {
+        return NULL;
+    }
+    memcpy(copy, text, len + 1);
+    if(!st_add(&p->interned, copy, 0))
+    {
+        return NULL;
+    }
+    return copy;
+}
+
+/* Create a node whose struct and (interned) text live in the pool */
+Node *pool_node(NodePool *p, const char *text, int isQuestion)
+{
+    // Nodes come from the node arena so they stay densely packed
+    Node *node = (Node*)arena_alloc(&p->nodes, sizeof(Node));
+    if(node==NULL)
+    {
+        return NULL;
+    }
+
+    const char *shared = pool_intern(p, text);
+    if(shared==NULL)
+    {
+        return NULL;
+    }
+
+    node->text = (char*)shared;
+    node->yes = NULL;
+    node->no = NULL;
+    node->isQuestion = isQuestion;
+    node->isPooled = 1;
+    node->id = -1;
+    return node;
+}
+
+void pool_free(NodePool *p)
+{
+    arena_free(&p->nodes);
+    arena_free(&p->strings);
+    if(p->map!=NULL)
+    {
+        munmap(p->map, p->mapLength);  // Text of a mapped tree lives here
+    }
+    p->map = NULL;
+    p->mapLength = 0;
+    st_free(&p->interned);
+    p->seedBlob = NULL;
+    p->seedOffsets = NULL;
+    p->seedCount = 0;
+}
+
+/* Drop the global tree: heap nodes via free_tree, pooled nodes by
+ * releasing g_pool wholesale. Pending edits point into the old tree,
+ * so the undo/redo history is cleared as well.
+ */
+void tree_release()
+{
+    free_tree(g_root);
+    g_root = NULL;
+    g_nextId = 0;
+    pool_free(&g_pool);
+    stats_free();
+    es_clear(&g_undo);
+    es_clear(&g_redo);
 }
 
 /* ========== Frame Stack (for iterative tree traversal) ========== */
@@ -318,89 +673,83 @@ void free_edit_stack(EditStack *s) {
 
 /* ========== Queue (for BFS traversal) ========== */
 
+/* The queue is a growable circular array rather than a linked list, so
+ * a BFS over n nodes does O(log n) allocations instead of n mallocs and
+ * n frees.
+ */
+
 /* TODO 15: Implement q_init
- * - Set front and rear to NULL
- * - Set size to 0
+ * - Allocate an initial array of 16 items (a power of two)
+ * - Set front and size to 0
  */
 void q_init(Queue *q) 
 {
-    // Initialize empty queue
-    q->front = NULL;  // No elements at front
-    q->rear = NULL;   // No elements at rear
-    q->size = 0;      // Queue is empty
+    // Allocate initial ring with capacity 16
+    q->items = (QueueNode*)malloc(16*sizeof(QueueNode));
+    q->front = 0;  // First element lives at items[0]
+    q->size = 0;   // Queue is empty
+    q->capacity = q->items==NULL ? 0 : 16;
 }
 
 /* TODO 16: Implement q_enqueue
- * - Allocate a new QueueNode
- * - Set its treeNode and id fields
- * - Set its next pointer to NULL
- * - If queue is empty (rear == NULL):
- *   - Set both front and rear to the new node
- * - Otherwise:
- *   - Link rear->next to the new node
- *   - Update rear to point to the new node
+ * - If size == capacity, double the capacity:
+ *   - Reallocate the array
+ *   - The wrapped part [0, front) now sits before the old end, so move
+ *     it up past the old capacity to keep the elements contiguous
+ * - Store the node and id at items[(front + size) & (capacity - 1)]
  * - Increment size
  */
 void q_enqueue(Queue *q, Node *node, int id) 
 {
-    // Create new queue node
-    QueueNode* newQNode = (QueueNode*)malloc(sizeof(QueueNode));
-    newQNode->treeNode = node;  // Store the tree node
-    newQNode->id = id;          // Store the ID
-    newQNode->next = NULL;      // This will be the last node
-
-    // Add to queue
-    if(q->rear==NULL)
+    // Grow when full
+    if(q->size==q->capacity)
     {
-        // Queue was empty, new node is both front and rear
-        q->front = newQNode;
-        q->rear = newQNode;
-    }
-    else
-    {
-        // Queue has elements, add to rear
-        q->rear->next = newQNode;  // Link old rear to new node
-        q->rear = newQNode;        // Update rear pointer
+        int newCapacity = q->capacity==0 ? 16 : q->capacity*2;
+        QueueNode* temp = realloc(q->items, newCapacity*sizeof(QueueNode));
+        if(temp==NULL)
+        {
+            return;  // Failed to resize, don't enqueue
+        }
+        q->items = temp;
+
+        // Unwrap: elements [0, front) followed the old end of the ring
+        if(q->front > 0)
+        {
+            memcpy(q->items + q->capacity, q->items, q->front*sizeof(QueueNode));
+        }
+        q->capacity = newCapacity;
     }
 
+    // Add to rear
+    QueueNode* slot = &q->items[(q->front + q->size) & (q->capacity - 1)];
+    slot->treeNode = node;  // Store the tree node
+    slot->id = id;          // Store the ID
+
     // Increment queue size
     q->size = q->size + 1;
 }
 
 /* TODO 17: Implement q_dequeue
- * - If queue is empty (front == NULL), return 0
- * - Save the front node's data to output parameters (*node, *id)
- * - Save front in a temp variable
- * - Move front to front->next
- * - If front is now NULL, set rear to NULL too
- * - Free the temp node
+ * - If queue is empty (size == 0), return 0
+ * - Save the front item's data to output parameters (*node, *id)
+ * - Advance front by one, wrapping at capacity
  * - Decrement size
  * - Return 1
  */
 int q_dequeue(Queue *q, Node **node, int *id) 
 {
     // Check if queue is empty
-    if(q->front==NULL)
+    if(q->size==0)
     {
         return 0;  // Nothing to dequeue
     }
 
-    // Extract data from front node
-    *node = q->front->treeNode;  // Return tree node via pointer
-    *id = q->front->id;           // Return ID via pointer
-
-    // Remove front node from queue
-    QueueNode* temp = q->front;  // Save for freeing
-    q->front = q->front->next;   // Move front to next node
-
-    // If queue is now empty, update rear too
-    if(q->front==NULL)
-    {
-        q->rear = NULL;
-    }
+    // Extract data from front item
+    *node = q->items[q->front].treeNode;  // Return tree node via pointer
+    *id = q->items[q->front].id;          // Return ID via pointer
 
-    // Free the old front node
-    free(temp);
+    // Move front to the next slot, wrapping around
+    q->front = (q->front + 1) & (q->capacity - 1);
     
     // Decrement size and indicate success
     q->size--;
@@ -421,27 +770,185 @@ int q_empty(Queue *q) {
 }
 
 /* TODO 19: Implement q_free
- * - Dequeue all remaining nodes
- * - Use a loop with q_dequeue until queue is empty
+ * - Free the item array
+ * - Reset the queue to an empty state
  */
 void q_free(Queue *q) 
 {
-    Node* n;
-    int id; 
+    // Release the ring itself; the tree nodes aren't owned by the queue
+    free(q->items);
+    q->items = NULL;
+    q->front = 0;
+    q->size = 0;
+    q->capacity = 0;
+}
+
+/* ========== Hash Table ========== */
+
+/* canonicalize classifies bytes as ASCII (the C locale the program runs
+ * in): letters and digits are kept and lowercased, whitespace (space,
+ * \t \n \v \f \r) becomes '_', everything else - punctuation, control
+ * and non-ASCII bytes - is dropped.
+ */
+static char canon_char(unsigned char c)
+{
+    if(c>='A' && c<='Z')
+    {
+        return (char)(c | 0x20);  // Lowercase
+    }
+    if((c>='a' && c<='z') || (c>='0' && c<='9'))
+    {
+        return (char)c;
+    }
+    if(c==' ' || (c>='\t' && c<='\r'))
+    {
+        return '_';
+    }
+    return 0;  // Drop
+}
 
-    // Dequeue all elements to free queue nodes
-    while(q_dequeue(q, &n, &id))
+/* Canonicalize len bytes of s one at a time; returns the output length */
+static size_t canon_scalar(const unsigned char *s, size_t len, char *out)
+{
+    size_t j = 0;
+    for(size_t i = 0; i < len; i++)
     {
-        // q_dequeue frees the QueueNode, just continue
+        char c = canon_char(s[i]);
+        if(c!=0)
+        {
+            out[j++] = c;
+        }
     }
+    return j;
+}
 
-    // Ensure queue is in clean state
-    q->front = NULL;
-    q->rear = NULL;
-    q->size = 0;
+/* Vector paths: classify a whole block with byte compares, store the
+ * mapped block in one go when every byte is kept (the common case:
+ * words and spaces), and otherwise copy out just the kept bytes using
+ * the compare mask. Signed compares put bytes >= 0x80 below every
+ * range, so non-ASCII bytes are dropped just like in canon_char. Both
+ * return how many input bytes they consumed (whole blocks only) and
+ * add the bytes written to *outLen; the caller finishes the tail.
+ */
+#if defined(__SSE2__)
+static size_t canon_sse2(const unsigned char *s, size_t len, char *out, size_t *outLen)
+{
+    const __m128i upperLo = _mm_set1_epi8('A' - 1), upperHi = _mm_set1_epi8('Z' + 1);
+    const __m128i lowerLo = _mm_set1_epi8('a' - 1), lowerHi = _mm_set1_epi8('z' + 1);
+    const __m128i digitLo = _mm_set1_epi8('0' - 1), digitHi = _mm_set1_epi8('9' + 1);
+    const __m128i ctrlLo = _mm_set1_epi8('\t' - 1), ctrlHi = _mm_set1_epi8('\r' + 1);
+    const __m128i space = _mm_set1_epi8(' '), underscore = _mm_set1_epi8('_');
+    const __m128i caseBit = _mm_set1_epi8(0x20);
+    size_t i = 0, j = *outLen;
+
+    for(; i + 16 <= len; i += 16)
+    {
+        __m128i b = _mm_loadu_si128((const __m128i*)(s + i));
+        __m128i upper = _mm_and_si128(_mm_cmpgt_epi8(b, upperLo), _mm_cmpgt_epi8(upperHi, b));
+        __m128i lower = _mm_or_si128(b, _mm_and_si128(upper, caseBit));
+        __m128i alnum = _mm_or_si128(
+            _mm_and_si128(_mm_cmpgt_epi8(lower, lowerLo), _mm_cmpgt_epi8(lowerHi, lower)),
+            _mm_and_si128(_mm_cmpgt_epi8(b, digitLo), _mm_cmpgt_epi8(digitHi, b)));
+        __m128i white = _mm_or_si128(_mm_cmpeq_epi8(b, space),
+            _mm_and_si128(_mm_cmpgt_epi8(b, ctrlLo), _mm_cmpgt_epi8(ctrlHi, b)));
+        __m128i mapped = _mm_or_si128(_mm_and_si128(alnum, lower),
+                                      _mm_and_si128(white, underscore));
+        unsigned keep = (unsigned)_mm_movemask_epi8(_mm_or_si128(alnum, white));
+
+        if(keep==0xFFFF)
+        {
+            // j <= i, so the store stays inside out's len + 1 bytes
+            _mm_storeu_si128((__m128i*)(out + j), mapped);
+            j += 16;
+        }
+        else
+        {
+            char block[16];
+            _mm_storeu_si128((__m128i*)block, mapped);
+            while(keep!=0)
+            {
+                out[j++] = block[__builtin_ctz(keep)];
+                keep &= keep - 1;
+            }
+        }
+    }
+    *outLen = j;
+    return i;
 }
+#endif
 
-/* ========== Hash Table ========== */
+#if defined(CANON_HAVE_AVX2)
+__attribute__((target("avx2")))
+static size_t canon_avx2(const unsigned char *s, size_t len, char *out, size_t *outLen)
+{
+    const __m256i upperLo = _mm256_set1_epi8('A' - 1), upperHi = _mm256_set1_epi8('Z' + 1);
+    const __m256i lowerLo = _mm256_set1_epi8('a' - 1), lowerHi = _mm256_set1_epi8('z' + 1);
+    const __m256i digitLo = _mm256_set1_epi8('0' - 1), digitHi = _mm256_set1_epi8('9' + 1);
+    const __m256i ctrlLo = _mm256_set1_epi8('\t' - 1), ctrlHi = _mm256_set1_epi8('\r' + 1);
+    const __m256i space = _mm256_set1_epi8(' '), underscore = _mm256_set1_epi8('_');
+    const __m256i caseBit = _mm256_set1_epi8(0x20);
+    size_t i = 0, j = *outLen;
+
+    for(; i + 32 <= len; i += 32)
+    {
+        __m256i b = _mm256_loadu_si256((const __m256i*)(s + i));
+        __m256i upper = _mm256_and_si256(_mm256_cmpgt_epi8(b, upperLo), _mm256_cmpgt_epi8(upperHi, b));
+        __m256i lower = _mm256_or_si256(b, _mm256_and_si256(upper, caseBit));
+        __m256i alnum = _mm256_or_si256(
+            _mm256_and_si256(_mm256_cmpgt_epi8(lower, lowerLo), _mm256_cmpgt_epi8(lowerHi, lower)),
+            _mm256_and_si256(_mm256_cmpgt_epi8(b, digitLo), _mm256_cmpgt_epi8(digitHi, b)));
+        __m256i white = _mm256_or_si256(_mm256_cmpeq_epi8(b, space),
+            _mm256_and_si256(_mm256_cmpgt_epi8(b, ctrlLo), _mm256_cmpgt_epi8(ctrlHi, b)));
+        __m256i mapped = _mm256_or_si256(_mm256_and_si256(alnum, lower),
+                                         _mm256_and_si256(white, underscore));
+        unsigned keep = (unsigned)_mm256_movemask_epi8(_mm256_or_si256(alnum, white));
+
+        if(keep==0xFFFFFFFFu)
+        {
+            _mm256_storeu_si256((__m256i*)(out + j), mapped);
+            j += 32;
+        }
+        else
+        {
+            char block[32];
+            _mm256_storeu_si256((__m256i*)block, mapped);
+            while(keep!=0)
+            {
+                out[j++] = block[__builtin_ctz(keep)];
+                keep &= keep - 1;
+            }
+        }
+    }
+    *outLen = j;
+    return i;
+}
+#endif
+
+/* Canonicalize s into out, which must have room for strlen(s) + 1 bytes
+ * (the result is never longer than the input). Returns the length of the
+ * result. Uses AVX2 or SSE2 for whole blocks when the CPU has them and
+ * the scalar loop for the rest; all paths give identical output.
+ */
+size_t canonicalize_into(const char *s, char *out)
+{
+    const unsigned char *in = (const unsigned char*)s;
+    size_t len = strlen(s);
+    size_t done = 0, j = 0;
+
+#if defined(CANON_HAVE_AVX2)
+    if(__builtin_cpu_supports("avx2"))
+    {
+        done = canon_avx2(in, len, out, &j);
+    }
+#endif
+#if defined(__SSE2__)
+    done += canon_sse2(in + done, len - done, out, &j);
+#endif
+    j += canon_scalar(in + done, len - done, out + j);
+
+    out[j] = '\0';
+    return j;
+}
 
 /* TODO 20: Implement canonicalize
  * Convert a string to canonical form for hashing:
@@ -453,228 +960,440 @@ void q_free(Queue *q)
  * 
  * Steps:
  * - Allocate result buffer (strlen(s) + 1)
- * - Iterate through input string
- * - For each character:
- *   - If alphanumeric: add lowercase version to result
- *   - If whitespace: add underscore
- *   - Otherwise: skip it
- * - Null-terminate result
+ * - Canonicalize into it (canonicalize_into)
  * - Return the new string
  */
 char *canonicalize(const char *s) 
 {
     // Allocate buffer for canonicalized string
     char* resultBuffer = (char*)malloc(strlen(s)+1);
-    int j = 0;  // Index for result buffer
-    
-    // Process each character in input string
-    for(int i = 0; s[i]!='\0'; i++)
+    if(resultBuffer==NULL)
     {
-        if(isalnum(s[i]))
+        return NULL;
+    }
+    canonicalize_into(s, resultBuffer);
+    return resultBuffer;
+}
+
+/* TODO 21: Implement h_hash
+ * Originally djb2 (hash * 33 + c), which mixes poorly: keys that share
+ * a long prefix ("does_it_have_...") differ only in their last few
+ * characters, and only the low bits are used to pick a slot.
+ *
+ * Now a wyhash-style hash: 8 bytes at a time, each pair of words
+ * combined with a 64x64->128-bit multiply whose halves are folded
+ * together, so every input bit reaches every output bit.
+ * h_hash_seeded mixes in a seed (per-table, see Hash.seed) so tables
+ * can be randomized; h_hash uses seed 0.
+ */
+#define WY_P0 0xa0761d6478bd642fULL
+#define WY_P1 0xe7037ed1a0b428dbULL
+#define WY_P2 0x8ebc6af09c88c6e3ULL
+#define WY_P3 0x589965cc75374cc3ULL
+
+/* 128-bit product of a and b, low half xor high half */
+static uint64_t wy_mix(uint64_t a, uint64_t b)
+{
+#if defined(__SIZEOF_INT128__)
+    __uint128_t r = (__uint128_t)a * b;
+    return (uint64_t)r ^ (uint64_t)(r >> 64);
+#else
+    uint64_t ha = a >> 32, la = (uint32_t)a, hb = b >> 32, lb = (uint32_t)b;
+    uint64_t rh = ha * hb, rm0 = ha * lb, rm1 = hb * la, rl = la * lb;
+    uint64_t t = rl + (rm0 << 32), c = t < rl;
+    uint64_t lo = t + (rm1 << 32);
+    c += lo < t;
+    uint64_t hi = rh + (rm0 >> 32) + (rm1 >> 32) + c;
+    return lo ^ hi;
+#endif
+}
+
+/* Unaligned little-endian-agnostic loads; memcpy compiles to one mov */
+static uint64_t wy_r8(const unsigned char *p)
+{
+    uint64_t v;
+    memcpy(&v, p, 8);
+    return v;
+}
+
+static uint64_t wy_r4(const unsigned char *p)
+{
+    uint32_t v;
+    memcpy(&v, p, 4);
+    return v;
+}
+
+unsigned h_hash_seeded(const char *s, uint64_t seed)
+{
+    const unsigned char *p = (const unsigned char*)s;
+    size_t len = strlen(s);
+    uint64_t a, b;
+
+    seed ^= wy_mix(seed ^ WY_P0, WY_P1);
+    if(len <= 16)
+    {
+        if(len >= 4)
         {
-            // Keep alphanumeric characters, convert to lowercase
-            resultBuffer[j] = tolower(s[i]);
-            j++;
+            // Two overlapping 4-byte reads from each end cover 4..16 bytes
+            size_t mid = (len >> 3) << 2;
+            a = (wy_r4(p) << 32) | wy_r4(p + mid);
+            b = (wy_r4(p + len - 4) << 32) | wy_r4(p + len - 4 - mid);
         }
-        else if(isspace(s[i]))
+        else if(len > 0)
         {
-            // Replace spaces with underscores
-            resultBuffer[j] = '_';
-            j++;
+            a = ((uint64_t)p[0] << 16) | ((uint64_t)p[len >> 1] << 8) | p[len - 1];
+            b = 0;
         }
-        else 
+        else
+        {
+            a = b = 0;
+        }
+    }
+    else
+    {
+        size_t i = len;
+        if(i > 48)
+        {
+            // Three independent lanes for long keys
+            uint64_t see1 = seed, see2 = seed;
+            do
+            {
+                seed = wy_mix(wy_r8(p) ^ WY_P1, wy_r8(p + 8) ^ seed);
+                see1 = wy_mix(wy_r8(p + 16) ^ WY_P2, wy_r8(p + 24) ^ see1);
+                see2 = wy_mix(wy_r8(p + 32) ^ WY_P3, wy_r8(p + 40) ^ see2);
+                p += 48;
+                i -= 48;
+            } while(i > 48);
+            seed ^= see1 ^ see2;
+        }
+        while(i > 16)
         {
-            // Skip punctuation and other characters
-            continue;
+            seed = wy_mix(wy_r8(p) ^ WY_P1, wy_r8(p + 8) ^ seed);
+            p += 16;
+            i -= 16;
         }
+        // Last 16 bytes (may overlap what was already mixed)
+        a = wy_r8(p + i - 16);
+        b = wy_r8(p + i - 8);
     }
 
-    // Null-terminate the result string
-    resultBuffer[j] = '\0';
-    return resultBuffer;
+    uint64_t h = wy_mix(wy_mix(a ^ WY_P1, b ^ seed) ^ WY_P0 ^ len, WY_P1 ^ seed);
+    return (unsigned)(h ^ (h >> 32));
+}
+
+unsigned h_hash(const char *s)
+{
+    return h_hash_seeded(s, 0);
+}
+
+/* Tables grow (doubling) once size exceeds 7/10 of the slots */
+#define H_MIN_SLOTS 8
+#define H_LOAD_NUM 7
+#define H_LOAD_DEN 10
+
+/* An IdList keeps up to IDLIST_INLINE ids in the list itself (sharing
+ * space with the heap pointer), so the usual one- or two-animal entry
+ * needs no allocation. capacity > IDLIST_INLINE means the ids moved to
+ * the heap; capacity 0 marks an empty slot's list.
+ */
+static int *idlist_ids(IdList *l)
+{
+    return l->capacity > IDLIST_INLINE ? l->u.heap : l->u.inlineIds;
 }
 
-/* TODO 21: Implement h_hash (djb2 algorithm)
- * unsigned hash = 5381;
- * For each character c in the string:
- *   hash = ((hash << 5) + hash) + c;  // hash * 33 + c
- * Return hash
+/* Append id, spilling to (or growing) a heap array once the list is full */
+static int idlist_append(IdList *l, int id)
+{
+    if(l->count==l->capacity)
+    {
+        int newCap = l->capacity * 2;  // Double capacity
+        int *heap;
+        if(l->capacity > IDLIST_INLINE)
+        {
+            heap = (int*)realloc(l->u.heap, newCap*sizeof(int));
+        }
+        else
+        {
+            heap = (int*)malloc(newCap*sizeof(int));
+            if(heap!=NULL)
+            {
+                memcpy(heap, l->u.inlineIds, l->count*sizeof(int));
+            }
+        }
+        if(heap==NULL)
+        {
+            return 0;  // Failed to resize
+        }
+        l->u.heap = heap;
+        l->capacity = newCap;
+    }
+    idlist_ids(l)[l->count++] = id;
+    return 1;
+}
+
+static void idlist_free(IdList *l)
+{
+    if(l->capacity > IDLIST_INLINE)
+    {
+        free(l->u.heap);
+    }
+    memset(l, 0, sizeof(*l));
+}
+
+/* Key stored in an entry */
+static const char *h_key(const Hash *h, const Entry *e)
+{
+    return h->keys + e->keyOffset;
+}
+
+/* Find the slot holding key, or the empty slot where it would go.
+ * Linear probing from hash & (nslots - 1); the cached hash lets most
+ * mismatches skip the strcmp entirely.
  */
-unsigned h_hash(const char *s) {
-    unsigned hash = 5381;  // Initial hash value (djb2 magic number)
-    
-    // Process each character in string
-    for(int i = 0; s[i]!='\0'; i++)
+static int h_find_slot(const Hash *h, const char *key, unsigned hash)
+{
+    unsigned mask = (unsigned)h->nslots - 1;
+    unsigned idx = hash & mask;
+    while(h->slots[idx].vals.count!=0)
+    {
+        Entry *e = &h->slots[idx];
+        if(e->hash==hash && strcmp(h_key(h, e), key)==0)
+        {
+            return (int)idx;  // Found matching key
+        }
+        idx = (idx + 1) & mask;  // Next slot, wrapping around
+    }
+    return (int)idx;  // Empty slot
+}
+
+/* Reinsert every entry into a fresh array of newSlots slots. Live keys
+ * are copied into a fresh buffer in slot order, which also drops the
+ * bytes of any removed keys.
+ */
+static int h_rehash(Hash *h, int newSlots)
+{
+    Entry *slots = (Entry*)calloc(newSlots, sizeof(Entry));
+    char *keys = (char*)malloc(h->keyCapacity);
+    if(slots==NULL || (keys==NULL && h->keyCapacity>0))
+    {
+        free(slots);
+        free(keys);
+        return 0;
+    }
+
+    size_t keyBytes = 0;
+    unsigned mask = (unsigned)newSlots - 1;
+    for(int i = 0; i<h->nslots; i++)
     {
-        // hash * 33 + c (using bit shift for efficiency)
-        hash = ((hash << 5) + hash) + s[i]; 
+        Entry *e = &h->slots[i];
+        if(e->vals.count==0)
+        {
+            continue;  // Empty slot
+        }
+
+        // Move the key into the new buffer
+        size_t len = strlen(h_key(h, e)) + 1;
+        memcpy(keys + keyBytes, h_key(h, e), len);
+
+        // Reinsert using the cached hash (no rehashing of key bytes)
+        unsigned idx = e->hash & mask;
+        while(slots[idx].vals.count!=0)
+        {
+            idx = (idx + 1) & mask;
+        }
+        slots[idx] = *e;
+        slots[idx].keyOffset = keyBytes;
+        keyBytes += len;
     }
-    return hash;
+
+    free(h->slots);
+    free(h->keys);
+    h->slots = slots;
+    h->nslots = newSlots;
+    h->keys = keys;
+    h->keyBytes = keyBytes;
+    h->deadKeyBytes = 0;
+    return 1;
+}
+
+/* Double the slot array */
+static int h_grow(Hash *h)
+{
+    return h_rehash(h, h->nslots * 2);
+}
+
+/* Append key to the contiguous key buffer, returning its offset */
+static int h_store_key(Hash *h, const char *key, size_t *outOffset)
+{
+    size_t len = strlen(key) + 1;
+    if(h->keyBytes + len > h->keyCapacity)
+    {
+        // Grow geometrically so appends stay amortized O(1)
+        size_t newCap = h->keyCapacity ? h->keyCapacity * 2 : 256;
+        while(newCap < h->keyBytes + len)
+        {
+            newCap *= 2;
+        }
+        char *keys = (char*)realloc(h->keys, newCap);
+        if(keys==NULL)
+        {
+            return 0;
+        }
+        h->keys = keys;
+        h->keyCapacity = newCap;
+    }
+    memcpy(h->keys + h->keyBytes, key, len);
+    *outOffset = h->keyBytes;
+    h->keyBytes += len;
+    return 1;
 }
 
 /* TODO 22: Implement h_init
- * - Allocate buckets array using calloc (initializes to NULL)
- * - Set nbuckets field
- * - Set size to 0
+ * - Round nbuckets up to a power of two (at least H_MIN_SLOTS); it is
+ *   only a starting size, the table grows on demand
+ * - Allocate the slot array using calloc (all slots empty)
+ * - Start with an empty key buffer and size 0
+ * h_init_seeded also picks the seed the table hashes its keys with;
+ * h_init uses seed 0.
  */
 void h_init(Hash *h, int nbuckets) 
 {
-    // Allocate array of bucket pointers (calloc initializes to NULL)
-    h->buckets = (Entry**)calloc(nbuckets, sizeof(Entry*));
-    
-    // Initialize hash table properties
-    h->nbuckets = nbuckets;  // Number of buckets
-    h->size = 0;             // Start with no entries
+    h_init_seeded(h, nbuckets, 0);
+}
+
+void h_init_seeded(Hash *h, int nbuckets, uint64_t seed) 
+{
+    int nslots = H_MIN_SLOTS;
+    while(nslots < nbuckets)
+    {
+        nslots *= 2;
+    }
+
+    // Allocate slot array (calloc leaves every slot empty)
+    h->slots = (Entry*)calloc(nslots, sizeof(Entry));
+    h->nslots = h->slots ? nslots : 0;
+    h->size = 0;  // Start with no entries
+
+    // Keys are appended on first insert
+    h->keys = NULL;
+    h->keyBytes = 0;
+    h->keyCapacity = 0;
+    h->deadKeyBytes = 0;
+    h->seed = seed;
 }
 
 /* TODO 23: Implement h_put
  * Add animalId to the list for the given key
  * 
  * Steps:
- * 1. Compute bucket index: idx = h_hash(key) % nbuckets
- * 2. Search the chain at buckets[idx] for an entry with matching key
- * 3. If found:
+ * 1. Compute the key's hash (with the table's seed) and probe for its slot
+ * 2. If found:
  *    - Check if animalId already exists in the vals list
  *    - If yes, return 0 (no change)
- *    - If no, add animalId to vals.ids array (resize if needed), return 1
- * 4. If not found:
- *    - Create new Entry with strdup(key)
- *    - Initialize vals with initial capacity (e.g., 4)
- *    - Add animalId as first element
- *    - Insert at head of chain (buckets[idx])
+ *    - If no, append animalId to vals (idlist_append), return 1
+ * 3. If not found:
+ *    - Grow the table first if it would pass the load factor, then
+ *      re-probe for the empty slot
+ *    - Append the key to the key buffer
+ *    - Initialize vals with animalId as its first, inline, id
  *    - Increment h->size
  *    - Return 1
  */
-int h_put(Hash *h, const char *key, int animalId) 
+static int h_insert(Hash *h, const char *key, int animalId, int checkDup)
 {
-    // Calculate which bucket this key belongs in
-    int idx = h_hash(key) % h->nbuckets;
-
-    // Search for existing entry with this key
-    Entry* curr = h->buckets[idx];
-    while(curr!=NULL)
+    if(h->nslots==0)
     {
-        if(strcmp(curr->key, key)==0)
+        h_init_seeded(h, H_MIN_SLOTS, h->seed);  // Lazily set up a zeroed table
+        if(h->nslots==0)
         {
-            break;  // Found matching key
+            return 0;
         }
-        curr = curr->next;
     }
 
-    if(curr!=NULL)
+    // Find existing entry or the empty slot for this key
+    unsigned hash = h_hash_seeded(key, h->seed);
+    int idx = h_find_slot(h, key, hash);
+    Entry* curr = &h->slots[idx];
+
+    if(curr->vals.count!=0)
     {
         // Entry exists, check if animalId already in list
-        for(int i = 0; i<curr->vals.count; i++)
+        int *ids = idlist_ids(&curr->vals);
+        for(int i = 0; checkDup && i<curr->vals.count; i++)
         {
-            if(curr->vals.ids[i]==animalId)
+            if(ids[i]==animalId)
             {
                 return 0;  // Animal already associated with this key
             }
         }
 
-        // Need to add animalId to existing entry
-        if(curr->vals.count==curr->vals.capacity)
-        {
-            // Need to resize the ids array
-            int newCap;
-            if(curr->vals.capacity>0)
-            {
-                newCap = curr->vals.capacity * 2;  // Double capacity
-            }
-            else
-            {
-                newCap = 4;  // Initial capacity
-            }
-
-            // Reallocate ids array
-            int* newID = (int*)realloc(curr->vals.ids, newCap*sizeof(int));
-            if(newID==NULL)
-            {
-                return 0;  // Failed to resize
-            }
-            curr->vals.ids = newID;
-            curr->vals.capacity = newCap;
-        }
-
         // Add animalId to the list
-        curr->vals.ids[curr->vals.count] = animalId;
-        curr->vals.count +=1; 
-        return 1;  // Successfully added
+        return idlist_append(&curr->vals, animalId);
     }
-    else 
+
+    // New key: keep the load factor below H_LOAD_NUM/H_LOAD_DEN
+    if((long)(h->size + 1) * H_LOAD_DEN > (long)h->nslots * H_LOAD_NUM)
     {
-        // Create new entry for this key
-        Entry* newEntry = (Entry*)malloc(sizeof(Entry));
-        if(newEntry==NULL)
-        {
-            return 0;  // Failed to allocate
-        }
-        
-        // Copy key string
-        newEntry->key = strdup(key);
-        if(newEntry->key==NULL)
-        {
-            free(newEntry);
-            return 0;  // Failed to copy key
-        }
-        
-        // Initialize vals list with initial capacity
-        newEntry->vals.capacity = 4;
-        newEntry->vals.count = 0;
-        newEntry->vals.ids = (int*)malloc(4*sizeof(int));
-        if(newEntry->vals.ids == NULL)
+        if(!h_grow(h))
         {
-            free(newEntry->key);
-            free(newEntry);
-            return 0;  // Failed to allocate ids array
+            return 0;  // Failed to grow
         }
-        
-        // Add first animalId
-        newEntry->vals.ids[newEntry->vals.count++] = animalId;
-
-        // Insert at head of bucket chain
-        newEntry->next = h->buckets[idx];
-        h->buckets[idx] = newEntry;
-        h->size +=1;  // Increment entry count
+        idx = h_find_slot(h, key, hash);
+        curr = &h->slots[idx];
+    }
 
-        return 1;  // Successfully added
+    // Copy key into the key buffer
+    size_t keyOffset;
+    if(!h_store_key(h, key, &keyOffset))
+    {
+        return 0;  // Failed to copy key
     }
+
+    // Fill the slot; a non-zero count marks it occupied. The first ids
+    // are stored inline, so a new entry allocates nothing.
+    curr->hash = hash;
+    curr->keyOffset = keyOffset;
+    curr->vals.capacity = IDLIST_INLINE;
+    curr->vals.u.inlineIds[0] = animalId;
+    curr->vals.count = 1;
+    h->size +=1;  // Increment entry count
+
+    return 1;  // Successfully added
+}
+
+int h_put(Hash *h, const char *key, int animalId)
+{
+    return h_insert(h, key, animalId, 1);
+}
+
+/* Like h_put, but skips the O(k) duplicate scan of the key's id list.
+ * For bulk builds where the caller knows each pair is new (a question
+ * shared by thousands of subtrees would otherwise make them quadratic).
+ */
+int h_add(Hash *h, const char *key, int animalId)
+{
+    return h_insert(h, key, animalId, 0);
 }
 
 /* TODO 24: Implement h_contains
  * Check if the hash table contains the given key-animalId pair
  * 
  * Steps:
- * 1. Compute bucket index
- * 2. Search the chain for matching key
- * 3. If found, search vals.ids array for animalId
- * 4. Return 1 if found, 0 otherwise
+ * 1. Probe for the key's slot
+ * 2. If found, search the key's ids for animalId
+ * 3. Return 1 if found, 0 otherwise
  */
 int h_contains(const Hash *h, const char *key, int animalId) 
 {
-    // Calculate which bucket this key would be in
-    int idx = h_hash(key) % h->nbuckets;
-    
-    // Search for entry with matching key
-    Entry* curr = h->buckets[idx];
-    while(curr!=NULL)
-    {
-        if(strcmp(curr->key, key)==0)
-        {
-            break;  // Found matching key
-        }
-        curr = curr->next;
-    }
+    int count;
+    int *ids = h_get_ids(h, key, &count);
 
-    if(curr!=NULL)
+    // Search for animalId in the key's list (count is 0 if key missing)
+    for(int i = 0; i<count; i++)
     {
-        // Entry found, search for animalId in its list
-        for(int i = 0; i<curr->vals.count; i++)
+        if(ids[i]==animalId)
         {
-            if(curr->vals.ids[i]==animalId)
-            {
-                return 1;  // Found the key-animalId pair
-            }
+            return 1;  // Found the key-animalId pair
         }
     }
 
@@ -687,31 +1406,28 @@ int h_contains(const Hash *h, const char *key, int animalId)
  * Return NULL if key not found
  * 
  * Steps:
- * 1. Compute bucket index
- * 2. Search chain for matching key
- * 3. If found:
+ * 1. Probe for the key's slot
+ * 2. If found:
  *    - Set *outCount = vals.count
- *    - Return vals.ids
- * 4. If not found:
+ *    - Return the ids (inline or heap); valid until the table changes
+ * 3. If not found:
  *    - Set *outCount = 0
  *    - Return NULL
  */
 int *h_get_ids(const Hash *h, const char *key, int *outCount) 
 {
-    // Calculate which bucket this key would be in
-    int idx = h_hash(key) % h->nbuckets;
-    
-    // Search for entry with matching key
-    Entry* curr = h->buckets[idx];
-    while(curr!=NULL)
+    if(h->nslots==0)
     {
-        if(strcmp(curr->key, key)==0)
-        {
-            // Found the key, return its ids array
-            *outCount = curr->vals.count;
-            return curr->vals.ids;
-        }
-        curr = curr->next;
+        *outCount = 0;
+        return NULL;  // Table never initialized
+    }
+
+    const Entry *e = &h->slots[h_find_slot(h, key, h_hash_seeded(key, h->seed))];
+    if(e->vals.count!=0)
+    {
+        // Found the key, return its ids array
+        *outCount = e->vals.count;
+        return idlist_ids((IdList*)&e->vals);
     }
 
     // Key not found
@@ -719,45 +1435,115 @@ int *h_get_ids(const Hash *h, const char *key, int *outCount)
     return NULL;
 }
 
+/* Remove animalId from key's list; the entry itself goes once its list
+ * is empty. Returns 1 if the pair was present.
+ *
+ * Deleting from a linear-probing table without tombstones: walk the
+ * cluster after the hole and pull back any entry whose home slot lies
+ * at or before the hole, so every remaining key stays reachable.
+ */
+int h_remove(Hash *h, const char *key, int animalId)
+{
+    if(h->nslots==0)
+    {
+        return 0;  // Table never initialized
+    }
+
+    int idx = h_find_slot(h, key, h_hash_seeded(key, h->seed));
+    Entry *e = &h->slots[idx];
+
+    // Find animalId in the entry's list
+    int *ids = idlist_ids(&e->vals);
+    int pos = -1;
+    for(int i = 0; i<e->vals.count; i++)
+    {
+        if(ids[i]==animalId)
+        {
+            pos = i;
+            break;
+        }
+    }
+    if(pos<0)
+    {
+        return 0;  // Key missing or animalId not in list
+    }
+
+    // Order of ids isn't significant, so fill the gap with the last one
+    e->vals.count -= 1;
+    ids[pos] = ids[e->vals.count];
+    if(e->vals.count>0)
+    {
+        return 1;  // Entry still has other ids
+    }
+
+    // List is empty: drop the entry (its key bytes are reclaimed below)
+    h->deadKeyBytes += strlen(h_key(h, e)) + 1;
+    idlist_free(&e->vals);
+    h->size -= 1;
+
+    // Backward-shift the rest of the cluster into the hole
+    unsigned mask = (unsigned)h->nslots - 1;
+    unsigned hole = (unsigned)idx;
+    unsigned j = hole;
+    while(1)
+    {
+        j = (j + 1) & mask;
+        Entry *next = &h->slots[j];
+        if(next->vals.count==0)
+        {
+            break;  // End of cluster
+        }
+
+        // Move it if the hole sits between its home slot and j
+        unsigned home = next->hash & mask;
+        if(((j - home) & mask) >= ((j - hole) & mask))
+        {
+            // Inline ids travel with the entry
+            h->slots[hole] = *next;
+            memset(&next->vals, 0, sizeof(next->vals));
+            hole = j;
+        }
+    }
+
+    // Once removed keys outweigh live ones, rehash in place to compact
+    // the key buffer, so remove/re-put cycles can't grow it without
+    // bound. A failed rehash leaves the table as it was.
+    if(h->deadKeyBytes > h->keyBytes - h->deadKeyBytes)
+    {
+        h_rehash(h, h->nslots);
+    }
+    return 1;
+}
+
 /* TODO 26: Implement h_free
  * Free all memory associated with the hash table
  * 
  * Steps:
- * - For each bucket:
- *   - Traverse the chain
- *   - For each entry:
- *     - Free the key string
- *     - Free the vals.ids array
- *     - Free the entry itself
- * - Free the buckets array
- * - Set buckets to NULL, size to 0
+ * - Free the heap ids array of every occupied slot that spilled
+ * - Free the slot array and the key buffer
+ * - Reset the table to the zeroed state
  */
 void h_free(Hash *h) 
 {
-    // Free all entries in each bucket
-    for(int i = 0; i<h->nbuckets; i++)
+    // Free each entry's ids array
+    for(int i = 0; i<h->nslots; i++)
     {
-        Entry* curr = h->buckets[i];
-        Entry* next;
-        
-        // Traverse the chain at this bucket
-        while(curr!=NULL)
+        if(h->slots[i].vals.count!=0)
         {
-            // Free entry's data
-            free(curr->key);      // Free the key string
-            free(curr->vals.ids); // Free the ids array
-            
-            // Move to next and free current entry
-            next = curr->next;
-            free(curr);
-            curr = next;
+            idlist_free(&h->slots[i].vals);
         }
     }
 
-    // Free the buckets array itself
-    free(h->buckets);
+    // Free the slot array and the shared key buffer
+    free(h->slots);
+    free(h->keys);
     
     // Reset hash table to empty state
-    h->buckets = NULL;
+    h->slots = NULL;
+    h->nslots = 0;
     h->size = 0;
-}
\ No newline at end of file
+    h->keys = NULL;
+    h->keyBytes = 0;
+    h->keyCapacity = 0;
+    h->deadKeyBytes = 0;
+}
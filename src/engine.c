@@ -0,0 +1,505 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "lab5.h"
+
+/* ========== Game Engine ========== */
+
+/* Start a new game at the root of g_root.
+ * Returns 1 on success, 0 if there is no tree to play.
+ */
+int game_start(GameSession *g) {
+    memset(g, 0, sizeof(*g));
+    g->parentAnswer = -1;
+    g->epoch = tree_unlink_epoch();
+    if (g_root == NULL) {
+        g->state = GAME_OVER;
+        return 0;
+    }
+    g->current = g_root;
+    g->state = g_root->isQuestion ? GAME_QUESTION : GAME_GUESS;
+    return 1;
+}
+
+/* The text the player should be shown now: the question in
+ * GAME_QUESTION, the guessed animal in GAME_GUESS / GAME_WON / GAME_LOST,
+ * NULL once the game is over.
+ */
+const char *game_text(const GameSession *g) {
+    if (g->state == GAME_OVER || g->current == NULL) {
+        return NULL;
+    }
+    return g->current->text;
+}
+
+/* Answer the current question or guess (nonzero = yes).
+ * A question moves to the chosen child; a guess ends in GAME_WON, or
+ * GAME_LOST waiting for game_learn. Returns 0 if nothing is being asked.
+ */
+int game_answer(GameSession *g, int yes) {
+    if (g->state == GAME_QUESTION) {
+        Node *next = yes ? g->current->yes : g->current->no;
+        if (next == NULL) {
+            g->state = GAME_OVER;  // Malformed question; nowhere to go
+            return 1;
+        }
+        g->parent = g->current;
+        g->parentAnswer = yes ? 1 : 0;
+        g->depth++;
+        g->current = next;
+        g->state = next->isQuestion ? GAME_QUESTION : GAME_GUESS;
+        return 1;
+    }
+    if (g->state == GAME_GUESS) {
+        g->state = yes ? GAME_WON : GAME_LOST;
+        return 1;
+    }
+    return 0;
+}
+
+/* Find where g's guessed leaf hangs now. Sessions share the tree, so
+ * since g reached the leaf other learns may have split it (and split
+ * the leaves they added) - it is then somewhere below the node that
+ * replaced it. Updates g's parent, parentAnswer and depth.
+ * Returns 1 if found, 0 if the leaf is no longer under g's parent, or
+ * if g's path may have left the tree: after an undo the detached
+ * question still points at the leaf, so the check below can't tell.
+ */
+static int game_locate(GameSession *g) {
+    if (g->epoch != tree_unlink_epoch()) {
+        return 0;  // Something was undone or reloaded since game_start
+    }
+    Node *leaf = g->current;
+    Node *at = g->parent == NULL ? g_root
+             : g->parentAnswer == 1 ? g->parent->yes : g->parent->no;
+    if (at == leaf) {
+        return 1;  // Nothing changed: the usual case
+    }
+    if (at == NULL || !at->isQuestion) {
+        return 0;
+    }
+
+    // Everything below at was learned since, so this is a small search.
+    // Queue ids carry each question's depth.
+    Queue q;
+    q_init(&q);
+    q_enqueue(&q, at, g->depth);
+    int found = 0;
+    Node *node;
+    int depth;
+    while (!found && q_dequeue(&q, &node, &depth)) {
+        if (node->yes == leaf || node->no == leaf) {
+            g->parent = node;
+            g->parentAnswer = node->yes == leaf;
+            g->depth = depth + 1;
+            found = 1;
+        } else {
+            if (node->yes != NULL && node->yes->isQuestion) q_enqueue(&q, node->yes, depth + 1);
+            if (node->no != NULL && node->no->isQuestion) q_enqueue(&q, node->no, depth + 1);
+        }
+    }
+    q_free(&q);
+    return found;
+}
+
+/* After a wrong guess, teach the tree the player's animal: the guessed
+ * leaf is replaced by question, with animal on the answerForAnimal side
+ * and the old leaf on the other, wherever the leaf hangs by now. The
+ * split is recorded on g_undo (g_redo is cleared) and g_index / g_stats
+ * are updated.
+ * Returns 1 on success, 0 if the game isn't waiting to learn, the
+ * strings are empty, or an undo (or reload) since game_start may have
+ * taken the guessed leaf's path out of the tree.
+ */
+int game_learn(GameSession *g, const char *animal, const char *question,
+               int answerForAnimal) {
+    if (g->state != GAME_LOST || animal == NULL || question == NULL ||
+        animal[0] == '\0' || question[0] == '\0') {
+        return 0;
+    }
+    if (!game_locate(g)) {
+        return 0;
+    }
+    Node *oldLeaf = g->current;
+
+    // Allocated from the tree's pool so they share its lifetime. Fresh IDs
+    // are never reused, so an undo followed by a new learn can't collide.
+    Node *newQuestion = pool_node(&g_pool, question, 1);
+    Node *newAnimal = pool_node(&g_pool, animal, 0);
+    if (newQuestion == NULL || newAnimal == NULL) {
+        return 0;
+    }
+    newQuestion->id = g_nextId++;
+    newAnimal->id = g_nextId++;
+
+    if (answerForAnimal) {
+        newQuestion->yes = newAnimal;
+        newQuestion->no = oldLeaf;
+    } else {
+        newQuestion->no = newAnimal;
+        newQuestion->yes = oldLeaf;
+    }
+
+    if (g->parent == NULL) {
+        g_root = newQuestion;
+    } else if (g->parentAnswer == 1) {
+        g->parent->yes = newQuestion;
+    } else {
+        g->parent->no = newQuestion;
+    }
+
+    Edit edit;
+    edit.type = EDIT_INSERT_SPLIT;
+    edit.parent = g->parent;
+    edit.wasYesChild = g->parentAnswer;
+    edit.oldLeaf = oldLeaf;
+    edit.newQuestion = newQuestion;
+    edit.newLeaf = newAnimal;
+    edit.depth = g->depth;
+    es_push(&g_undo, edit);
+    es_clear(&g_redo);
+    journal_record(JOURNAL_SPLIT, &edit);
+
+    // The new question now distinguishes both animals, the parent's no
+    // longer does
+    index_apply_split(&edit);
+    stats_apply_split(g->depth);
+
+    g->state = GAME_OVER;
+    return 1;
+}
+
+/* Rebuild, on g_root, a game that was played on a snapshot of the tree
+ * and lost: answers are the player's count answers and leafId is the ID
+ * of the animal guessed. Learns since the snapshot only split leaves, so
+ * the answers still lead to that leaf, or to a question learned in its
+ * place with the leaf somewhere below it.
+ * Returns 1 with g in GAME_LOST, ready for game_learn, or 0 if the leaf
+ * isn't there (or there is no tree).
+ */
+int game_resume(GameSession *g, const unsigned char *answers, int count, int leafId) {
+    if (!game_start(g)) {
+        return 0;
+    }
+    for (int a = 0; a < count; a++) {
+        if (g->state != GAME_QUESTION || !game_answer(g, answers[a])) {
+            g->state = GAME_OVER;
+            return 0;
+        }
+    }
+    if (g->state == GAME_GUESS && g->current->id == leafId) {
+        g->state = GAME_LOST;
+        return 1;
+    }
+    if (g->state != GAME_QUESTION) {
+        g->state = GAME_OVER;
+        return 0;
+    }
+
+    // Everything below current was learned since the snapshot. Queue ids
+    // carry each question's depth.
+    Queue q;
+    q_init(&q);
+    q_enqueue(&q, g->current, g->depth);
+    int found = 0;
+    Node *node;
+    int depth;
+    while (!found && q_dequeue(&q, &node, &depth)) {
+        for (int yes = 1; yes >= 0 && !found; yes--) {
+            Node *child = yes ? node->yes : node->no;
+            if (child == NULL) {
+                continue;
+            }
+            if (!child->isQuestion && child->id == leafId) {
+                g->parent = node;
+                g->parentAnswer = yes;
+                g->depth = depth + 1;
+                g->current = child;
+                found = 1;
+            } else if (child->isQuestion) {
+                q_enqueue(&q, child, depth + 1);
+            }
+        }
+    }
+    q_free(&q);
+    g->state = found ? GAME_LOST : GAME_OVER;
+    return found;
+}
+
+/* ========== Batch Replay ========== */
+
+/* A correction waiting for the end of its batch: where the transcript
+ * left its session, and what it taught
+ */
+typedef struct {
+    GameSession at;
+    char *animal;
+    char *question;
+    int answer;
+} Correction;
+
+typedef struct {
+    Correction *items;
+    int count;
+    int capacity;
+    Hash seen;  /* canonical animal -> ids of the leaves it corrected */
+} CorrectionBatch;
+
+/* Queue a correction unless this batch already holds the same animal for
+ * the same leaf. Returns 1 if queued.
+ */
+static int batch_add(CorrectionBatch *b, const GameSession *at,
+                     const char *animal, const char *question, int answer) {
+    char *key = canonicalize(animal);
+    if (key == NULL) {
+        return 0;
+    }
+    int isNew = h_put(&b->seen, key, at->current->id);
+    free(key);
+    if (!isNew) {
+        return 0;
+    }
+    if (b->count == b->capacity) {
+        int capacity = b->capacity ? b->capacity * 2 : 64;
+        Correction *grown = realloc(b->items, capacity * sizeof(Correction));
+        if (grown == NULL) {
+            return 0;
+        }
+        b->items = grown;
+        b->capacity = capacity;
+    }
+    Correction *c = &b->items[b->count];
+    c->at = *at;
+    c->animal = strdup(animal);
+    c->question = strdup(question);
+    c->answer = answer;
+    if (c->animal == NULL || c->question == NULL) {
+        free(c->animal);
+        free(c->question);
+        return 0;
+    }
+    b->count++;
+    return 1;
+}
+
+/* Apply a batch's corrections in first-seen order. Every transcript in
+ * the batch was resolved against the tree as it was before any of them;
+ * game_learn follows a leaf corrected twice (with different animals)
+ * down under the first split's question. Returns the number of splits
+ * made.
+ */
+static long batch_apply(CorrectionBatch *b) {
+    long learned = 0;
+    for (int i = 0; i < b->count; i++) {
+        Correction *c = &b->items[i];
+        if (game_learn(&c->at, c->animal, c->question, c->answer)) {
+            learned++;
+        }
+        free(c->animal);
+        free(c->question);
+    }
+    b->count = 0;
+    h_free(&b->seen);
+    return learned;
+}
+
+/* Split a transcript line in place at tabs into at most max fields */
+static int split_fields(char *line, char **fields, int max) {
+    line[strcspn(line, "\r\n")] = '\0';
+    int n = 0;
+    fields[n++] = line;
+    for (char *p = line; *p != '\0' && n < max; p++) {
+        if (*p == '\t') {
+            *p = '\0';
+            fields[n++] = p + 1;
+        }
+    }
+    return n;
+}
+
+/* Stream transcripts from in through g_root. Each line is
+ *     answers [TAB animal TAB question TAB y|n]
+ * where answers is one y/n per question asked. A line without a
+ * correction is a session whose guess was right; with one, the guess was
+ * wrong and animal (told apart from the guess by question, answered y/n
+ * for animal) should be learned.
+ *
+ * Corrections are collected and applied every batchSize lines (and at
+ * the end), once per distinct leaf and animal however many transcripts
+ * in the batch carry them. Transcripts whose answers don't end exactly
+ * at a leaf of the tree, or with a partial correction, are counted as
+ * unresolved.
+ * Returns 1 on success, 0 on a bad argument.
+ */
+int replay_transcripts(FILE *in, int batchSize, ReplayStats *stats) {
+    memset(stats, 0, sizeof(*stats));
+    if (in == NULL || batchSize < 1) {
+        return 0;
+    }
+
+    CorrectionBatch batch = {NULL, 0, 0, {NULL, 0, 0, NULL, 0, 0, 0, 0}};
+    char *line = NULL;
+    size_t cap = 0;
+    int inBatch = 0;
+    GameSession g;
+    while (getline(&line, &cap, in) != -1) {
+        char *fields[4];
+        int n = split_fields(line, fields, 4);
+        if (n == 1 && fields[0][0] == '\0') {
+            continue;  // Blank line
+        }
+        stats->sessions++;
+
+        const char *answers = fields[0];
+        int ok = game_start(&g);
+        for (; ok && *answers != '\0' && g.state == GAME_QUESTION; answers++) {
+            char a = *answers | 0x20;  // ASCII lowercase
+            ok = (a == 'y' || a == 'n') && game_answer(&g, a == 'y');
+        }
+        if (!ok || *answers != '\0' || g.state != GAME_GUESS || n == 2 || n == 3) {
+            stats->unresolved++;
+        } else {
+            stats->resolved++;
+            if (n == 4) {
+                stats->corrections++;
+                game_answer(&g, 0);
+                if (batch_add(&batch, &g, fields[1], fields[2],
+                              (fields[3][0] | 0x20) == 'y')) {
+                    stats->distinctCorrections++;
+                }
+            }
+        }
+
+        if (++inBatch == batchSize) {
+            stats->learned += batch_apply(&batch);
+            inBatch = 0;
+        }
+    }
+    stats->learned += batch_apply(&batch);
+
+    free(line);
+    free(batch.items);
+    return 1;
+}
+
+/* TODO 32: Implement undo_last_edit
+ * Undo the most recent tree modification
+ *
+ * Steps:
+ * 1. Check if g_undo stack is empty, return 0 if so
+ * 2. Pop edit from g_undo
+ * 3. Restore the tree structure:
+ *    - If edit.parent is NULL:
+ *      - Set g_root = edit.oldLeaf
+ *    - Else if edit.wasYesChild:
+ *      - Set edit.parent->yes = edit.oldLeaf
+ *    - Else:
+ *      - Set edit.parent->no = edit.oldLeaf
+ * 4. Revert the edit's g_index and g_stats changes
+ * 5. Push edit to g_redo stack
+ * 6. Return 1
+ *
+ * Note: We don't free newQuestion/newLeaf because they might be redone
+ */
+int undo_last_edit()
+{
+    // Check if there are any edits to undo
+    if(g_undo.size==0)
+    {
+        return 0;  // Nothing to undo
+    }
+
+    // Get pointers to both stacks for clarity
+    EditStack* undoPtr = &g_undo;
+    EditStack* redoPtr = &g_redo;
+
+    // Pop the most recent edit from undo stack
+    Edit edit = es_pop(undoPtr);
+
+    // Restore the tree to its state before this edit
+    if(edit.parent==NULL)
+    {
+        // The edit was at the root level
+        g_root = edit.oldLeaf;
+    }
+    else if(edit.wasYesChild)
+    {
+        // The edit replaced parent's yes child
+        edit.parent->yes = edit.oldLeaf;
+    }
+    else
+    {
+        // The edit replaced parent's no child
+        edit.parent->no = edit.oldLeaf;
+    }
+
+    // Keep g_index and g_stats in step with the tree
+    index_revert_split(&edit);
+    stats_revert_split(edit.depth);
+
+    // Push edit to redo stack so it can be reapplied later
+    es_push(redoPtr, edit);
+    journal_record(JOURNAL_UNDO, &edit);
+
+    return 1;  // Successfully undid the edit
+}
+
+/* TODO 33: Implement redo_last_edit
+ * Redo a previously undone edit
+ *
+ * Steps:
+ * 1. Check if g_redo stack is empty, return 0 if so
+ * 2. Pop edit from g_redo
+ * 3. Reapply the tree modification:
+ *    - If edit.parent is NULL:
+ *      - Set g_root = edit.newQuestion
+ *    - Else if edit.wasYesChild:
+ *      - Set edit.parent->yes = edit.newQuestion
+ *    - Else:
+ *      - Set edit.parent->no = edit.newQuestion
+ * 4. Re-apply the edit's g_index and g_stats changes
+ * 5. Push edit back to g_undo stack
+ * 6. Return 1
+ */
+int redo_last_edit()
+{
+    // Check if there are any edits to redo
+    if(g_redo.size==0)
+    {
+        return 0;  // Nothing to redo
+    }
+
+    // Get pointers to both stacks for clarity
+    EditStack* redoPtr = &g_redo;
+    EditStack* undoPtr = &g_undo;
+
+    // Pop the most recent edit from redo stack
+    Edit edit = es_pop(redoPtr);
+
+    // Reapply the edit to the tree
+    if(edit.parent==NULL)
+    {
+        // The edit was at the root level
+        g_root = edit.newQuestion;
+    }
+    else if(edit.wasYesChild)
+    {
+        // The edit replaced parent's yes child
+        edit.parent->yes = edit.newQuestion;
+    }
+    else
+    {
+        // The edit replaced parent's no child
+        edit.parent->no = edit.newQuestion;
+    }
+
+    // Keep g_index and g_stats in step with the tree
+    index_apply_split(&edit);
+    stats_apply_split(edit.depth);
+
+    // Push edit back to undo stack so it can be undone again
+    es_push(undoPtr, edit);
+    journal_record(JOURNAL_REDO, &edit);
+
+    return 1;  // Successfully redid the edit
+}
@@ -0,0 +1,165 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "lab5.h"
+
+/* ========== Flat Tree ========== */
+
+/* Flatten the tree under root into ft, in BFS order.
+ * Nodes without an ID get a fresh one from g_nextId (and g_nextId is
+ * moved past every existing ID), so the flat copy and the tree agree on
+ * IDs. Returns 1 on success, 0 on allocation failure (ft is left empty).
+ */
+int flat_from_tree(FlatTree *ft, Node *root) {
+    memset(ft, 0, sizeof(*ft));
+    if (root == NULL) {
+        return 1;  // Empty tree flattens to nothing
+    }
+
+    // First pass: BFS order. The order array is its own queue: node i's
+    // children are appended as i is visited.
+    int capacity = 1024;
+    Node **order = malloc(capacity * sizeof(Node*));
+    if (order == NULL) {
+        return 0;
+    }
+    order[0] = root;
+    int count = 1;
+    uint64_t stringBytes = 0;
+    for (int i = 0; i < count; i++) {
+        Node *node = order[i];
+        if (count + 2 > capacity) {
+            Node **grown = capacity <= INT32_MAX / 2
+                ? realloc(order, (size_t)capacity * 2 * sizeof(Node*)) : NULL;
+            if (grown == NULL) {
+                free(order);
+                return 0;
+            }
+            order = grown;
+            capacity *= 2;
+        }
+        if (node->yes != NULL) order[count++] = node->yes;
+        if (node->no != NULL) order[count++] = node->no;
+        stringBytes += strlen(node->text) + 1;
+    }
+
+    ft->children = malloc((size_t)count * 2 * sizeof(int32_t));
+    ft->ids = malloc(count * sizeof(int32_t));
+    ft->textOffset = malloc(count * sizeof(uint64_t));
+    ft->questionBits = calloc((count + 63) / 64, sizeof(uint64_t));
+    ft->strings = malloc(stringBytes);
+    if (ft->children == NULL || ft->ids == NULL ||
+        ft->textOffset == NULL || ft->questionBits == NULL || ft->strings == NULL) {
+        free(order);
+        flat_free(ft);
+        return 0;
+    }
+
+    // Second pass: fill the arrays. Children were appended in visiting
+    // order, so handing out indices in the same order reproduces them.
+    int nextIndex = 1;
+    uint64_t offset = 0;
+    for (int i = 0; i < count; i++) {
+        Node *node = order[i];
+        FLAT_YES(ft, i) = node->yes != NULL ? nextIndex++ : -1;
+        FLAT_NO(ft, i) = node->no != NULL ? nextIndex++ : -1;
+        if (node->isQuestion) {
+            ft->questionBits[i >> 6] |= (uint64_t)1 << (i & 63);
+        }
+
+        if (node->id < 0) {
+            node->id = g_nextId++;
+        } else if (node->id >= g_nextId) {
+            g_nextId = node->id + 1;
+        }
+        ft->ids[i] = node->id;
+
+        size_t len = strlen(node->text) + 1;
+        memcpy(ft->strings + offset, node->text, len);
+        ft->textOffset[i] = offset;
+        offset += len;
+    }
+
+    free(order);
+    ft->count = count;
+    ft->stringBytes = stringBytes;
+    return 1;
+}
+
+/* Build a pointer tree from ft with all nodes and text allocated from
+ * pool (one block each). Returns the root, or NULL if ft is empty or
+ * allocation fails.
+ */
+Node *flat_to_tree(const FlatTree *ft, NodePool *pool) {
+    if (ft->count == 0) {
+        return NULL;
+    }
+    if (!arena_reserve(&pool->nodes, (size_t)ft->count * sizeof(Node)) ||
+        !arena_reserve(&pool->strings, ft->stringBytes)) {
+        return NULL;
+    }
+    Node *nodes = arena_alloc(&pool->nodes, (size_t)ft->count * sizeof(Node));
+    char *strings = arena_alloc(&pool->strings, ft->stringBytes);
+    if (nodes == NULL || strings == NULL) {
+        return NULL;
+    }
+    memcpy(strings, ft->strings, ft->stringBytes);
+
+    for (int i = 0; i < ft->count; i++) {
+        nodes[i].text = strings + ft->textOffset[i];
+        nodes[i].yes = FLAT_YES(ft, i) >= 0 ? &nodes[FLAT_YES(ft, i)] : NULL;
+        nodes[i].no = FLAT_NO(ft, i) >= 0 ? &nodes[FLAT_NO(ft, i)] : NULL;
+        nodes[i].isQuestion = FLAT_IS_QUESTION(ft, i);
+        nodes[i].isPooled = 1;
+        nodes[i].id = ft->ids[i];
+    }
+    return &nodes[0];
+}
+
+/* Same rules as check_integrity: questions have both children, leaves
+ * have none. In BFS order a valid tree hands out child indices 1, 2, 3...
+ * in visiting order, so one linear scan also proves every index is in
+ * range and every node has exactly one parent - no queue needed.
+ */
+int flat_check_integrity(const FlatTree *ft) {
+    int nextIndex = 1;
+    for (int i = 0; i < ft->count; i++) {
+        if (FLAT_IS_QUESTION(ft, i)) {
+            if (FLAT_YES(ft, i) != nextIndex || FLAT_NO(ft, i) != nextIndex + 1) {
+                return 0;  // Missing child, or not a BFS-ordered tree
+            }
+            nextIndex += 2;
+        } else if (FLAT_YES(ft, i) != -1 || FLAT_NO(ft, i) != -1) {
+            return 0;  // Leaf with children
+        }
+    }
+    return ft->count == 0 || nextIndex == ft->count;
+}
+
+/* Replay a game: starting at the root, follow one answer per question
+ * (nonzero = yes) until a leaf is reached or the answers run out.
+ * Returns the index of the node reached, or -1 for an empty tree.
+ */
+int flat_walk(const FlatTree *ft, const unsigned char *answers, int count) {
+    if (ft->count == 0) {
+        return -1;
+    }
+    int i = 0;
+    for (int a = 0; a < count && FLAT_IS_QUESTION(ft, i); a++) {
+        int next = FLAT_CHILD(ft, i, answers[a]);
+        if (next < 0) {
+            break;  // Malformed question; stay put
+        }
+        i = next;
+    }
+    return i;
+}
+
+void flat_free(FlatTree *ft) {
+    free(ft->children);
+    free(ft->ids);
+    free(ft->textOffset);
+    free(ft->questionBits);
+    free(ft->strings);
+    memset(ft, 0, sizeof(*ft));
+}
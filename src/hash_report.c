@@ -0,0 +1,206 @@
+/*
+ * hash_report.c - Bucket distribution report for g_index keys
+ *
+ * Usage: ./hash_report [corpus]
+ *   corpus - a saved tree file (any VERSION), whose questions are used,
+ *            or a text file with one question per line. Without one, a
+ *            synthetic corpus of near-identical questions is generated.
+ *
+ * Keys are canonicalized and deduplicated exactly as g_index would
+ * store them, then inserted in order into a linear-probing table of the
+ * size g_index would have at each point as it grows (power-of-two
+ * slots, 0.7 load factor). For h_hash and, for comparison, the old djb2
+ * hash it reports:
+ *   avg probe  - slots examined per successful lookup
+ *   max probe  - worst successful lookup
+ *   collisions - keys whose home slot was already some other key's
+ *                home slot, relative to what a uniform hash would give
+ *                (1.00 = ideal)
+ * Flat probe lengths as the key count grows mean the hash is doing its
+ * job on this corpus.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include "lab5.h"
+
+#define SYNTHETIC_KEYS 1000000
+
+/* The hash g_index used before h_hash was replaced */
+static unsigned djb2(const char *s) {
+    unsigned hash = 5381;
+    for (int i = 0; s[i] != '\0'; i++) {
+        hash = ((hash << 5) + hash) + s[i];
+    }
+    return hash;
+}
+
+/* Distinct canonical keys in first-seen order (the order g_index
+ * would receive them); unique is only used to drop duplicates
+ */
+typedef struct {
+    Hash unique;
+    char **keys;
+    int count;
+    int capacity;
+} Corpus;
+
+static void add_question(Corpus *c, const char *text) {
+    char *key = canonicalize(text);
+    if (key == NULL || key[0] == '\0' || !h_put(&c->unique, key, 0)) {
+        free(key);
+        return;  // Empty or already seen
+    }
+    if (c->count == c->capacity) {
+        c->capacity = c->capacity ? c->capacity * 2 : 1024;
+        c->keys = realloc(c->keys, c->capacity * sizeof(char*));
+    }
+    c->keys[c->count++] = key;
+}
+
+/* Questions from a saved tree, or lines of a text file */
+static int read_corpus(const char *path, Corpus *corpus) {
+    if (load_tree(path)) {
+        FlatTree ft;
+        if (!flat_from_tree(&ft, g_root)) {
+            return 0;
+        }
+        for (int i = 0; i < ft.count; i++) {
+            if (FLAT_IS_QUESTION(&ft, i)) {
+                add_question(corpus, ft.strings + ft.textOffset[i]);
+            }
+        }
+        flat_free(&ft);
+        tree_release();
+        return 1;
+    }
+
+    FILE *fp = fopen(path, "r");
+    if (fp == NULL) {
+        return 0;
+    }
+    char *line = NULL;
+    size_t cap = 0;
+    while (getline(&line, &cap, fp) != -1) {
+        add_question(corpus, line);
+    }
+    free(line);
+    fclose(fp);
+    return 1;
+}
+
+/* The kind of near-duplicates users type */
+static void synthetic_corpus(Corpus *corpus) {
+    const char *stems[] = {"Does it have %d legs?", "Does it have feature %d?",
+                           "Is it bigger than %d cm?", "Does it live in zone %d?"};
+    char text[64];
+    for (int i = 0; corpus->count < SYNTHETIC_KEYS; i++) {
+        snprintf(text, sizeof(text), stems[i % 4], i / 4);
+        add_question(corpus, text);
+    }
+}
+
+typedef struct {
+    double avgProbe;
+    int maxProbe;
+    double collisionRatio;
+} Distribution;
+
+/* Insert hashes[0..n) into a linear-probing table of nslots slots */
+static Distribution measure(const unsigned *hashes, int n, int nslots) {
+    Distribution d = {0, 0, 0};
+    unsigned mask = nslots - 1;
+    char *occupied = calloc(nslots, 1);
+    char *home = calloc(nslots, 1);
+    long probes = 0;
+    int homesUsed = 0;
+
+    for (int i = 0; i < n; i++) {
+        unsigned slot = hashes[i] & mask;
+        if (!home[slot]) {
+            home[slot] = 1;
+            homesUsed++;
+        }
+        int probe = 1;
+        while (occupied[slot]) {
+            slot = (slot + 1) & mask;
+            probe++;
+        }
+        occupied[slot] = 1;
+        probes += probe;
+        if (probe > d.maxProbe) d.maxProbe = probe;
+    }
+
+    // Expected distinct home slots for n uniform keys in nslots slots
+    double expectedHomes = nslots * (1.0 - pow(1.0 - 1.0 / nslots, n));
+    double expectedCollisions = n - expectedHomes;
+    d.avgProbe = n ? (double)probes / n : 0;
+    d.collisionRatio = expectedCollisions > 0
+        ? (n - homesUsed) / expectedCollisions : 1.0;
+
+    free(occupied);
+    free(home);
+    return d;
+}
+
+/* Slot count g_index has after inserting n keys from empty */
+static int slots_for(int n) {
+    int nslots = 8;
+    while ((long)n * 10 > (long)nslots * 7) {
+        nslots *= 2;
+    }
+    return nslots;
+}
+
+int main(int argc, char **argv) {
+    Corpus corpus = {{NULL, 0, 0, NULL, 0, 0, 0, 0}, NULL, 0, 0};
+    h_init(&corpus.unique, 1024);
+
+    if (argc > 1) {
+        if (!read_corpus(argv[1], &corpus)) {
+            fprintf(stderr, "hash_report: can't read %s\n", argv[1]);
+            return 1;
+        }
+    } else {
+        synthetic_corpus(&corpus);
+    }
+
+    int n = corpus.count;
+    unsigned *newHashes = malloc((n ? n : 1) * sizeof(unsigned));
+    unsigned *oldHashes = malloc((n ? n : 1) * sizeof(unsigned));
+    for (int i = 0; i < n; i++) {
+        newHashes[i] = h_hash(corpus.keys[i]);
+        oldHashes[i] = djb2(corpus.keys[i]);
+    }
+
+    printf("%s: %d distinct canonical keys\n",
+           argc > 1 ? argv[1] : "synthetic corpus", n);
+    printf("  %9s %9s | %-24s | %-24s\n", "", "", "h_hash", "djb2 (old)");
+    printf("  %9s %9s | %7s %7s %8s | %7s %7s %8s\n", "keys", "slots",
+           "avg", "max", "collide", "avg", "max", "collide");
+
+    // Report at each point the table would double, plus the final size
+    for (int step = 64; ; step *= 2) {
+        int keysNow = (int)((long)step * 7 / 10);
+        int last = keysNow >= n;
+        if (last) keysNow = n;
+        if (keysNow > 0) {
+            int nslots = slots_for(keysNow);
+            Distribution a = measure(newHashes, keysNow, nslots);
+            Distribution b = measure(oldHashes, keysNow, nslots);
+            printf("  %9d %9d | %7.2f %7d %8.2f | %7.2f %7d %8.2f\n",
+                   keysNow, nslots, a.avgProbe, a.maxProbe, a.collisionRatio,
+                   b.avgProbe, b.maxProbe, b.collisionRatio);
+        }
+        if (last) break;
+    }
+
+    free(newHashes);
+    free(oldHashes);
+    for (int i = 0; i < n; i++) free(corpus.keys[i]);
+    free(corpus.keys);
+    h_free(&corpus.unique);
+    return 0;
+}
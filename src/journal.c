@@ -0,0 +1,653 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include "lab5.h"
+
+/* ========== Learning Journal ========== */
+
+/* "<tree file>.journal" is an append-only log of the edits made since
+ * the tree file was written:
+ *   JournalHeader | JournalRecord + question + animal | ...
+ * A record carries everything needed to redo its split from scratch
+ * (IDs, branch, depth and both texts), so undo and redo records replay
+ * even when the edit they refer to predates the journal.
+ *
+ * The header names the tree file the journal extends by its size,
+ * trailing CRC32C and next ID (TreeFileId), which load_tree has at hand
+ * without touching the tree; a journal only replays onto that exact
+ * file, so one left over from before a newer save is ignored. Each
+ * record is also checked against the tree before it is applied (the
+ * split's old leaf, or new question, must hang where the record says)
+ * and skipped if not.
+ *
+ * Compaction: a background thread writes the current tree (flattened
+ * up front) to "<tree file>.compact" while records keep going to the
+ * journal. Once it is done, the records appended meanwhile are copied
+ * into "<tree file>.journal.new", which extends the new file, and the
+ * tree file and then the journal are renamed into place. After a crash
+ * at any point exactly one of ".journal.new" and ".journal" extends the
+ * tree file on disk, and load_tree replays that one.
+ */
+
+#define JOURNAL_MAGIC 0x4A544C35  /* "5LTJ" */
+#define JOURNAL_VERSION 2
+#define JOURNAL_BUFFER 65536
+
+typedef struct {
+    uint32_t magic;
+    uint32_t version;
+    uint32_t baseNextId;  /* the tree file this journal extends: next ID, */
+    uint32_t baseCrc;     /* trailing CRC32C */
+    uint64_t baseBytes;   /* and size */
+} JournalHeader;
+
+typedef struct {
+    uint32_t length;        /* bytes after this field, texts included */
+    uint8_t type;           /* JournalOp */
+    int8_t wasYesChild;     /* 1 yes, 0 no, -1 root */
+    uint8_t animalOnYes;    /* new leaf is the new question's yes child */
+    uint8_t pad;
+    int32_t parentId;       /* -1 at the root */
+    int32_t oldLeafId;
+    int32_t newQuestionId;
+    int32_t newLeafId;
+    int32_t depth;
+    uint32_t questionLen;   /* texts follow, no terminators */
+    uint32_t animalLen;
+} JournalRecord;
+
+typedef struct {
+    int fd;                /* -1 when no journal is open */
+    char *path;            /* "<tree file>.journal" */
+    char *newPath;         /* "<tree file>.journal.new" */
+    char *treeFile;
+    char *compactPath;     /* "<tree file>.compact" */
+    char *buffer;          /* records not yet written */
+    size_t buffered;
+    int pending;           /* records in buffer */
+    int syncEvery;
+    long compactBytes;
+    long fileBytes;
+    int failed;            /* a write or sync failed; stop journaling */
+
+    /* Background compaction */
+    int compacting;
+    int compactDone;       /* set by the thread when it finishes */
+    int compactOk;
+    pthread_t thread;
+    FlatTree snapshot;
+    int snapshotNextId;
+    TreeFileId snapshotId; /* of the file written from snapshot */
+    long compactFrom;      /* journal bytes the snapshot includes */
+    long compactions;
+} Journal;
+
+/* What the last load_tree found: the tree file, and the journal it
+ * replayed cleanly (NULL if there was none to replay, when the tree
+ * still matches the file until it is edited)
+ */
+static char *g_loadedFile = NULL;
+static TreeFileId g_loadedId;
+static unsigned long g_loadedEpoch;
+static char *g_replayed = NULL;
+
+static Journal g_journal = {-1, NULL, NULL, NULL, NULL, NULL, 0, 0, 0, 0, 0, 0,
+                            0, 0, 0, 0, {0, NULL, NULL, NULL, NULL, NULL, 0}, 0,
+                            {0, 0, 0}, 0, 0};
+
+static char *path_with(const char *base, const char *suffix) {
+    size_t len = strlen(base);
+    size_t suffixLen = strlen(suffix);
+    char *path = malloc(len + suffixLen + 1);
+    if (path != NULL) {
+        memcpy(path, base, len);
+        memcpy(path + len, suffix, suffixLen + 1);
+    }
+    return path;
+}
+
+static int write_all(int fd, const char *data, size_t len) {
+    while (len > 0) {
+        ssize_t n = write(fd, data, len);
+        if (n < 0) {
+            if (errno == EINTR) continue;
+            return 0;
+        }
+        data += n;
+        len -= n;
+    }
+    return 1;
+}
+
+/* Create (or truncate) a journal at path extending the tree file base */
+static int journal_create(const char *path, const TreeFileId *base) {
+    int fd = open(path, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if (fd < 0) {
+        return -1;
+    }
+    JournalHeader header;
+    memset(&header, 0, sizeof(header));
+    header.magic = JOURNAL_MAGIC;
+    header.version = JOURNAL_VERSION;
+    header.baseNextId = (uint32_t)base->nextId;
+    header.baseCrc = base->crc;
+    header.baseBytes = base->bytes;
+    if (!write_all(fd, (const char*)&header, sizeof(header)) || fdatasync(fd) != 0) {
+        close(fd);
+        return -1;
+    }
+    return fd;
+}
+
+/* ---------- Replay ---------- */
+
+/* Node lookup by ID for the tree being replayed onto */
+typedef struct {
+    Node **nodes;
+    int capacity;
+} NodeById;
+
+static int byid_put(NodeById *m, Node *node) {
+    if (node->id < 0) {
+        return 1;
+    }
+    if (node->id >= m->capacity) {
+        int capacity = m->capacity ? m->capacity : 64;
+        while (capacity <= node->id) capacity *= 2;
+        Node **grown = realloc(m->nodes, capacity * sizeof(Node*));
+        if (grown == NULL) {
+            return 0;
+        }
+        memset(grown + m->capacity, 0, (capacity - m->capacity) * sizeof(Node*));
+        m->nodes = grown;
+        m->capacity = capacity;
+    }
+    m->nodes[node->id] = node;
+    return 1;
+}
+
+static Node *byid_get(const NodeById *m, int32_t id) {
+    return id >= 0 && id < m->capacity ? m->nodes[id] : NULL;
+}
+
+static int byid_build(NodeById *m) {
+    memset(m, 0, sizeof(*m));
+    if (g_root == NULL) {
+        return 1;
+    }
+    Queue q;
+    q_init(&q);
+    q_enqueue(&q, g_root, 0);
+    Node *node;
+    int unused;
+    int ok = 1;
+    while (ok && q_dequeue(&q, &node, &unused)) {
+        ok = byid_put(m, node);
+        if (node->yes != NULL) q_enqueue(&q, node->yes, 0);
+        if (node->no != NULL) q_enqueue(&q, node->no, 0);
+    }
+    q_free(&q);
+    return ok;
+}
+
+/* Where the record's split hangs: the root pointer or a child pointer */
+static Node **record_slot(const JournalRecord *r, const NodeById *m) {
+    if (r->parentId < 0) {
+        return &g_root;
+    }
+    Node *parent = byid_get(m, r->parentId);
+    if (parent == NULL || !parent->isQuestion) {
+        return NULL;
+    }
+    return r->wasYesChild ? &parent->yes : &parent->no;
+}
+
+/* The edit a record describes, creating its two nodes (with the
+ * recorded IDs and text) if they aren't known yet
+ */
+static int record_edit(const JournalRecord *r, const char *question, const char *animal,
+                       NodeById *m, Edit *e) {
+    e->type = EDIT_INSERT_SPLIT;
+    e->parent = byid_get(m, r->parentId);
+    e->wasYesChild = r->parentId < 0 ? -1 : r->wasYesChild;
+    e->oldLeaf = byid_get(m, r->oldLeafId);
+    e->newQuestion = byid_get(m, r->newQuestionId);
+    e->newLeaf = byid_get(m, r->newLeafId);
+    e->depth = r->depth;
+    if (e->oldLeaf == NULL || (r->parentId >= 0 && e->parent == NULL)) {
+        return 0;
+    }
+    if (e->newQuestion == NULL || e->newLeaf == NULL) {
+        e->newQuestion = pool_node(&g_pool, question, 1);
+        e->newLeaf = pool_node(&g_pool, animal, 0);
+        if (e->newQuestion == NULL || e->newLeaf == NULL) {
+            return 0;
+        }
+        e->newQuestion->id = r->newQuestionId;
+        e->newLeaf->id = r->newLeafId;
+        e->newQuestion->yes = r->animalOnYes ? e->newLeaf : e->oldLeaf;
+        e->newQuestion->no = r->animalOnYes ? e->oldLeaf : e->newLeaf;
+        if (!byid_put(m, e->newQuestion) || !byid_put(m, e->newLeaf)) {
+            return 0;
+        }
+    }
+    if (r->newLeafId >= g_nextId) {
+        g_nextId = r->newLeafId + 1;
+    }
+    return 1;
+}
+
+/* Apply one record if the tree is in the state it expects.
+ * Returns 1 if applied, 0 if skipped.
+ */
+static int replay_record(const JournalRecord *r, const char *question, const char *animal,
+                         NodeById *m) {
+    Node **slot = record_slot(r, m);
+    if (slot == NULL) {
+        return 0;
+    }
+    Edit e;
+    switch (r->type) {
+        case JOURNAL_SPLIT:
+        case JOURNAL_REDO:
+            if (*slot == NULL || *slot != byid_get(m, r->oldLeafId)) {
+                return 0;  // Not where the split happened (or already split)
+            }
+            if (r->type == JOURNAL_REDO && g_redo.size > 0 &&
+                g_redo.edits[g_redo.size - 1].newQuestion->id == r->newQuestionId) {
+                return redo_last_edit();
+            }
+            if (!record_edit(r, question, animal, m, &e)) {
+                return 0;
+            }
+            *slot = e.newQuestion;
+            es_push(&g_undo, e);
+            if (r->type == JOURNAL_SPLIT) {
+                es_clear(&g_redo);
+            }
+            index_apply_split(&e);
+            stats_apply_split(e.depth);
+            return 1;
+        case JOURNAL_UNDO:
+            if (*slot == NULL || *slot != byid_get(m, r->newQuestionId)) {
+                return 0;
+            }
+            if (g_undo.size > 0 &&
+                g_undo.edits[g_undo.size - 1].newQuestion->id == r->newQuestionId) {
+                return undo_last_edit();
+            }
+            if (!record_edit(r, question, animal, m, &e)) {
+                return 0;
+            }
+            *slot = e.oldLeaf;
+            es_push(&g_redo, e);
+            index_revert_split(&e);
+            stats_revert_split(e.depth);
+            return 1;
+    }
+    return 0;
+}
+
+/* Replay one journal file onto g_root. Stops at the first torn or
+ * malformed record (a crash mid-append) and, if truncateTail, cuts the
+ * file back to the last whole record so appends continue cleanly.
+ * Returns the number of records applied, or -1 if the file doesn't
+ * exist or doesn't extend the tree file base.
+ */
+static long replay_file(const char *path, const TreeFileId *base, int truncateTail) {
+    FILE *fp = fopen(path, "rb");
+    if (fp == NULL) {
+        return -1;
+    }
+    JournalHeader header;
+    if (fread(&header, sizeof(header), 1, fp) != 1 || header.magic != JOURNAL_MAGIC ||
+        header.version != JOURNAL_VERSION || header.baseNextId != (uint32_t)base->nextId ||
+        header.baseCrc != base->crc || header.baseBytes != base->bytes) {
+        fclose(fp);
+        return -1;
+    }
+
+    NodeById m;
+    if (!byid_build(&m)) {
+        fclose(fp);
+        return -1;
+    }
+    long applied = 0;
+    long good = sizeof(header);
+    char *text = NULL;
+    size_t textCapacity = 0;
+    JournalRecord r;
+    while (fread(&r, sizeof(r), 1, fp) == 1) {
+        uint64_t textLen = (uint64_t)r.questionLen + r.animalLen;
+        if (r.length != sizeof(r) - sizeof(r.length) + textLen ||
+            r.questionLen == 0 || r.animalLen == 0) {
+            break;  // Garbage: treat like a torn tail
+        }
+        if (textLen + 2 > textCapacity) {
+            char *grown = realloc(text, textLen + 2);
+            if (grown == NULL) break;
+            text = grown;
+            textCapacity = textLen + 2;
+        }
+        if (fread(text, 1, textLen, fp) != textLen) {
+            break;  // Torn tail
+        }
+        // question\0animal\0
+        memmove(text + r.questionLen + 1, text + r.questionLen, r.animalLen);
+        text[r.questionLen] = '\0';
+        text[textLen + 1] = '\0';
+        applied += replay_record(&r, text, text + r.questionLen + 1, &m);
+        good += sizeof(r) + textLen;
+    }
+    free(text);
+    free(m.nodes);
+    fclose(fp);
+    if (truncateTail) {
+        truncate(path, good);
+    }
+    return applied;
+}
+
+/* Called by load_tree once treeFile (identified by id) is loaded:
+ * replay the journal extending it, if any. Returns the number of
+ * records applied.
+ */
+long journal_replay(const char *treeFile, const TreeFileId *id) {
+    char *newPath = path_with(treeFile, ".journal.new");
+    char *path = path_with(treeFile, ".journal");
+    free(g_loadedFile);
+    free(g_replayed);
+    g_loadedFile = path_with(treeFile, "");
+    g_loadedId = *id;
+    g_replayed = NULL;
+    long applied = 0;
+    if (newPath != NULL && path != NULL) {
+        // A compaction stopped after moving its tree file into place
+        // leaves the journal extending it as .journal.new: finish it
+        long n = replay_file(newPath, id, 1);
+        if (n >= 0 && !replace_file(newPath, path)) {
+            n = -1;
+        }
+        if (n < 0) {
+            n = replay_file(path, id, 1);
+        }
+        if (n >= 0) {
+            applied = n;
+            g_replayed = path;  // journal_open can keep appending to it
+            path = NULL;
+        }
+    }
+    g_loadedEpoch = tree_unlink_epoch();
+    free(newPath);
+    free(path);
+    return applied;
+}
+
+/* ---------- Appending ---------- */
+
+static void *compact_thread(void *arg) {
+    Journal *j = arg;
+    int ok = write_flat_tree(j->compactPath, &j->snapshot, j->snapshotNextId, &j->snapshotId);
+    flat_free(&j->snapshot);
+    j->compactOk = ok;
+    __atomic_store_n(&j->compactDone, 1, __ATOMIC_RELEASE);
+    return NULL;
+}
+
+/* Copy the journal's records past the snapshot to fd */
+static int copy_tail(Journal *j, int fd) {
+    int in = open(j->path, O_RDONLY);
+    if (in < 0) {
+        return 0;
+    }
+    char chunk[8192];
+    long at = j->compactFrom;
+    int ok = 1;
+    while (ok && at < j->fileBytes) {
+        size_t want = j->fileBytes - at < (long)sizeof(chunk) ? (size_t)(j->fileBytes - at)
+                                                              : sizeof(chunk);
+        ssize_t n = pread(in, chunk, want, at);
+        ok = n > 0 && write_all(fd, chunk, (size_t)n);
+        at += n;
+    }
+    close(in);
+    return ok;
+}
+
+/* Hand over to the tree file a compaction wrote: .journal.new extends
+ * it with the records appended since the snapshot, then the tree file
+ * and the new journal are moved into place, in that order.
+ */
+static int compact_finish(Journal *j) {
+    int fd = journal_create(j->newPath, &j->snapshotId);
+    if (fd < 0 || !copy_tail(j, fd) || fdatasync(fd) != 0 ||
+        !replace_file(j->compactPath, j->treeFile)) {
+        if (fd >= 0) {
+            close(fd);
+        }
+        unlink(j->newPath);
+        unlink(j->compactPath);
+        return 0;  // The old tree file and journal still stand
+    }
+    close(j->fd);
+    j->fd = fd;
+    j->fileBytes = sizeof(JournalHeader) + (j->fileBytes - j->compactFrom);
+    if (!replace_file(j->newPath, j->path)) {
+        j->failed = 1;  // load_tree still finds .journal.new
+    }
+    return 1;
+}
+
+/* Finish a compaction whose thread is done */
+static void compact_done(Journal *j) {
+    j->compacting = 0;
+    j->compactDone = 0;
+    if (j->compactOk && !compact_finish(j)) {
+        j->compactOk = 0;
+    }
+    if (j->compactOk) {
+        j->compactions++;
+    }
+}
+
+/* Reap a finished compaction; with wait, block until it finishes */
+static void compact_reap(Journal *j, int wait) {
+    if (!j->compacting ||
+        (!wait && !__atomic_load_n(&j->compactDone, __ATOMIC_ACQUIRE))) {
+        return;
+    }
+    pthread_join(j->thread, NULL);
+    compact_done(j);
+}
+
+/* Start writing the current tree to the compaction file in the
+ * background. Every record so far must be written. Returns 1 if started.
+ */
+static int compact_start(Journal *j) {
+    if (j->compacting || g_root == NULL) {
+        return 0;
+    }
+    if (!flat_from_tree(&j->snapshot, g_root)) {
+        return 0;
+    }
+    j->snapshotNextId = g_nextId;
+    j->compactFrom = j->fileBytes;
+    j->compactDone = 0;
+    if (pthread_create(&j->thread, NULL, compact_thread, j) != 0) {
+        compact_thread(j);  // No thread: do it now
+        compact_done(j);
+        return 1;
+    }
+    j->compacting = 1;
+    return 1;
+}
+
+/* Journal edits of the tree loaded from treeFile; call it right after
+ * load_tree (which replays any journal it finds), or on a new tree.
+ * Records are written and fsync'd every syncEvery records or on
+ * journal_sync; once the journal passes
+ * compactBytes the tree file is rewritten in the background and the
+ * journal starts over. Returns 1 on success.
+ */
+int journal_open(const char *treeFile, int syncEvery, long compactBytes) {
+    Journal *j = &g_journal;
+    if (j->fd >= 0 || syncEvery < 1) {
+        return 0;
+    }
+    memset(j, 0, sizeof(*j));
+    j->fd = -1;
+    j->treeFile = path_with(treeFile, "");
+    j->path = path_with(treeFile, ".journal");
+    j->newPath = path_with(treeFile, ".journal.new");
+    j->compactPath = path_with(treeFile, ".compact");
+    j->buffer = malloc(JOURNAL_BUFFER);
+    j->syncEvery = syncEvery;
+    j->compactBytes = compactBytes;
+    if (j->treeFile == NULL || j->path == NULL || j->newPath == NULL ||
+        j->compactPath == NULL || j->buffer == NULL) {
+        journal_close();
+        return 0;
+    }
+
+    // Keep appending to the journal load_tree just replayed. If it
+    // found none and the tree is still as loaded, start one on the file;
+    // anything else (a new or edited tree, a stale journal) means saving
+    // the tree first so the journal can start clean from it
+    unlink(j->newPath);  // Stale: it extends a tree file never moved in
+    int fd = -1;
+    if (g_replayed != NULL && strcmp(g_replayed, j->path) == 0) {
+        fd = open(j->path, O_WRONLY | O_APPEND);
+    }
+    if (fd >= 0) {
+        j->fileBytes = lseek(fd, 0, SEEK_END);
+    } else {
+        TreeFileId base = g_loadedId;
+        int asLoaded = g_replayed == NULL && g_loadedFile != NULL &&
+                       strcmp(g_loadedFile, treeFile) == 0 &&
+                       g_loadedEpoch == tree_unlink_epoch() && g_nextId == base.nextId &&
+                       g_undo.size == 0 && g_redo.size == 0;
+        if (g_root == NULL || (!asLoaded && !save_tree_id(treeFile, &base))) {
+            journal_close();
+            return 0;
+        }
+        fd = journal_create(j->path, &base);
+        j->fileBytes = sizeof(JournalHeader);
+    }
+    j->fd = fd;
+    if (fd < 0) {
+        journal_close();
+        return 0;
+    }
+    return 1;
+}
+
+/* Write and fsync buffered records, then start a compaction if the
+ * journal has grown past its threshold. Returns 0 if the journal has
+ * failed (edits are no longer being recorded).
+ */
+int journal_sync() {
+    Journal *j = &g_journal;
+    if (j->fd < 0) {
+        return 0;
+    }
+    compact_reap(j, 0);
+    if (j->failed) {
+        return 0;
+    }
+    if (j->buffered > 0) {
+        if (!write_all(j->fd, j->buffer, j->buffered) || fdatasync(j->fd) != 0) {
+            j->failed = 1;
+            return 0;
+        }
+        j->fileBytes += j->buffered;
+        j->buffered = 0;
+        j->pending = 0;
+    }
+    if (j->compactBytes > 0 && j->fileBytes > j->compactBytes) {
+        compact_start(j);
+    }
+    return 1;
+}
+
+/* Record an edit (called by game_learn, undo_last_edit and
+ * redo_last_edit). A no-op unless a journal is open.
+ */
+void journal_record(JournalOp op, const Edit *e) {
+    Journal *j = &g_journal;
+    if (j->fd < 0 || j->failed) {
+        return;
+    }
+    int animalOnYes = e->newQuestion->yes == e->newLeaf;
+    const char *question = e->newQuestion->text;
+    const char *animal = e->newLeaf->text;
+    JournalRecord r;
+    memset(&r, 0, sizeof(r));
+    r.type = (uint8_t)op;
+    r.wasYesChild = (int8_t)e->wasYesChild;
+    r.animalOnYes = (uint8_t)animalOnYes;
+    r.parentId = e->parent != NULL ? e->parent->id : -1;
+    r.oldLeafId = e->oldLeaf->id;
+    r.newQuestionId = e->newQuestion->id;
+    r.newLeafId = e->newLeaf->id;
+    r.depth = e->depth;
+    r.questionLen = strlen(question);
+    r.animalLen = strlen(animal);
+    r.length = sizeof(r) - sizeof(r.length) + r.questionLen + r.animalLen;
+
+    size_t need = sizeof(r) + r.questionLen + r.animalLen;
+    if (j->buffered + need > JOURNAL_BUFFER) {
+        journal_sync();
+        if (need > JOURNAL_BUFFER) {
+            j->failed = 1;  // Texts are capped well below this on input
+            return;
+        }
+    }
+    memcpy(j->buffer + j->buffered, &r, sizeof(r));
+    memcpy(j->buffer + j->buffered + sizeof(r), question, r.questionLen);
+    memcpy(j->buffer + j->buffered + sizeof(r) + r.questionLen, animal, r.animalLen);
+    j->buffered += need;
+    if (++j->pending >= j->syncEvery) {
+        journal_sync();
+    }
+}
+
+/* Rewrite the tree file now and start the journal over (waits) */
+int journal_checkpoint() {
+    Journal *j = &g_journal;
+    if (j->fd < 0 || !journal_sync()) {
+        return 0;
+    }
+    compact_reap(j, 1);
+    if (!compact_start(j)) {
+        return 0;
+    }
+    compact_reap(j, 1);
+    return j->compactOk;
+}
+
+/* Sync, finish any compaction and stop journaling */
+void journal_close() {
+    Journal *j = &g_journal;
+    if (j->fd >= 0) {
+        journal_sync();
+        compact_reap(j, 1);
+        close(j->fd);
+    }
+    free(j->path);
+    free(j->newPath);
+    free(j->compactPath);
+    free(j->treeFile);
+    free(j->buffer);
+    memset(j, 0, sizeof(*j));
+    j->fd = -1;
+}
+
+/* Bytes in the journal file, and compactions finished since open */
+void journal_stats(long *fileBytes, long *compactions) {
+    *fileBytes = g_journal.fileBytes;
+    *compactions = g_journal.compactions;
+}
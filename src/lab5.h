@@ -1,7 +1,10 @@
 #ifndef LAB5_H
 #define LAB5_H
 
+#include <stdio.h>
 #include <stdint.h>
+#include <stddef.h>
+#include <pthread.h>
 
 /* ========== Tree Node ========== */
 typedef struct Node {
@@ -9,6 +12,8 @@ typedef struct Node {
     struct Node *yes;
     struct Node *no;
     int isQuestion;
+    int isPooled;  /* 1 if node and text are owned by a NodePool */
+    int id;        /* node ID used by g_index, -1 if unassigned */
 } Node;
 
 /* Node constructors */
@@ -17,6 +22,70 @@ Node *create_animal_node(const char *animal);
 void free_tree(Node *node);
 int count_nodes(Node *root);
 
+/* ========== Arena / Node Pool ========== */
+typedef struct ArenaBlock {
+    struct ArenaBlock *next;
+    size_t used;
+    size_t capacity;
+} ArenaBlock;  /* payload follows the header */
+
+typedef struct {
+    ArenaBlock *head;      /* current block, older blocks chained via next */
+    size_t nextBlockSize;  /* payload size of the next block to allocate */
+} Arena;
+
+/* Set of strings, each with an int value: open addressing with linear
+ * probing over a power-of-two slot array. Keys aren't copied, so they
+ * must outlive the table.
+ */
+typedef struct {
+    const char **keys;  /* NULL marks an empty slot */
+    unsigned *hashes;
+    int *values;
+    size_t capacity;
+    size_t count;
+} StringTable;
+
+void st_init(StringTable *t);
+long st_find(const StringTable *t, const char *key);
+int st_add(StringTable *t, const char *key, int value);
+void st_free(StringTable *t);
+
+/* A tree's storage: a bump arena of Nodes plus a paired string arena.
+ * Pooled nodes are never freed individually; the whole pool goes at once.
+ * A tree loaded from a VERSION 2 file also owns the file mapping its
+ * node text points into (read-only).
+ *
+ * Pool text is interned: every distinct string is stored once and
+ * shared by all the nodes that use it, so it must never be modified.
+ * A VERSION 5 load hands over the file's own string table as seeds,
+ * added to the intern table the first time a node is created.
+ */
+typedef struct {
+    Arena nodes;
+    Arena strings;
+    void *map;         /* mmap'd tree file, or NULL */
+    size_t mapLength;
+    StringTable interned;        /* text -> its one copy in the pool */
+    const char *seedBlob;        /* strings not yet in interned: */
+    const uint64_t *seedOffsets; /* seedBlob + seedOffsets[i] */
+    uint32_t seedCount;
+} NodePool;
+
+void arena_init(Arena *a);
+void *arena_alloc(Arena *a, size_t size);
+int arena_reserve(Arena *a, size_t size);
+void arena_free(Arena *a);
+
+void pool_init(NodePool *p);
+const char *pool_intern(NodePool *p, const char *text);
+Node *pool_node(NodePool *p, const char *text, int isQuestion);
+void pool_free(NodePool *p);
+
+extern NodePool g_pool;
+
+void tree_release();
+
 /* ========== Stack for Gameplay ========== */
 typedef struct Frame {
     Node *node;
@@ -47,6 +116,7 @@ typedef struct {
     Node *oldLeaf;
     Node *newQuestion;
     Node *newLeaf;
+    int depth;        /* depth of oldLeaf (root = 0), for g_stats */
 } Edit;
 
 typedef struct {
@@ -66,6 +136,7 @@ void free_edit_stack(EditStack *s);
 extern EditStack g_undo;
 extern EditStack g_redo;
 extern Node *g_root;
+extern int g_nextId;  /* next unused node ID; IDs are never reused */
 
 int undo_last_edit();
 int redo_last_edit();
@@ -74,13 +145,16 @@ int redo_last_edit();
 typedef struct QueueNode {
     Node *treeNode;
     int id;
-    struct QueueNode *next;
 } QueueNode;
 
+/* Circular array: items[(front + i) & (capacity - 1)] for i < size.
+ * capacity is a power of two and doubles when full.
+ */
 typedef struct {
-    QueueNode *front;
-    QueueNode *rear;
+    QueueNode *items;
+    int front;
     int size;
+    int capacity;
 } Queue;
 
 void q_init(Queue *q);
@@ -89,32 +163,121 @@ int q_dequeue(Queue *q, Node **node, int *id);
 int q_empty(Queue *q);
 void q_free(Queue *q);
 
+/* ========== Flat Tree ========== */
+/* Structure-of-arrays copy of a tree in BFS order (root at index 0).
+ * Children are 32-bit indices (-1 if none), with node i's yes and no
+ * children side by side so an answer picks one without branching.
+ * Question flags are packed one bit per node, and all text is stored
+ * back to back, in node order, as null-terminated strings. A walk
+ * touches a few dense arrays instead of chasing Node pointers and
+ * separately allocated text.
+ */
+typedef struct {
+    int count;
+    int32_t *children;      /* [2i] = yes child of i, [2i+1] = no child */
+    uint64_t *questionBits; /* bit i set if node i is a question */
+    int32_t *ids;           /* stable node IDs */
+    uint64_t *textOffset;   /* offset of node i's text in strings */
+    char *strings;
+    uint64_t stringBytes;
+} FlatTree;
+
+#define FLAT_IS_QUESTION(ft, i) (((ft)->questionBits[(i) >> 6] >> ((i) & 63)) & 1)
+#define FLAT_YES(ft, i) ((ft)->children[2 * (i)])
+#define FLAT_NO(ft, i) ((ft)->children[2 * (i) + 1])
+/* Child of i for an answer (nonzero = yes) */
+#define FLAT_CHILD(ft, i, answer) ((ft)->children[2 * (i) + !(answer)])
+
+int flat_from_tree(FlatTree *ft, Node *root);
+Node *flat_to_tree(const FlatTree *ft, NodePool *pool);
+int flat_check_integrity(const FlatTree *ft);
+int flat_walk(const FlatTree *ft, const unsigned char *answers, int count);
+void flat_free(FlatTree *ft);
+
+/* ========== Snapshots ========== */
+/* Immutable flat copies of the tree for concurrent readers. A writer
+ * (the thread editing g_root) publishes a new snapshot after each batch
+ * of edits; any number of reader threads walk whichever snapshot was
+ * current when they entered, without locks. Replaced snapshots are
+ * freed by epoch-based reclamation once no reader can still hold them.
+ */
+typedef struct Snapshot {
+    FlatTree tree;
+    uint64_t version;             /* 1 for the first publish */
+    uint64_t retiredAt;           /* store epoch when replaced */
+    struct Snapshot *nextRetired;
+} Snapshot;
+
+typedef struct {
+    uint64_t epoch;  /* epoch entered at, 0 while outside */
+    char pad[56];    /* one cache line per reader */
+} ReaderSlot;
+
+typedef struct {
+    Snapshot *current;
+    uint64_t epoch;
+    uint64_t published;
+    ReaderSlot *readers;
+    int maxReaders;
+    Snapshot *retired;  /* replaced, not yet freed */
+    int retiredCount;
+    pthread_mutex_t writeLock;
+} SnapshotStore;
+
+int snap_init(SnapshotStore *s, int maxReaders);
+int snap_publish(SnapshotStore *s, Node *root);
+const Snapshot *snap_enter(SnapshotStore *s, int reader);
+void snap_exit(SnapshotStore *s, int reader);
+void snap_free(SnapshotStore *s);
+
 /* ========== Hash Table ========== */
+/* Animal IDs for one key. The first IDLIST_INLINE ids are stored in
+ * the list itself (in the space the heap pointer would take), and
+ * spill to a heap array only when more are added.
+ */
+#define IDLIST_INLINE 2
+
 typedef struct IdList {
-    int *ids;
     int count;
-    int capacity;
+    int capacity;   /* IDLIST_INLINE while inline; 0 in an empty slot */
+    union {
+        int inlineIds[IDLIST_INLINE];
+        int *heap;
+    } u;
 } IdList;
 
+/* One slot of the open-addressed table. vals.count == 0 marks an
+ * empty slot; occupied slots always hold at least one id.
+ */
 typedef struct Entry {
-    char *key;
+    unsigned hash;     /* cached hash of key, compared before strcmp */
+    size_t keyOffset;  /* key's offset in Hash.keys */
     IdList vals;
-    struct Entry *next;
 } Entry;
 
 typedef struct {
-    Entry **buckets;
-    int nbuckets;
-    int size;
+    Entry *slots;        /* linear probing, nslots is a power of two */
+    int nslots;
+    int size;            /* number of occupied slots */
+    char *keys;          /* all keys, null-terminated, back to back */
+    size_t keyBytes;
+    size_t keyCapacity;
+    size_t deadKeyBytes; /* bytes of removed keys still in keys */
+    uint64_t seed;       /* mixed into every key's hash; kept by h_free */
 } Hash;
 
 extern void h_init(Hash *h, int nbuckets);
+extern void h_init_seeded(Hash *h, int nbuckets, uint64_t seed);
 extern unsigned h_hash(const char *s);
+extern unsigned h_hash_seeded(const char *s, uint64_t seed);
 extern int h_put(Hash *h, const char *key, int animalId);
+extern int h_add(Hash *h, const char *key, int animalId);
 extern int h_contains(const Hash *h, const char *key, int animalId);
 extern int *h_get_ids(const Hash *h, const char *key, int *outCount);
+extern int h_remove(Hash *h, const char *key, int animalId);
 extern void h_free(Hash *h);
 extern char *canonicalize(const char *s);
+extern size_t canonicalize_into(const char *s, char *out);
 extern int get_yes_no(int y, int x, const char *prompt);
 extern char *get_input(int y, int x, const char *prompt);
 
@@ -122,12 +285,187 @@ extern Hash g_index;
 
 /* ========== Persistence ========== */
 int save_tree(const char *filename);
+int save_tree_version(const char *filename, int version);
 int load_tree(const char *filename);
 
+/* One written tree file, as a journal names the file it extends: its
+ * size, its trailing CRC32C (0 before VERSION 4) and its next free ID
+ */
+typedef struct {
+    uint64_t bytes;
+    uint32_t crc;
+    int32_t nextId;
+} TreeFileId;
+
+int save_tree_id(const char *filename, TreeFileId *id);
+int write_flat_tree(const char *path, const FlatTree *ft, int nextId, TreeFileId *id);
+int replace_file(const char *from, const char *to);
+void set_load_threads(int threads);
+uint32_t crc32c(uint32_t crc, const void *data, size_t len);
+
+/* ========== Bulk I/O ========== */
+/* Block-buffered file writer used by save_tree (bulkio.c) */
+typedef enum {
+    IO_FD = 0,      /* write(2) */
+    IO_DIRECT = 1,  /* O_DIRECT, bypassing the page cache */
+    IO_URING = 2    /* io_uring, two blocks in flight */
+} IoBackend;
+
+typedef struct BulkRing BulkRing;
+
+typedef struct {
+    int fd;
+    IoBackend backend;   /* the one in use, after any fallback */
+    char *buf;           /* buffer being filled */
+    char *buffers[2];
+    size_t cap;
+    size_t len;          /* bytes in buf */
+    uint64_t offset;     /* file offset of buf[0] */
+    int checksum;        /* keep crc over every byte written */
+    uint32_t crc;
+    int failed;
+    long writes;         /* blocks handed to the kernel */
+    BulkRing *ring;      /* IO_URING only */
+    int current;         /* which of buffers is buf */
+    size_t pending[2];   /* bytes in flight from each buffer */
+    uint64_t pendingAt[2];
+    int inFlight;
+} BulkWriter;
+
+int bw_open(BulkWriter *w, const char *path, IoBackend backend);
+void *bw_reserve(BulkWriter *w, size_t len);
+int bw_write(BulkWriter *w, const void *data, size_t len);
+uint32_t bw_crc(const BulkWriter *w);
+int bw_close(BulkWriter *w, int sync);
+void set_io_backend(IoBackend backend);
+
+/* ========== LZ Block Codec ========== */
+/* LZ4-style compression of independent blocks (lz.c) */
+size_t lz_bound(size_t len);
+size_t lz_compress(const void *src, size_t len, void *dst, size_t cap);
+long lz_decompress(const void *src, size_t len, void *dst, size_t cap);
+
+/* ========== Learning Journal ========== */
+/* Append-only log of edits next to a tree file, replayed by load_tree,
+ * so persisting a learn costs one record instead of a full save
+ */
+typedef enum {
+    JOURNAL_SPLIT = 1,  /* game_learn */
+    JOURNAL_UNDO = 2,
+    JOURNAL_REDO = 3
+} JournalOp;
+
+long journal_replay(const char *treeFile, const TreeFileId *id);
+int journal_open(const char *treeFile, int syncEvery, long compactBytes);
+void journal_record(JournalOp op, const Edit *e);
+int journal_sync();
+int journal_checkpoint();
+void journal_close();
+void journal_stats(long *fileBytes, long *compactions);
+
+/* ========== Tree Statistics ========== */
+typedef struct {
+    int nodes;
+    int leaves;
+    int maxDepth;      /* deepest leaf, root = 0 */
+    int *leafDepths;   /* leafDepths[d] = number of leaves at depth d */
+    int depthCapacity;
+} TreeStats;
+
+extern TreeStats g_stats;
+
+void stats_rebuild();
+void stats_apply_split(int depth);
+void stats_revert_split(int depth);
+void stats_free();
+
 /* ========== Utilities ========== */
 int check_integrity();
+void index_rebuild();
+void index_apply_split(const Edit *e);
+void index_revert_split(const Edit *e);
+unsigned long tree_unlink_epoch();
 void find_shortest_path(const char *animal1, const char *animal2);
 
+/* ========== Path Index ========== */
+/* Answers "how do these two animals differ?" for one version of a tree
+ * (utils.c). Nodes are numbered in preorder; each one's parent and depth
+ * are kept, and the lowest common ancestor of two nodes is the parent of
+ * the shallowest node strictly after the first and up to the second. That
+ * range minimum is O(1): minima from each block's start and to its end
+ * cover the partial blocks, and a sparse table over blocks of PATH_BLOCK
+ * nodes covers the whole ones in between.
+ */
+#define PATH_BLOCK 32
+
+typedef struct {
+    int count;
+    Node **nodes;         /* in preorder */
+    int *parent;          /* preorder index of the parent, -1 for the root */
+    int *depth;
+    int *prefixMin;       /* shallowest from the start of i's block to i */
+    int *suffixMin;       /* shallowest from i to the end of its block */
+    int blocks;
+    int levels;
+    int *blockMin;        /* [level * blocks + b]: shallowest of 2^level blocks */
+    StringTable animals;  /* animal text -> preorder index of its first leaf */
+} PathIndex;
+
+/* One question on the path between two animals */
+typedef struct {
+    const Node *question;
+    int answer;  /* 1 yes, 0 no: the branch toward the animal on this side */
+    int side;    /* 0 for the question that splits them, else 1 or 2 */
+} PathStep;
+
+int path_index_build(PathIndex *pi, Node *root);
+void path_index_free(PathIndex *pi);
+int path_find(const PathIndex *pi, const char *animal);
+int path_lca(const PathIndex *pi, int u, int v);
+int path_between(const PathIndex *pi, const char *animal1, const char *animal2,
+                 PathStep *steps, int cap);
+
+/* ========== Game Engine ========== */
+/* A UI-free game: start it, answer yes/no until it guesses, then either
+ * it won or it waits for game_learn. Sessions only read g_root until
+ * game_learn, which edits it (one learn at a time).
+ */
+typedef enum {
+    GAME_QUESTION,  /* asking the question game_text() */
+    GAME_GUESS,     /* guessing the animal game_text() */
+    GAME_WON,       /* guess confirmed */
+    GAME_LOST,      /* guess rejected; waiting for game_learn */
+    GAME_OVER       /* learned, or nothing left to ask */
+} GameState;
+
+typedef struct {
+    GameState state;
+    Node *current;
+    Node *parent;      /* question current was reached from, NULL at root */
+    int parentAnswer;  /* 1 yes, 0 no, -1 at root */
+    int depth;         /* questions answered so far = depth of current */
+    unsigned long epoch;  /* tree_unlink_epoch() when the game started */
+} GameSession;
+
+int game_start(GameSession *g);
+const char *game_text(const GameSession *g);
+int game_answer(GameSession *g, int yes);
+int game_learn(GameSession *g, const char *animal, const char *question,
+               int answerForAnimal);
+int game_resume(GameSession *g, const unsigned char *answers, int count, int leafId);
+
+/* Counts from replay_transcripts */
+typedef struct {
+    long sessions;             /* non-blank transcript lines */
+    long resolved;             /* reached a leaf */
+    long unresolved;           /* ran out early, went past a leaf, or bad */
+    long corrections;          /* resolved transcripts carrying a correction */
+    long distinctCorrections;  /* after deduplication within a batch */
+    long learned;              /* splits actually made */
+} ReplayStats;
+
+int replay_transcripts(FILE *in, int batchSize, ReplayStats *stats);
+
 /* ========== Gameplay ========== */
 void play_game();
 
@@ -0,0 +1,238 @@
+/*
+ * loadgen.c - Load generator for animal_server
+ *
+ * Usage: ./animal_loadgen [-u socket path | -p port] [-c clients]
+ *                         [-g games] [-i idle] [-l learn percent]
+ *   -u/-p  where the server listens (default: animal.sock)
+ *   -c     concurrent playing connections (default: 64)
+ *   -g     games to play in total (default: 100000)
+ *   -i     extra connections opened first that start a game and then
+ *          sit idle for the whole run (default: 0)
+ *   -l     percent of games where the guess is rejected and a new
+ *          animal is taught (default: 1)
+ *
+ * Each playing connection answers questions at random, then confirms the
+ * guess or rejects it and sends LEARN, and starts the next game. Reports
+ * games/sec, requests/sec and the mean request round trip.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <time.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/epoll.h>
+#include <sys/resource.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+
+#define LINE_MAX_LEN 1024
+
+typedef struct {
+    int fd;
+    int id;
+    int inLen;
+    double sentAt;
+    char in[LINE_MAX_LEN];
+} Client;
+
+static const char *g_path = "animal.sock";
+static int g_port = 0;
+static unsigned g_seed = 12345;
+
+static double now_sec() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static unsigned next_random() {
+    g_seed = g_seed * 1103515245u + 12345u;
+    return g_seed >> 16;
+}
+
+static int connect_server() {
+    int fd;
+    if (g_port > 0) {
+        fd = socket(AF_INET, SOCK_STREAM, 0);
+        struct sockaddr_in addr;
+        memset(&addr, 0, sizeof(addr));
+        addr.sin_family = AF_INET;
+        addr.sin_port = htons(g_port);
+        addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+        if (fd < 0 || connect(fd, (struct sockaddr*)&addr, sizeof(addr)) < 0) {
+            if (fd >= 0) close(fd);
+            return -1;
+        }
+    } else {
+        fd = socket(AF_UNIX, SOCK_STREAM, 0);
+        struct sockaddr_un addr;
+        memset(&addr, 0, sizeof(addr));
+        addr.sun_family = AF_UNIX;
+        strncpy(addr.sun_path, g_path, sizeof(addr.sun_path) - 1);
+        if (fd < 0 || connect(fd, (struct sockaddr*)&addr, sizeof(addr)) < 0) {
+            if (fd >= 0) close(fd);
+            return -1;
+        }
+    }
+    return fd;
+}
+
+/* Blocking send of a whole request */
+static int send_line(Client *c, const char *line) {
+    size_t len = strlen(line);
+    size_t sent = 0;
+    while (sent < len) {
+        ssize_t n = send(c->fd, line + sent, len - sent, MSG_NOSIGNAL);
+        if (n < 0) {
+            if (errno == EAGAIN || errno == EINTR) continue;
+            return 0;
+        }
+        sent += n;
+    }
+    c->sentAt = now_sec();
+    return 1;
+}
+
+int main(int argc, char **argv) {
+    int clients = 64;
+    long games = 100000;
+    int idle = 0;
+    int learnPercent = 1;
+    int opt;
+    while ((opt = getopt(argc, argv, "u:p:c:g:i:l:")) != -1) {
+        switch (opt) {
+            case 'u': g_path = optarg; break;
+            case 'p': g_port = atoi(optarg); break;
+            case 'c': clients = atoi(optarg); break;
+            case 'g': games = atol(optarg); break;
+            case 'i': idle = atoi(optarg); break;
+            case 'l': learnPercent = atoi(optarg); break;
+            default:
+                fprintf(stderr, "usage: %s [-u path | -p port] [-c clients] [-g games] "
+                        "[-i idle] [-l learn percent]\n", argv[0]);
+                return 1;
+        }
+    }
+    if (clients < 1 || games < 1 || idle < 0) {
+        fprintf(stderr, "animal_loadgen: clients and games must be positive\n");
+        return 1;
+    }
+
+    struct rlimit lim;
+    if (getrlimit(RLIMIT_NOFILE, &lim) == 0 && lim.rlim_cur < lim.rlim_max) {
+        lim.rlim_cur = lim.rlim_max;
+        setrlimit(RLIMIT_NOFILE, &lim);
+    }
+
+    // Idle sessions: each holds a game open at its first question
+    int *idleFds = malloc((idle ? idle : 1) * sizeof(int));
+    char reply[LINE_MAX_LEN];
+    for (int i = 0; i < idle; i++) {
+        idleFds[i] = connect_server();
+        if (idleFds[i] < 0 || send(idleFds[i], "NEW\n", 4, MSG_NOSIGNAL) != 4 ||
+            recv(idleFds[i], reply, sizeof(reply), 0) <= 0) {
+            fprintf(stderr, "animal_loadgen: idle connection %d failed: %s\n",
+                    i, strerror(errno));
+            return 1;
+        }
+    }
+    if (idle > 0) {
+        printf("idle sessions: %d open\n", idle);
+    }
+
+    int ep = epoll_create1(0);
+    Client *all = calloc(clients, sizeof(Client));
+    for (int i = 0; i < clients; i++) {
+        all[i].id = i;
+        all[i].fd = connect_server();
+        if (all[i].fd < 0) {
+            fprintf(stderr, "animal_loadgen: can't connect: %s\n", strerror(errno));
+            return 1;
+        }
+        struct epoll_event ev = {EPOLLIN, {.ptr = &all[i]}};
+        epoll_ctl(ep, EPOLL_CTL_ADD, all[i].fd, &ev);
+    }
+
+    long started = 0, finished = 0, learned = 0, requests = 0, errors = 0;
+    double latency = 0;
+    double start = now_sec();
+    for (int i = 0; i < clients && started < games; i++, started++) {
+        send_line(&all[i], "NEW\n");
+    }
+
+    struct epoll_event events[256];
+    int active = clients < games ? clients : (int)games;
+    char request[LINE_MAX_LEN];
+    while (active > 0) {
+        int n = epoll_wait(ep, events, 256, -1);
+        for (int e = 0; e < n; e++) {
+            Client *c = events[e].data.ptr;
+            ssize_t got = recv(c->fd, c->in + c->inLen, sizeof(c->in) - c->inLen, 0);
+            if (got <= 0) {
+                fprintf(stderr, "animal_loadgen: server closed a connection\n");
+                return 1;
+            }
+            c->inLen += got;
+            char *nl = memchr(c->in, '\n', c->inLen);
+            if (nl == NULL) {
+                continue;  // Partial reply
+            }
+            *nl = '\0';
+            requests++;
+            latency += now_sec() - c->sentAt;
+
+            int gameOver = 0;
+            if (strncmp(c->in, "ASK ", 4) == 0) {
+                send_line(c, next_random() & 1 ? "ANSWER y\n" : "ANSWER n\n");
+            } else if (strncmp(c->in, "GUESS ", 6) == 0) {
+                int reject = (int)(next_random() % 100) < learnPercent;
+                send_line(c, reject ? "ANSWER n\n" : "ANSWER y\n");
+            } else if (strcmp(c->in, "LOST") == 0) {
+                snprintf(request, sizeof(request),
+                         "LEARN Animal %d-%ld\tIs it animal %d-%ld?\t%c\n",
+                         c->id, finished, c->id, finished, next_random() & 1 ? 'y' : 'n');
+                send_line(c, request);
+            } else if (strcmp(c->in, "LEARNED") == 0) {
+                learned++;
+                gameOver = 1;
+            } else if (strcmp(c->in, "WON") == 0) {
+                gameOver = 1;
+            } else {
+                errors++;  // ERR or OVER: abandon this game
+                gameOver = 1;
+            }
+            int rest = c->inLen - (int)(nl + 1 - c->in);
+            memmove(c->in, nl + 1, rest);
+            c->inLen = rest;
+
+            if (gameOver) {
+                finished++;
+                if (started < games) {
+                    started++;
+                    send_line(c, "NEW\n");
+                } else {
+                    active--;
+                }
+            }
+        }
+    }
+    double elapsed = now_sec() - start;
+
+    printf("games:    %ld (%ld learned, %ld errors) on %d connections\n",
+           finished, learned, errors, clients);
+    printf("games/sec:    %.0f\n", finished / elapsed);
+    printf("requests/sec: %.0f\n", requests / elapsed);
+    printf("mean round trip: %.1f us\n", requests ? latency / requests * 1e6 : 0.0);
+
+    for (int i = 0; i < clients; i++) close(all[i].fd);
+    for (int i = 0; i < idle; i++) close(idleFds[i]);
+    free(all);
+    free(idleFds);
+    close(ep);
+    return errors ? 1 : 0;
+}
@@ -0,0 +1,193 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "lab5.h"
+
+/* ========== LZ Block Codec ========== */
+
+/* An LZ4-style codec for self-contained blocks (compressed snapshots).
+ * A block is a run of sequences, each:
+ *   token (1 byte)      high nibble: literal count, low nibble: match
+ *                       length - LZ_MIN_MATCH; 15 means "more follows"
+ *   [length bytes]      literal count - 15 as 255, 255, ..., < 255
+ *   literals
+ *   offset (2 bytes LE) how far back the match starts, 1..65535
+ *   [length bytes]      match length - LZ_MIN_MATCH - 15, as above
+ * The last sequence stops after its literals. Matches never reach
+ * outside the block, so blocks decompress independently.
+ */
+
+#define LZ_MIN_MATCH 4
+#define LZ_MAX_OFFSET 65535
+#define LZ_HASH_BITS 14
+#define LZ_SKIP_SHIFT 6  /* step up the search after 64 misses in a row */
+
+static uint32_t lz_read32(const unsigned char *p)
+{
+    uint32_t v;
+    memcpy(&v, p, sizeof(v));
+    return v;
+}
+
+static uint32_t lz_hash(uint32_t v)
+{
+    return (v * 2654435761u) >> (32 - LZ_HASH_BITS);
+}
+
+static unsigned char *lz_put_length(unsigned char *op, size_t len)
+{
+    while (len >= 255) {
+        *op++ = 255;
+        len -= 255;
+    }
+    *op++ = (unsigned char)len;
+    return op;
+}
+
+static unsigned char *lz_put_sequence(unsigned char *op, const unsigned char *literals,
+                                      size_t lit, size_t offset, size_t match)
+{
+    unsigned char *token = op++;
+    *token = (unsigned char)((lit >= 15 ? 15 : lit) << 4);
+    if (lit >= 15) {
+        op = lz_put_length(op, lit - 15);
+    }
+    memcpy(op, literals, lit);
+    op += lit;
+    if (offset == 0) {
+        return op;  // Last sequence: literals only
+    }
+    *op++ = (unsigned char)(offset & 0xFF);
+    *op++ = (unsigned char)(offset >> 8);
+    match -= LZ_MIN_MATCH;
+    *token |= (unsigned char)(match >= 15 ? 15 : match);
+    if (match >= 15) {
+        op = lz_put_length(op, match - 15);
+    }
+    return op;
+}
+
+/* Largest compressed size of len bytes: all literals plus length bytes */
+size_t lz_bound(size_t len)
+{
+    return len + len / 255 + 16;
+}
+
+/* Compress len bytes of src into dst, which must hold lz_bound(len).
+ * Greedy parse with a single-entry hash table of 4-byte sequences.
+ * Returns the compressed size, or 0 if cap is too small.
+ */
+size_t lz_compress(const void *src, size_t len, void *dst, size_t cap)
+{
+    if (cap < lz_bound(len)) {
+        return 0;
+    }
+    uint32_t table[1 << LZ_HASH_BITS];  // 64 KB of stack
+    memset(table, 0, sizeof(table));
+
+    const unsigned char *in = src;
+    const unsigned char *end = in + len;
+    const unsigned char *ip = in;
+    const unsigned char *anchor = in;  // start of pending literals
+    unsigned char *op = dst;
+    while (len >= LZ_MIN_MATCH && ip <= end - LZ_MIN_MATCH) {
+        uint32_t seq = lz_read32(ip);
+        uint32_t h = lz_hash(seq);
+        const unsigned char *ref = in + table[h];
+        table[h] = (uint32_t)(ip - in);
+        if (ref >= ip || ip - ref > LZ_MAX_OFFSET || lz_read32(ref) != seq) {
+            ip += 1 + ((size_t)(ip - anchor) >> LZ_SKIP_SHIFT);
+            continue;
+        }
+
+        const unsigned char *mp = ip + LZ_MIN_MATCH;
+        const unsigned char *rp = ref + LZ_MIN_MATCH;
+        while (mp < end && *mp == *rp) {
+            mp++;
+            rp++;
+        }
+        op = lz_put_sequence(op, anchor, (size_t)(ip - anchor), (size_t)(ip - ref),
+                             (size_t)(mp - ip));
+        // Index a position inside the match so the next one can chain
+        if (mp - 2 > ip && mp + 2 <= end) {
+            table[lz_hash(lz_read32(mp - 2))] = (uint32_t)(mp - 2 - in);
+        }
+        ip = anchor = mp;
+    }
+    op = lz_put_sequence(op, anchor, (size_t)(end - anchor), 0, 0);
+    return (size_t)(op - (unsigned char *)dst);
+}
+
+static int lz_get_length(const unsigned char **ip, const unsigned char *iend, size_t *len,
+                         size_t limit)
+{
+    unsigned char byte;
+    do {
+        if (*ip == iend) {
+            return 0;
+        }
+        byte = *(*ip)++;
+        *len += byte;
+        if (*len > limit) {
+            return 0;  // Longer than the output could hold
+        }
+    } while (byte == 255);
+    return 1;
+}
+
+/* Decompress a block into dst. Every length and offset is checked
+ * against both buffers, so hostile input fails instead of overrunning.
+ * Returns the decompressed size, or -1 if src is malformed or the
+ * output would exceed cap.
+ */
+long lz_decompress(const void *src, size_t len, void *dst, size_t cap)
+{
+    const unsigned char *ip = src;
+    const unsigned char *iend = ip + len;
+    unsigned char *out = dst;
+    unsigned char *op = out;
+    unsigned char *oend = out + cap;
+    while (ip < iend) {
+        unsigned token = *ip++;
+        size_t lit = token >> 4;
+        if (lit == 15 && !lz_get_length(&ip, iend, &lit, cap)) {
+            return -1;
+        }
+        if ((size_t)(iend - ip) < lit || (size_t)(oend - op) < lit) {
+            return -1;
+        }
+        memcpy(op, ip, lit);
+        op += lit;
+        ip += lit;
+        if (ip == iend) {
+            break;  // Last sequence
+        }
+
+        if (iend - ip < 2) {
+            return -1;
+        }
+        size_t offset = ip[0] | (size_t)ip[1] << 8;
+        ip += 2;
+        if (offset == 0 || offset > (size_t)(op - out)) {
+            return -1;  // Reaches before the block
+        }
+        size_t match = token & 15;
+        if (match == 15 && !lz_get_length(&ip, iend, &match, cap)) {
+            return -1;
+        }
+        match += LZ_MIN_MATCH;
+        if ((size_t)(oend - op) < match) {
+            return -1;
+        }
+        const unsigned char *ref = op - offset;
+        if (offset >= match) {
+            memcpy(op, ref, match);
+            op += match;
+        } else {
+            while (match-- > 0) {
+                *op++ = *ref++;  // Overlapping: repeats the last offset bytes
+            }
+        }
+    }
+    return (long)(op - out);
+}
@@ -19,18 +19,36 @@
 #include <stdlib.h>
 #include <string.h>
 #include <ctype.h>
+#include <time.h>
+#include <unistd.h>
 #include <ncurses.h>
 #include "lab5.h"
 
 /* Global root node */
 Node *g_root = NULL;
 
+/* Next unused node ID for g_root's tree */
+int g_nextId = 0;
+
+/* Maintained node/leaf/depth counts for g_root */
+TreeStats g_stats = {0, 0, 0, NULL, 0};
+
+/* Storage pool owning the nodes of g_root */
+NodePool g_pool = {{NULL, 0}, {NULL, 0}, NULL, 0, {NULL, NULL, NULL, 0, 0}, NULL, NULL, 0};
+
 /* Global undo/redo stacks */
 EditStack g_undo = {NULL, 0, 0};
 EditStack g_redo = {NULL, 0, 0};
 
 /* Global attribute index */
-Hash g_index = {NULL, 0, 0};
+Hash g_index = {NULL, 0, 0, NULL, 0, 0, 0, 0};
+
+/* Edits are journaled next to the tree file (journal.c), so saving
+ * costs the records written since the last save, not the whole tree */
+#define TREE_FILE "animals.dat"
+#define UI_SYNC_EVERY 64                   /* 's' syncs whatever is left */
+#define REPLAY_SYNC_EVERY 4096
+#define JOURNAL_COMPACT_BYTES (64L << 20)  /* rewrite the tree file past 64 MB of journal */
 
 /* GUI Colors */
 #define COLOR_HEADER 1
@@ -128,21 +146,86 @@ void initialize_tree() {
     
     
     
-    if (g_root != NULL) {
-        free_tree(g_root);
-    }
+    tree_release();
+    pool_init(&g_pool);
     
-    Node *water = create_question_node("Does it live in water?");
-    water->yes = create_animal_node("Fish");
-    water->no = create_animal_node("Dog");
+    Node *water = pool_node(&g_pool, "Does it live in water?", 1);
+    water->yes = pool_node(&g_pool, "Fish", 0);
+    water->no = pool_node(&g_pool, "Dog", 0);
+    water->id = g_nextId++;
+    water->yes->id = g_nextId++;
+    water->no->id = g_nextId++;
     g_root = water;
     
-    h_free(&g_index);
-    h_init(&g_index, 31);
+    index_rebuild();
+    stats_rebuild();
     
 }
 
-int main() {
+/* guess_animal --replay <transcripts> [tree file] [batch size]
+ * Stream transcripts through the tree without the UI (see
+ * replay_transcripts), print throughput, and journal what it learns to
+ * "<tree file>.journal". A tree file that doesn't exist yet starts from
+ * the starting tree; without one nothing is saved.
+ */
+static int run_replay(int argc, char **argv) {
+    const char *treeFile = argc > 3 ? argv[3] : NULL;
+    int batchSize = argc > 4 ? atoi(argv[4]) : 10000;
+    FILE *in = strcmp(argv[2], "-") == 0 ? stdin : fopen(argv[2], "r");
+    if (in == NULL) {
+        fprintf(stderr, "guess_animal: can't read %s\n", argv[2]);
+        return 1;
+    }
+    if (treeFile != NULL && access(treeFile, F_OK) == 0) {
+        if (!load_tree(treeFile)) {
+            fprintf(stderr, "guess_animal: can't load %s\n", treeFile);
+            return 1;
+        }
+    } else {
+        initialize_tree();
+    }
+    if (treeFile != NULL && !journal_open(treeFile, REPLAY_SYNC_EVERY, JOURNAL_COMPACT_BYTES)) {
+        fprintf(stderr, "guess_animal: can't journal to %s\n", treeFile);
+        return 1;
+    }
+
+    ReplayStats stats;
+    struct timespec start, end;
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    int ok = replay_transcripts(in, batchSize, &stats);
+    clock_gettime(CLOCK_MONOTONIC, &end);
+    if (in != stdin) fclose(in);
+    if (!ok) {
+        fprintf(stderr, "guess_animal: batch size must be at least 1\n");
+        return 1;
+    }
+    double seconds = (end.tv_sec - start.tv_sec) + (end.tv_nsec - start.tv_nsec) / 1e9;
+
+    printf("sessions:    %ld (%ld resolved, %ld unresolved)\n",
+           stats.sessions, stats.resolved, stats.unresolved);
+    printf("corrections: %ld (%ld distinct, %ld learned)\n",
+           stats.corrections, stats.distinctCorrections, stats.learned);
+    printf("tree:        %d nodes, %d animals\n", g_stats.nodes, g_stats.leaves);
+    printf("throughput:  %.0f sessions/sec\n",
+           seconds > 0 ? stats.sessions / seconds : 0.0);
+
+    if (treeFile != NULL && !journal_sync()) {
+        fprintf(stderr, "guess_animal: can't save %s\n", treeFile);
+        ok = 0;
+    }
+    journal_close();
+    tree_release();
+    free_edit_stack(&g_undo);
+    free_edit_stack(&g_redo);
+    h_free(&g_index);
+    return ok ? 0 : 1;
+}
+
+int main(int argc, char **argv) {
+    if (argc > 2 && strcmp(argv[1], "--replay") == 0) {
+        return run_replay(argc, argv);
+    }
+
     init_gui();
     
     /* Initialize undo/redo stacks FIRST */
@@ -165,7 +248,8 @@ int main() {
         draw_box(2, 1, LINES - 6, COLS - 2, "Game Status");
         display_menu();
         
-        mvprintw(4, 3, "Tree nodes: %d", g_root ? count_nodes(g_root) : 0);
+        mvprintw(4, 3, "Tree nodes: %d | Animals: %d | Max depth: %d",
+                 g_stats.nodes, g_stats.leaves, g_stats.maxDepth);
         mvprintw(5, 3, "Undo stack: %d | Redo stack: %d", g_undo.size, g_redo.size);
         
         if (g_root == NULL) {
@@ -206,14 +290,18 @@ int main() {
             case 's':
                 if (g_root == NULL) {
                     show_message("Error: No tree to save! Initialize tree first.", 1);
-                } else if (save_tree("animals.dat")) {
+                } else if (journal_sync() ||
+                           journal_open(TREE_FILE, UI_SYNC_EVERY, JOURNAL_COMPACT_BYTES)) {
+                    // The first save writes the tree and starts its journal
                     show_message("Tree saved successfully!", 0);
                 } else {
                     show_message("Error saving tree!", 1);
                 }
                 break;
             case 'l':
-                if (load_tree("animals.dat")) {
+                journal_close();  // Loading replays everything it wrote
+                if (load_tree(TREE_FILE)) {
+                    journal_open(TREE_FILE, UI_SYNC_EVERY, JOURNAL_COMPACT_BYTES);
                     show_message("Tree loaded successfully!", 0);
                 } else {
                     show_message("Error loading tree!", 1);
@@ -235,7 +323,8 @@ int main() {
     }
     
     endwin();
-    free_tree(g_root);
+    journal_close();
+    tree_release();
     free_edit_stack(&g_undo);
     free_edit_stack(&g_redo);
     h_free(&g_index);
@@ -1,23 +1,652 @@
+#define _DEFAULT_SOURCE  /* MAP_ANONYMOUS */
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 #include <stdint.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
 #include "lab5.h"
 
+#if defined(__x86_64__) && defined(__GNUC__)
+#include <nmmintrin.h>
+#define CRC32C_X86 1
+#elif defined(__aarch64__) && defined(__ARM_FEATURE_CRC32)
+#include <arm_acle.h>
+#define CRC32C_ARM 1
+#endif
+
 extern Node *g_root;
 
 #define MAGIC 0x41544C35  /* "ATL5" */
-#define VERSION 1
+#define VERSION_V1 1      /* variable-length records */
+#define VERSION_V2 2      /* fixed node table + string blob, mmap-able */
+#define VERSION_V3 3      /* VERSION 2 plus stable node IDs */
+#define VERSION_V4 4      /* VERSION 3 plus a trailing CRC32C */
+#define VERSION_V5 5      /* each distinct text stored once */
+#define VERSION_V6 6      /* VERSION 5 in compressed blocks */
+#define VERSION VERSION_V5  /* version written by save_tree */
+
+#define HEADER_BYTES 12        /* magic + version + count */
+#define RECORD_FIXED_BYTES 13  /* isQuestion + textLen + yesId + noId */
+
+/* VERSION 2 layout:
+ *   HeaderV2 | NodeRecordV2[count] | string blob (stringBytes)
+ * Every string in the blob is null-terminated, so loaded nodes point
+ * straight into the mapped file instead of copying their text.
+ * VERSION 3 is the same with NodeRecordV3 entries in the table, and
+ * VERSION 4 is VERSION 3 followed by a 4-byte CRC32C of everything
+ * before it.
+ */
+typedef struct {
+    uint32_t magic;
+    uint32_t version;
+    uint32_t count;
+    uint32_t nextId;       /* VERSION 3: next unused node ID; 0 in VERSION 2 */
+    uint64_t stringBytes;  /* size of the string blob */
+} HeaderV2;
+
+typedef struct {
+    uint64_t textOffset;  /* offset of text in the string blob */
+    int32_t yesId;        /* -1 if NULL */
+    int32_t noId;         /* -1 if NULL */
+    uint32_t textLen;     /* excluding the null terminator */
+    uint8_t isQuestion;
+    uint8_t pad[3];       /* always 0 */
+} NodeRecordV2;
+
+typedef struct {
+    NodeRecordV2 base;
+    int32_t id;           /* stable node ID, in [0, nextId) */
+    uint32_t pad;         /* always 0 */
+} NodeRecordV3;
+
+/* VERSION 5 layout:
+ *   HeaderV5 | uint64_t stringOffsets[stringCount] | NodeRecordV5[count] |
+ *   string blob (stringBytes) | CRC32C
+ * The blob holds each distinct text once, null-terminated, and node
+ * records name their text by its index in the string table. Texts
+ * recur all over a learned tree (the same question taught under many
+ * parents), so this shrinks the blob, and the records drop to 16 bytes.
+ */
+typedef struct {
+    HeaderV2 base;
+    uint32_t stringCount;  /* distinct texts */
+    uint32_t pad;          /* always 0 */
+} HeaderV5;
+
+#define V5_QUESTION 0x80000000u  /* NodeRecordV5.text flag bit */
+
+typedef struct {
+    uint32_t text;        /* string table index, V5_QUESTION for questions */
+    int32_t yesId;        /* -1 if NULL */
+    int32_t noId;         /* -1 if NULL */
+    int32_t id;           /* stable node ID, in [0, nextId) */
+} NodeRecordV5;
+
+/* VERSION 6 layout:
+ *   HeaderV6 | compressed blocks | uint32_t packedBytes[blockCount] |
+ *   CRC32C
+ * The VERSION 5 body (string table, node table, blob) is cut into
+ * blockBytes pieces, each compressed on its own with the LZ codec (or
+ * stored as is when that doesn't shrink it: packedBytes equal to the
+ * raw size), so load can decompress them in parallel. The block sizes
+ * go at the end, as they're only known once each block is written.
+ */
+typedef struct {
+    HeaderV5 v5;          /* the VERSION 5 header, version 6 */
+    uint32_t blockBytes;  /* raw bytes per block; the last may be short */
+    uint32_t blockCount;
+} HeaderV6;
+
+#define V6_BLOCK (64 << 10)        /* one LZ window */
+#define V6_MAX_BLOCK (16 << 20)
+#define V6_MAX_RATIO 256           /* raw bytes one packed byte can make */
+
+/* ---------- CRC32C (Castagnoli) ---------- */
+
+/* Software fallback: slicing-by-8 over the reflected polynomial */
+static uint32_t g_crcTable[8][256];
+static uint32_t (*g_crcUpdate)(uint32_t, const unsigned char *, size_t);
+static pthread_once_t g_crcOnce = PTHREAD_ONCE_INIT;
+
+static uint32_t crc32c_sw(uint32_t crc, const unsigned char *p, size_t len)
+{
+    while (len > 0 && ((uintptr_t)p & 7) != 0) {
+        crc = g_crcTable[0][(crc ^ *p++) & 0xFF] ^ (crc >> 8);
+        len--;
+    }
+    while (len >= 8) {
+        uint32_t lo, hi;
+        memcpy(&lo, p, 4);
+        memcpy(&hi, p + 4, 4);
+        lo ^= crc;
+        crc = g_crcTable[7][lo & 0xFF] ^ g_crcTable[6][(lo >> 8) & 0xFF] ^
+              g_crcTable[5][(lo >> 16) & 0xFF] ^ g_crcTable[4][lo >> 24] ^
+              g_crcTable[3][hi & 0xFF] ^ g_crcTable[2][(hi >> 8) & 0xFF] ^
+              g_crcTable[1][(hi >> 16) & 0xFF] ^ g_crcTable[0][hi >> 24];
+        p += 8;
+        len -= 8;
+    }
+    while (len-- > 0) {
+        crc = g_crcTable[0][(crc ^ *p++) & 0xFF] ^ (crc >> 8);
+    }
+    return crc;
+}
+
+/* Hardware path: the CRC32 instruction computes exactly this CRC */
+#if defined(CRC32C_X86)
+#define CRC_LANE 4096  /* bytes per lane of the three-way loop */
+
+/* Advancing a CRC over CRC_LANE zero bytes, one table per input byte */
+static uint32_t g_crcShift[4][256];
+
+static uint32_t crc32c_shift(uint32_t crc)
+{
+    return g_crcShift[0][crc & 0xFF] ^ g_crcShift[1][(crc >> 8) & 0xFF] ^
+           g_crcShift[2][(crc >> 16) & 0xFF] ^ g_crcShift[3][crc >> 24];
+}
+
+/* The instruction's latency is three times its throughput, so large
+ * inputs run three independent lanes and stitch their CRCs together:
+ * the CRC of a then b is crc(a) advanced over len(b) zeros, xor crc(b).
+ */
+__attribute__((target("sse4.2")))
+static uint32_t crc32c_hw(uint32_t crc, const unsigned char *p, size_t len)
+{
+    uint64_t c = crc;
+    while (len > 0 && ((uintptr_t)p & 7) != 0) {
+        c = _mm_crc32_u8((uint32_t)c, *p++);
+        len--;
+    }
+    while (len >= 3 * CRC_LANE) {
+        uint64_t c1 = 0, c2 = 0;
+        const unsigned char *end = p + CRC_LANE;
+        while (p < end) {
+            uint64_t w0, w1, w2;
+            memcpy(&w0, p, 8);
+            memcpy(&w1, p + CRC_LANE, 8);
+            memcpy(&w2, p + 2 * CRC_LANE, 8);
+            c = _mm_crc32_u64(c, w0);
+            c1 = _mm_crc32_u64(c1, w1);
+            c2 = _mm_crc32_u64(c2, w2);
+            p += 8;
+        }
+        c = crc32c_shift(crc32c_shift((uint32_t)c) ^ (uint32_t)c1) ^ (uint32_t)c2;
+        p += 2 * CRC_LANE;
+        len -= 3 * CRC_LANE;
+    }
+    while (len >= 8) {
+        uint64_t word;
+        memcpy(&word, p, 8);
+        c = _mm_crc32_u64(c, word);
+        p += 8;
+        len -= 8;
+    }
+    while (len-- > 0) {
+        c = _mm_crc32_u8((uint32_t)c, *p++);
+    }
+    return (uint32_t)c;
+}
+#elif defined(CRC32C_ARM)
+static uint32_t crc32c_hw(uint32_t crc, const unsigned char *p, size_t len)
+{
+    while (len > 0 && ((uintptr_t)p & 7) != 0) {
+        crc = __crc32cb(crc, *p++);
+        len--;
+    }
+    while (len >= 8) {
+        uint64_t word;
+        memcpy(&word, p, 8);
+        crc = __crc32cd(crc, word);
+        p += 8;
+        len -= 8;
+    }
+    while (len-- > 0) {
+        crc = __crc32cb(crc, *p++);
+    }
+    return crc;
+}
+#endif
+
+static void crc32c_init()
+{
+    for (uint32_t i = 0; i < 256; i++) {
+        uint32_t crc = i;
+        for (int bit = 0; bit < 8; bit++) {
+            crc = (crc >> 1) ^ ((crc & 1) ? 0x82F63B78u : 0);
+        }
+        g_crcTable[0][i] = crc;
+    }
+    for (int t = 1; t < 8; t++) {
+        for (int i = 0; i < 256; i++) {
+            uint32_t prev = g_crcTable[t - 1][i];
+            g_crcTable[t][i] = g_crcTable[0][prev & 0xFF] ^ (prev >> 8);
+        }
+    }
+    g_crcUpdate = crc32c_sw;
+#if defined(CRC32C_X86)
+    if (__builtin_cpu_supports("sse4.2")) {
+        // The shift is linear, so tabulate it from its 32 basis vectors
+        static const unsigned char zeros[CRC_LANE];
+        uint32_t basis[32];
+        for (int bit = 0; bit < 32; bit++) {
+            basis[bit] = crc32c_sw(1u << bit, zeros, CRC_LANE);
+        }
+        for (int k = 0; k < 4; k++) {
+            for (int b = 0; b < 256; b++) {
+                uint32_t v = 0;
+                for (int bit = 0; bit < 8; bit++) {
+                    if (b & (1 << bit)) {
+                        v ^= basis[8 * k + bit];
+                    }
+                }
+                g_crcShift[k][b] = v;
+            }
+        }
+        g_crcUpdate = crc32c_hw;
+    }
+#elif defined(CRC32C_ARM)
+    g_crcUpdate = crc32c_hw;
+#endif
+}
+
+/* CRC32C of len bytes, continuing from crc (0 to start). Chaining
+ * works: crc32c(crc32c(0, a, m), b, n) is the CRC of a followed by b.
+ */
+uint32_t crc32c(uint32_t crc, const void *data, size_t len)
+{
+    pthread_once(&g_crcOnce, crc32c_init);
+    return ~g_crcUpdate(~crc, data, len);
+}
+
+/* Length of node i's text. Flat tree strings are stored in node order,
+ * so it runs up to the next node's text (or the end of the pool).
+ */
+static uint32_t flat_text_len(const FlatTree *ft, int i)
+{
+    uint64_t end = (i + 1 < ft->count) ? ft->textOffset[i + 1] : ft->stringBytes;
+    return (uint32_t)(end - ft->textOffset[i] - 1);
+}
+
+/* Back end save_tree writes through (set_io_backend) */
+static IoBackend g_ioBackend = IO_FD;
+
+void set_io_backend(IoBackend backend)
+{
+    g_ioBackend = backend;
+}
+
+/* Write a VERSION 1 file body: header then variable-length records,
+ * encoded straight into the writer's buffer
+ */
+static int write_v1(BulkWriter *w, const FlatTree *ft)
+{
+    // Write header (magic, version, nodeCount)
+    uint32_t header[3] = {
+        MAGIC,              // Magic number for file format validation
+        VERSION_V1,         // Version number for compatibility checking
+        (uint32_t)ft->count // Total number of nodes in tree
+    };
+    if (!bw_write(w, header, sizeof(header))) {
+        return 0;  // Failed to write header
+    }
+    
+    // For each node in BFS order
+    for (int i = 0; i < ft->count; i++) {
+        uint8_t isQuestion = FLAT_IS_QUESTION(ft, i);
+        uint32_t textLen = flat_text_len(ft, i);
+        const char *text = ft->strings + ft->textOffset[i];
+        // Child IDs are BFS indices already (-1 if NULL)
+        int32_t ids[2] = {FLAT_YES(ft, i), FLAT_NO(ft, i)};
+        
+        // isQuestion, textLen, text (no null terminator), yesId, noId
+        char *rec = bw_reserve(w, 5);
+        if (rec == NULL) {
+            return 0;  // Failed to write record
+        }
+        rec[0] = (char)isQuestion;
+        memcpy(rec + 1, &textLen, sizeof(textLen));
+        if (!bw_write(w, text, textLen) || !bw_write(w, ids, sizeof(ids))) {
+            return 0;  // Failed to write record
+        }
+    }
+    return 1;
+}
 
+/* Write a VERSION 2, 3 or 4 file body: header, fixed-size node table,
+ * string blob. VERSION 3 records also carry each node's ID. Records are
+ * encoded in place in the writer's buffer, and the flat tree's string
+ * pool already has the blob's layout, so text offsets carry over and
+ * the blob is copied in one go. VERSION 4 appends the writer's CRC.
+ */
+static int write_v2(BulkWriter *w, const FlatTree *ft, int version, int nextId)
+{
+    int hasIds = (version >= VERSION_V3);
+    w->checksum = (version == VERSION_V4);
+    
+    HeaderV2 header;
+    memset(&header, 0, sizeof(header));
+    header.magic = MAGIC;
+    header.version = version;
+    header.count = ft->count;
+    header.nextId = hasIds ? (uint32_t)nextId : 0;
+    header.stringBytes = ft->stringBytes;
+    if (!bw_write(w, &header, sizeof(header))) {
+        return 0;  // Failed to write header
+    }
+    
+    // Node table, in BFS order. VERSION 2 records are just the leading
+    // NodeRecordV2 part.
+    size_t recordSize = hasIds ? sizeof(NodeRecordV3) : sizeof(NodeRecordV2);
+    for (int i = 0; i < ft->count; i++) {
+        NodeRecordV3 *rec = bw_reserve(w, recordSize);
+        if (rec == NULL) {
+            return 0;  // Failed to write node record
+        }
+        memset(rec, 0, recordSize);
+        rec->base.textLen = flat_text_len(ft, i);
+        rec->base.textOffset = ft->textOffset[i];
+        rec->base.yesId = FLAT_YES(ft, i);
+        rec->base.noId = FLAT_NO(ft, i);
+        rec->base.isQuestion = FLAT_IS_QUESTION(ft, i);
+        if (hasIds) {
+            rec->id = ft->ids[i];
+        }
+    }
+    
+    // String blob: every text with its null terminator
+    if (!bw_write(w, ft->strings, ft->stringBytes)) {
+        return 0;  // Failed to write text
+    }
+    
+    // Trailer: CRC32C of everything above
+    if (version == VERSION_V4) {
+        uint32_t crc = bw_crc(w);
+        if (!bw_write(w, &crc, sizeof(crc))) {
+            return 0;
+        }
+    }
+    return 1;
+}
+
+/* Collects the VERSION 6 body and writes it a compressed block at a time */
 typedef struct {
-    Node *node;
-    int id;
-} NodeMapping;
+    BulkWriter *w;
+    unsigned char *raw;     /* block being filled */
+    size_t len;
+    unsigned char *packed;  /* lz_bound(V6_BLOCK) */
+    uint32_t *sizes;        /* packed size of each block written */
+    uint32_t blocks;
+} BlockPacker;
+
+/* Compress the filled block and write it, or write it as is when that
+ * doesn't shrink it, and record its packed size
+ */
+static int pack_flush(BlockPacker *pk)
+{
+    size_t packed = lz_compress(pk->raw, pk->len, pk->packed, lz_bound(V6_BLOCK));
+    int ok;
+    if (packed == 0 || packed >= pk->len) {
+        packed = pk->len;  // Incompressible: store it
+        ok = bw_write(pk->w, pk->raw, pk->len);
+    } else {
+        ok = bw_write(pk->w, pk->packed, packed);
+    }
+    pk->sizes[pk->blocks++] = (uint32_t)packed;
+    pk->len = 0;
+    return ok;
+}
+
+/* Append to the VERSION 5 body: straight to w, or through pk */
+static int v5_put(BulkWriter *w, BlockPacker *pk, const void *data, size_t len)
+{
+    if (pk == NULL) {
+        return bw_write(w, data, len);
+    }
+    const unsigned char *p = data;
+    while (len > 0) {
+        size_t n = V6_BLOCK - pk->len;
+        if (n > len) {
+            n = len;
+        }
+        memcpy(pk->raw + pk->len, p, n);
+        pk->len += n;
+        p += n;
+        len -= n;
+        if (pk->len == V6_BLOCK && !pack_flush(pk)) {
+            return 0;
+        }
+    }
+    return 1;
+}
+
+/* Write a VERSION 5 file: texts are numbered in order of first use
+ * (deduplicated through a StringTable), then the string table, node
+ * records and blob are written in one pass each, followed by the CRC.
+ * With compress set it writes VERSION 6 instead: the same body goes
+ * through a BlockPacker, and the block sizes follow it.
+ */
+static int write_v5(BulkWriter *w, const FlatTree *ft, int nextId, int compress)
+{
+    uint32_t *textIds = malloc((size_t)ft->count * sizeof(uint32_t));
+    int32_t *firstUse = malloc((size_t)ft->count * sizeof(int32_t));  // node per text
+    StringTable seen;
+    st_init(&seen);
+    uint32_t distinct = 0;
+    uint64_t blobBytes = 0;
+    int ok = (textIds != NULL && firstUse != NULL);
+    for (int i = 0; ok && i < ft->count; i++) {
+        const char *text = ft->strings + ft->textOffset[i];
+        long slot = st_find(&seen, text);
+        if (slot >= 0) {
+            textIds[i] = (uint32_t)seen.values[slot];
+        } else {
+            textIds[i] = distinct;
+            firstUse[distinct++] = i;
+            blobBytes += flat_text_len(ft, i) + 1;
+            ok = st_add(&seen, text, (int)textIds[i]);
+        }
+    }
+    st_free(&seen);
+    
+    w->checksum = 1;
+    HeaderV6 header;
+    memset(&header, 0, sizeof(header));
+    header.v5.base.magic = MAGIC;
+    header.v5.base.version = compress ? VERSION_V6 : VERSION_V5;
+    header.v5.base.count = ft->count;
+    header.v5.base.nextId = (uint32_t)nextId;
+    header.v5.base.stringBytes = blobBytes;
+    header.v5.stringCount = distinct;
+    
+    BlockPacker packer;
+    BlockPacker *pk = NULL;
+    if (compress) {
+        uint64_t rawBytes = (uint64_t)distinct * sizeof(uint64_t) +
+                            (uint64_t)ft->count * sizeof(NodeRecordV5) + blobBytes;
+        header.blockBytes = V6_BLOCK;
+        header.blockCount = (uint32_t)((rawBytes + V6_BLOCK - 1) / V6_BLOCK);
+        memset(&packer, 0, sizeof(packer));
+        packer.w = w;
+        packer.raw = malloc(V6_BLOCK);
+        packer.packed = malloc(lz_bound(V6_BLOCK));
+        packer.sizes = malloc(header.blockCount * sizeof(uint32_t));
+        ok = ok && packer.raw != NULL && packer.packed != NULL && packer.sizes != NULL;
+        pk = &packer;
+        ok = ok && bw_write(w, &header, sizeof(header));
+    } else {
+        ok = ok && bw_write(w, &header.v5, sizeof(header.v5));
+    }
+    
+    // String table: where each distinct text starts in the blob
+    uint64_t offset = 0;
+    for (uint32_t k = 0; ok && k < distinct; k++) {
+        ok = v5_put(w, pk, &offset, sizeof(offset));
+        offset += flat_text_len(ft, firstUse[k]) + 1;
+    }
+    
+    // Node table, in BFS order
+    for (int i = 0; ok && i < ft->count; i++) {
+        NodeRecordV5 local;
+        NodeRecordV5 *rec = pk != NULL ? &local : bw_reserve(w, sizeof(NodeRecordV5));
+        if (rec == NULL) {
+            ok = 0;
+            break;
+        }
+        rec->text = textIds[i] | (FLAT_IS_QUESTION(ft, i) ? V5_QUESTION : 0);
+        rec->yesId = FLAT_YES(ft, i);
+        rec->noId = FLAT_NO(ft, i);
+        rec->id = ft->ids[i];
+        if (pk != NULL) {
+            ok = v5_put(w, pk, rec, sizeof(*rec));
+        }
+    }
+    
+    // Blob: each distinct text with its null terminator
+    for (uint32_t k = 0; ok && k < distinct; k++) {
+        int i = firstUse[k];
+        ok = v5_put(w, pk, ft->strings + ft->textOffset[i], flat_text_len(ft, i) + 1);
+    }
+    
+    // Last short block, then the block size table
+    if (pk != NULL) {
+        if (ok && pk->len > 0) {
+            ok = pack_flush(pk);
+        }
+        ok = ok && pk->blocks == header.blockCount &&
+             bw_write(w, pk->sizes, pk->blocks * sizeof(uint32_t));
+        free(pk->raw);
+        free(pk->packed);
+        free(pk->sizes);
+    }
+    
+    if (ok) {
+        uint32_t crc = bw_crc(w);
+        ok = bw_write(w, &crc, sizeof(crc));
+    }
+    free(textIds);
+    free(firstUse);
+    return ok;
+}
+
+/* Identify the tree file open on fd: its size and, from VERSION 4 on,
+ * the CRC32C stored in its last 4 bytes
+ */
+static int tree_file_id(int fd, int hasCrc, int nextId, TreeFileId *id)
+{
+    struct stat st;
+    if (fstat(fd, &st) != 0) {
+        return 0;
+    }
+    id->bytes = (uint64_t)st.st_size;
+    id->crc = 0;
+    id->nextId = nextId;
+    if (hasCrc && (st.st_size < (off_t)sizeof(id->crc) ||
+                   pread(fd, &id->crc, sizeof(id->crc), st.st_size - sizeof(id->crc)) !=
+                       (ssize_t)sizeof(id->crc))) {
+        return 0;
+    }
+    return 1;
+}
+
+/* Steps 2, 4 and part of 5 of save_tree: write ft to path, flush it to
+ * disk and, if id is given, identify the file written
+ */
+static int write_tree_tmp(const char *path, const FlatTree *ft, int version, int nextId,
+                          TreeFileId *id)
+{
+    // Step 2: Open temp file for writing through the bulk writer
+    BulkWriter w;
+    if (!bw_open(&w, path, g_ioBackend)) {
+        return 0;  // Failed to open file
+    }
+    
+    // Step 4: Write header and records
+    int ok;
+    if (version == VERSION_V1) {
+        ok = write_v1(&w, ft);
+    } else if (version >= VERSION_V5) {
+        ok = write_v5(&w, ft, nextId, version == VERSION_V6);
+    } else {
+        ok = write_v2(&w, ft, version, nextId);
+    }
+    
+    // Step 5: Flush, fsync and close. The data must be on disk before
+    // the rename, or a crash could leave an empty file under the real
+    // name (and the journal already compacted away).
+    if (!bw_close(&w, 1)) {
+        ok = 0;
+    }
+    if (ok && id != NULL) {
+        int fd = open(path, O_RDONLY);
+        ok = fd >= 0 && tree_file_id(fd, version >= VERSION_V4, nextId, id);
+        if (fd >= 0) {
+            close(fd);
+        }
+    }
+    return ok;
+}
+
+/* Rename from over to and sync the directory, since the rename itself
+ * lives there: once this returns, a crash leaves the new file under to
+ */
+int replace_file(const char *from, const char *to)
+{
+    if (rename(from, to) != 0) {
+        return 0;
+    }
+    size_t len = strlen(to);
+    char *dir = malloc(len + 2);
+    if (dir == NULL) {
+        return 1;  // Renamed; the directory sync is best effort anyway
+    }
+    memcpy(dir, to, len + 1);
+    char *slash = strrchr(dir, '/');
+    if (slash == dir) {
+        dir[1] = '\0';
+    } else if (slash != NULL) {
+        *slash = '\0';
+    } else {
+        strcpy(dir, ".");
+    }
+    int dirFd = open(dir, O_RDONLY);
+    if (dirFd >= 0) {
+        fsync(dirFd);  // Best effort: not every filesystem allows it
+        close(dirFd);
+    }
+    free(dir);
+    return 1;
+}
+
+/* Steps 2, 4 and 5 of save_tree: write ft to "<filename>.tmp", flush it
+ * to disk and rename it over filename
+ */
+static int write_tree_file(const char *filename, const FlatTree *ft, int version, int nextId,
+                           TreeFileId *id)
+{
+    size_t nameLen = strlen(filename);
+    char *tmpName = malloc(nameLen + 5);
+    if (tmpName == NULL) {
+        return 0;
+    }
+    memcpy(tmpName, filename, nameLen);
+    memcpy(tmpName + nameLen, ".tmp", 5);
+    
+    int ok = write_tree_tmp(tmpName, ft, version, nextId, id) &&
+             replace_file(tmpName, filename);
+    if (!ok) {
+        remove(tmpName);
+    }
+    free(tmpName);
+    return ok;
+}
 
 /* TODO 27: Implement save_tree
  * Save the tree to a binary file using BFS traversal
  * 
- * Binary format:
+ * Binary format (VERSION 1):
  * - Header: magic (4 bytes), version (4 bytes), nodeCount (4 bytes)
  * - For each node in BFS order:
  *   - isQuestion (1 byte)
@@ -25,173 +654,852 @@ typedef struct {
  *   - text (textLen bytes, no null terminator)
  *   - yesId (4 bytes, -1 if NULL)
  *   - noId (4 bytes, -1 if NULL)
+ * VERSION 2 stores the same fields as a fixed-size node table followed
+ * by a blob of null-terminated strings (see HeaderV2). VERSION 3 adds
+ * each node's stable ID and the next free ID (g_nextId), VERSION 4 a
+ * trailing CRC32C that load_tree verifies, VERSION 5 (the default)
+ * stores each distinct text once (see HeaderV5), and VERSION 6 is
+ * VERSION 5 compressed in blocks (see HeaderV6).
  * 
  * Steps:
  * 1. Return 0 if g_root is NULL
- * 2. Open file for writing binary ("wb")
- * 3. Initialize queue and NodeMapping array
- * 4. Use BFS to assign IDs to all nodes:
- *    - Enqueue root with id=0
- *    - Store mapping[0] = {g_root, 0}
- *    - While queue not empty:
- *      - Dequeue node and id
- *      - If node has yes child: add to mappings, enqueue with new id
- *      - If node has no child: add to mappings, enqueue with new id
- * 5. Write header (magic, version, nodeCount)
- * 6. For each node in mapping order:
- *    - Write isQuestion, textLen, text bytes
- *    - Find yes child's id in mappings (or -1)
- *    - Find no child's id in mappings (or -1)
- *    - Write yesId, noId
- * 7. Clean up and return 1 on success
+ * 2. Open "<filename>.tmp" through the bulk writer (bw_open, with the
+ *    backend chosen by set_io_backend)
+ * 3. Flatten the tree (flat_from_tree): BFS positions become the
+ *    record IDs, child links become indices and all text is packed into
+ *    one pool. Any node without a stable ID gets one from g_nextId.
+ * 4. Write the header and records for the requested version from the
+ *    flat arrays
+ * 5. Flush the temp file to disk (fsync), rename it over filename and
+ *    fsync the directory, so a crash leaves either the old file or the
+ *    new one. A loaded VERSION 2 tree may be mapped from filename, and
+ *    truncating a mapped file in place would pull the pages out from
+ *    under it.
+ * 6. Clean up and return 1 on success
  */
-int save_tree(const char *filename) 
+static int save_tree_file(const char *filename, int version, TreeFileId *id)
 {
     // Step 1: Return 0 if g_root is NULL
     if (g_root == NULL) {
         return 0;  // Nothing to save if tree is empty
     }
+    if (version < VERSION_V1 || version > VERSION_V6) {
+        return 0;  // Unknown format
+    }
     
-    // Step 2: Open file for writing binary ("wb")
-    FILE *fp = fopen(filename, "wb");
-    if (fp == NULL) {
-        return 0;  // Failed to open file
+    // Step 3: Flatten into BFS order (also assigns missing IDs)
+    FlatTree ft;
+    if (!flat_from_tree(&ft, g_root)) {
+        return 0;
+    }
+    int ok = write_tree_file(filename, &ft, version, g_nextId, id);
+    flat_free(&ft);
+    return ok;
+}
+
+int save_tree_version(const char *filename, int version)
+{
+    return save_tree_file(filename, version, NULL);
+}
+
+int save_tree(const char *filename)
+{
+    return save_tree_file(filename, VERSION, NULL);
+}
+
+/* save_tree, also identifying the file written (for a journal) */
+int save_tree_id(const char *filename, TreeFileId *id)
+{
+    return save_tree_file(filename, VERSION, id);
+}
+
+/* Write an already flattened tree in the default version straight to
+ * path (no rename; see replace_file) and identify it. Touches no
+ * globals, so it can run on a background thread while g_root keeps
+ * changing.
+ */
+int write_flat_tree(const char *path, const FlatTree *ft, int nextId, TreeFileId *id)
+{
+    if (ft->count == 0) {
+        return 0;
+    }
+    if (!write_tree_tmp(path, ft, VERSION, nextId, id)) {
+        remove(path);
+        return 0;
+    }
+    return 1;
+}
+
+/* ---------- Parallel load ---------- */
+
+#define LOAD_MAX_THREADS 64
+#define LOAD_MIN_PER_THREAD 65536  /* records; smaller files use fewer threads */
+
+static int g_loadThreads = 0;  /* 0: one per online CPU */
+
+/* Threads load_tree may use to parse and build a tree (0, the default,
+ * means one per online CPU). Trees under LOAD_MIN_PER_THREAD records
+ * per thread use fewer, down to the calling thread alone.
+ */
+void set_load_threads(int threads)
+{
+    g_loadThreads = threads < 0 ? 0 : threads;
+}
+
+/* How many parts to split count records into */
+static int load_parts(uint64_t count)
+{
+    long threads = g_loadThreads;
+    if (threads == 0) {
+        threads = sysconf(_SC_NPROCESSORS_ONLN);
+    }
+    if ((uint64_t)threads > count / LOAD_MIN_PER_THREAD) {
+        threads = (long)(count / LOAD_MIN_PER_THREAD);
+    }
+    if (threads > LOAD_MAX_THREADS) {
+        threads = LOAD_MAX_THREADS;
+    }
+    return threads < 1 ? 1 : (int)threads;
+}
+
+/* Part part of parts over [0, count) */
+static void part_range(uint64_t count, int part, int parts, uint64_t *begin, uint64_t *end)
+{
+    *begin = count * part / parts;
+    *end = count * (part + 1) / parts;
+}
+
+typedef struct {
+    void (*fn)(void *job, int part, int parts);
+    void *job;
+    int part;
+    int parts;
+} LoadPart;
+
+static void *load_part_thread(void *arg)
+{
+    LoadPart *lp = arg;
+    lp->fn(lp->job, lp->part, lp->parts);
+    return NULL;
+}
+
+/* Run fn(job, part, parts) for every part: part 0 on the calling thread,
+ * the rest on their own threads (or inline if one can't be started)
+ */
+static void run_parts(void (*fn)(void *, int, int), void *job, int parts)
+{
+    LoadPart lp[LOAD_MAX_THREADS];
+    pthread_t threads[LOAD_MAX_THREADS];
+    int started[LOAD_MAX_THREADS];
+    for (int i = 1; i < parts; i++) {
+        lp[i].fn = fn;
+        lp[i].job = job;
+        lp[i].part = i;
+        lp[i].parts = parts;
+        started[i] = pthread_create(&threads[i], NULL, load_part_thread, &lp[i]) == 0;
+        if (!started[i]) {
+            fn(job, i, parts);
+        }
+    }
+    fn(job, 0, parts);
+    for (int i = 1; i < parts; i++) {
+        if (started[i]) {
+            pthread_join(threads[i], NULL);
+        }
+    }
+}
+
+/* a * b modulo the CRC32C polynomial, in the reflected bit order the
+ * CRC uses (x^0 is the top bit)
+ */
+static uint32_t crc_mulmod(uint32_t a, uint32_t b)
+{
+    uint32_t product = 0;
+    for (int i = 0; i < 32; i++) {
+        if (a & 0x80000000u) {
+            product ^= b;
+        }
+        a <<= 1;
+        b = (b >> 1) ^ ((b & 1) ? 0x82F63B78u : 0);
+    }
+    return product;
+}
+
+/* x^(8n): running a CRC over n zero bytes multiplies it by this */
+static uint32_t crc_x8n(uint64_t n)
+{
+    uint32_t power = 0x40000000u;  // x^1, squared up to x^(2^k)
+    uint32_t result = 0x80000000u; // x^0
+    n *= 8;
+    while (n > 0) {
+        if (n & 1) {
+            result = crc_mulmod(power, result);
+        }
+        power = crc_mulmod(power, power);
+        n >>= 1;
+    }
+    return result;
+}
+
+/* CRC of a followed by b, given crc32c of each and b's length */
+static uint32_t crc32c_combine(uint32_t crcA, uint32_t crcB, uint64_t lenB)
+{
+    return crc_mulmod(crc_x8n(lenB), crcA) ^ crcB;
+}
+
+typedef struct {
+    const unsigned char *data;
+    uint64_t len;
+    uint32_t crc[LOAD_MAX_THREADS];
+} CrcJob;
+
+static void crc_part(void *arg, int part, int parts)
+{
+    CrcJob *job = arg;
+    uint64_t begin, end;
+    part_range(job->len, part, parts, &begin, &end);
+    job->crc[part] = crc32c(0, job->data + begin, end - begin);
+}
+
+/* crc32c(0, data, len), checksummed in parts */
+static uint32_t crc32c_parallel(const void *data, uint64_t len, int parts)
+{
+    CrcJob job;
+    job.data = data;
+    job.len = len;
+    run_parts(crc_part, &job, parts);
+    uint32_t crc = job.crc[0];
+    for (int i = 1; i < parts; i++) {
+        uint64_t begin, end;
+        part_range(len, i, parts, &begin, &end);
+        crc = crc32c_combine(crc, job.crc[i], end - begin);
+    }
+    return crc;
+}
+
+/* Record that child id has a parent. Fails if id is the root or was
+ * already claimed, which rules out cycles and shared subtrees reachable
+ * from the root. id == -1 (no child) always succeeds. With several
+ * threads claiming at once (shared) the check-and-set is atomic.
+ */
+static int claim_child(uint8_t *claimed, int32_t id, int shared)
+{
+    if (id < 0) {
+        return 1;
+    }
+    if (id == 0) {
+        return 0;
+    }
+    if (shared) {
+        return __atomic_exchange_n(&claimed[id], 1, __ATOMIC_RELAXED) == 0;
+    }
+    if (claimed[id]) {
+        return 0;
+    }
+    claimed[id] = 1;
+    return 1;
+}
+
+/* Record that a node carries stable ID id, already checked to be in
+ * [0, nextId). Fails if another record carries it too. seen holds one
+ * bit per ID; with several threads (shared) the bit is set atomically.
+ */
+static int claim_id(uint8_t *seen, int32_t id, int shared)
+{
+    uint8_t bit = (uint8_t)(1u << (id & 7));
+    if (shared) {
+        return (__atomic_fetch_or(&seen[id >> 3], bit, __ATOMIC_RELAXED) & bit) == 0;
+    }
+    if (seen[id >> 3] & bit) {
+        return 0;
+    }
+    seen[id >> 3] |= bit;
+    return 1;
+}
+
+/* Child IDs must be in [-1, count) and each node have one parent */
+static int link_children(Node *nodes, Node *node, int32_t yesId, int32_t noId,
+                         uint64_t count, uint8_t *claimed, int shared)
+{
+    if (yesId < -1 || yesId >= (int64_t)count || noId < -1 || noId >= (int64_t)count ||
+        !claim_child(claimed, yesId, shared) || !claim_child(claimed, noId, shared)) {
+        return 0;  // Invalid child ID (corrupted data?)
+    }
+    node->yes = yesId >= 0 ? &nodes[yesId] : NULL;
+    node->no = noId >= 0 ? &nodes[noId] : NULL;
+    return 1;
+}
+
+/* One VERSION 1 load: the file, where each record starts, and the
+ * node and string blocks the records are built into
+ */
+typedef struct {
+    const char *file;
+    const uint64_t *offsets;  /* of each record */
+    uint64_t count;
+    Node *nodes;
+    char *strings;
+    uint8_t *claimed;
+    int shared;
+    int ok[LOAD_MAX_THREADS];
+} V1Job;
+
+/* Build and link one part's nodes. Record i's text lands in the string
+ * block after the texts (and terminators) of every earlier record,
+ * which works out to offsets[i] minus i * 12 fixed bytes.
+ */
+static void v1_part(void *arg, int part, int parts)
+{
+    V1Job *job = arg;
+    uint64_t begin, end;
+    part_range(job->count, part, parts, &begin, &end);
+    job->ok[part] = 0;
+    for (uint64_t i = begin; i < end; i++) {
+        const char *rec = job->file + job->offsets[i];
+        uint32_t textLen;
+        int32_t yesId, noId;
+        memcpy(&textLen, rec + 1, sizeof(textLen));
+        memcpy(&yesId, rec + 5 + textLen, sizeof(yesId));
+        memcpy(&noId, rec + 9 + textLen, sizeof(noId));
+        
+        char *text = job->strings + (job->offsets[i] - HEADER_BYTES - i * (RECORD_FIXED_BYTES - 1));
+        memcpy(text, rec + 5, textLen);
+        text[textLen] = '\0';  // The file doesn't store terminators
+        
+        Node *node = &job->nodes[i];
+        node->text = text;
+        node->isQuestion = (uint8_t)rec[0];
+        node->isPooled = 1;
+        node->id = (int)i;  // Position in the file
+        if (!link_children(job->nodes, node, yesId, noId, job->count,
+                           job->claimed, job->shared)) {
+            return;
+        }
+    }
+    job->ok[part] = 1;
+}
+
+/* Load the body of a VERSION 1 file into pool: one sequential scan over
+ * the mapped file finds where each variable-length record starts, then
+ * the nodes are built and linked in parallel. Returns the root, or NULL
+ * on any validation failure.
+ */
+static Node *load_v1(FILE *fp, uint32_t count, long fileSize, NodePool *pool,
+                     int *outNextId)
+{
+    // Validate count against the file itself: every record needs at least
+    // RECORD_FIXED_BYTES (texts may be empty: the old UI accepted an empty
+    // line), so a hostile header can't make us allocate more than the
+    // file could describe. IDs are int32.
+    if (count == 0 || count > INT32_MAX ||
+        (uint64_t)count * RECORD_FIXED_BYTES > (uint64_t)(fileSize - HEADER_BYTES)) {
+        return NULL;  // Count doesn't fit in the file (corrupted file?)
     }
     
-    // Step 3: Initialize queue and NodeMapping array
-    Queue q;
-    q_init(&q);
+    void *map = mmap(NULL, (size_t)fileSize, PROT_READ, MAP_PRIVATE, fileno(fp), 0);
+    if (map == MAP_FAILED) {
+        return NULL;
+    }
+    const char *file = map;
+    Node *root = NULL;
+    uint64_t *offsets = malloc((size_t)count * sizeof(uint64_t));
+    uint8_t *claimed = calloc(count, sizeof(uint8_t));
+    if (offsets == NULL || claimed == NULL) {
+        goto v1_done;  // Memory allocation failed
+    }
     
-    // Count nodes to allocate mapping array
-    int nodeCount = count_nodes(g_root);
-    NodeMapping *mappings = malloc(nodeCount * sizeof(NodeMapping));
-    if (mappings == NULL) {
-        fclose(fp);
-        q_free(&q);
-        return 0;  // Failed to allocate memory
+    // Sequential scan: hop from record to record by text length. Every
+    // byte of the file must be accounted for.
+    uint64_t pos = HEADER_BYTES;
+    for (uint32_t i = 0; i < count; i++) {
+        uint32_t textLen;
+        if ((uint64_t)fileSize - pos < RECORD_FIXED_BYTES) {
+            goto v1_done;  // Truncated record
+        }
+        memcpy(&textLen, file + pos + 1, sizeof(textLen));
+        if (textLen > (uint64_t)fileSize - pos - RECORD_FIXED_BYTES) {
+            goto v1_done;  // Invalid text length (corrupted data?)
+        }
+        offsets[i] = pos;
+        pos += RECORD_FIXED_BYTES + textLen;
+    }
+    if (pos != (uint64_t)fileSize) {
+        goto v1_done;  // Trailing garbage or inconsistent lengths
     }
     
-    // Step 4: Use BFS to assign IDs to all nodes
-    int nextId = 0;
+    // The whole tree fits in one node block plus one string block
+    uint64_t textBytes = (uint64_t)fileSize - HEADER_BYTES - (uint64_t)count * RECORD_FIXED_BYTES;
+    if (!arena_reserve(&pool->nodes, (size_t)count * sizeof(Node)) ||
+        !arena_reserve(&pool->strings, (size_t)textBytes + count)) {
+        goto v1_done;  // Memory allocation failed
+    }
     
-    // Enqueue root with id=0
-    q_enqueue(&q, g_root, 0);
-    // Store mapping[0] = {g_root, 0}
-    mappings[0].node = g_root;
-    mappings[0].id = 0;
-    nextId = 1;
-    
-    // BFS traversal to assign IDs to all nodes
-    while (!q_empty(&q)) {
-        Node *currentNode;
-        int currentId;
+    V1Job job;
+    job.file = file;
+    job.offsets = offsets;
+    job.count = count;
+    job.nodes = arena_alloc(&pool->nodes, (size_t)count * sizeof(Node));
+    job.strings = arena_alloc(&pool->strings, (size_t)textBytes + count);
+    job.claimed = claimed;
+    int parts = load_parts(count);
+    job.shared = parts > 1;
+    if (job.nodes == NULL || job.strings == NULL) {
+        goto v1_done;
+    }
+    run_parts(v1_part, &job, parts);
+    for (int i = 0; i < parts; i++) {
+        if (!job.ok[i]) {
+            goto v1_done;
+        }
+    }
+    
+    // Root is always first in BFS order; IDs are file positions
+    root = &job.nodes[0];
+    *outNextId = (int)count;
+    
+v1_done:
+    // Text has been copied into the pool, so the mapping goes; nodes and
+    // strings all live in the pool, which the caller frees on failure
+    munmap(map, (size_t)fileSize);
+    free(offsets);
+    free(claimed);
+    return root;
+}
+
+/* One VERSION 2-4 load: the mapped node table and blob, and the nodes
+ * built over them
+ */
+typedef struct {
+    const char *table;
+    const char *blob;
+    size_t recordSize;
+    int hasIds;
+    uint64_t count;
+    uint64_t nextId;
+    uint64_t stringBytes;
+    Node *nodes;
+    uint8_t *claimed;
+    uint8_t *idSeen;      /* one bit per stable ID; VERSION 3+ only */
+    int shared;
+    int ok[LOAD_MAX_THREADS];
+} V2Job;
+
+/* Validate one part's records and wire them up in place. Children are
+ * addressed by index, so linking needs no second pass.
+ */
+static void v2_part(void *arg, int part, int parts)
+{
+    V2Job *job = arg;
+    uint64_t begin, end;
+    part_range(job->count, part, parts, &begin, &end);
+    job->ok[part] = 0;
+    for (uint64_t i = begin; i < end; i++) {
+        const NodeRecordV2 *rec = (const NodeRecordV2 *)(job->table + i * job->recordSize);
+        int32_t id = job->hasIds ? ((const NodeRecordV3 *)rec)->id : (int32_t)i;
         
-        // Dequeue node and id
-        q_dequeue(&q, &currentNode, &currentId);
+        // Text must be inside the blob and null-terminated (it may be
+        // empty, as in a VERSION 1 file written by the old UI)
+        if (rec->textOffset >= job->stringBytes ||
+            rec->textLen >= job->stringBytes - rec->textOffset ||
+            job->blob[rec->textOffset + rec->textLen] != '\0') {
+            return;
+        }
         
-        // If node has yes child: add to mappings, enqueue with new id
-        if (currentNode->yes != NULL) {
-            mappings[nextId].node = currentNode->yes;
-            mappings[nextId].id = nextId;
-            q_enqueue(&q, currentNode->yes, nextId);
-            nextId++;
+        // Node IDs must lie in [0, nextId) and be unique
+        if (id < 0 || (uint64_t)id >= job->nextId ||
+            (job->hasIds && !claim_id(job->idSeen, id, job->shared))) {
+            return;
         }
         
-        // If node has no child: add to mappings, enqueue with new id
-        if (currentNode->no != NULL) {
-            mappings[nextId].node = currentNode->no;
-            mappings[nextId].id = nextId;
-            q_enqueue(&q, currentNode->no, nextId);
-            nextId++;
+        Node *node = &job->nodes[i];
+        node->text = (char *)(job->blob + rec->textOffset);
+        node->isQuestion = rec->isQuestion;
+        node->isPooled = 1;
+        node->id = id;
+        if (!link_children(job->nodes, node, rec->yesId, rec->noId, job->count,
+                           job->claimed, job->shared)) {
+            return;
         }
     }
+    job->ok[part] = 1;
+}
+
+/* Check the CRC32C trailing a mapped file and drop it from fileSize */
+static int strip_crc(const void *map, long *fileSize, int parts)
+{
+    uint32_t stored;
+    if ((size_t)*fileSize < sizeof(HeaderV2) + sizeof(stored)) {
+        return 0;
+    }
+    *fileSize -= sizeof(stored);
+    memcpy(&stored, (const char *)map + *fileSize, sizeof(stored));
+    return crc32c_parallel(map, (uint64_t)*fileSize, parts) == stored;
+}
+
+/* Map a VERSION 2, 3 or 4 file and build the node table over it. Node
+ * text points directly into the (read-only) mapping; the mapping is
+ * handed to pool so it lives exactly as long as the tree. A VERSION 4
+ * file is checksummed before anything in it is trusted. Checksumming
+ * and building are both split across load threads.
+ */
+static Node *load_v2(FILE *fp, long fileSize, uint32_t version, NodePool *pool,
+                     int *outNextId)
+{
+    // The header and node table must fit before any further checks
+    if ((size_t)fileSize < sizeof(HeaderV2)) {
+        return NULL;
+    }
     
-    // Step 5: Write header (magic, version, nodeCount)
-    uint32_t magic = MAGIC;      // Magic number for file format validation
-    uint32_t version = VERSION;  // Version number for compatibility checking
-    uint32_t count = nodeCount;  // Total number of nodes in tree
+    void *map = mmap(NULL, (size_t)fileSize, PROT_READ, MAP_PRIVATE, fileno(fp), 0);
+    if (map == MAP_FAILED) {
+        return NULL;
+    }
+    pool->map = map;
+    pool->mapLength = (size_t)fileSize;
     
-    // Write header to file
-    if (fwrite(&magic, sizeof(uint32_t), 1, fp) != 1 ||
-        fwrite(&version, sizeof(uint32_t), 1, fp) != 1 ||
-        fwrite(&count, sizeof(uint32_t), 1, fp) != 1) {
-        fclose(fp);
-        free(mappings);
-        q_free(&q);
-        return 0;  // Failed to write header
+    // Validate that header, table and blob exactly cover the file
+    const HeaderV2 *header = map;
+    uint64_t count = header->count;
+    if (count == 0 || count > INT32_MAX) {
+        return NULL;
     }
+    int parts = load_parts(count);
     
-    // Step 6: For each node in mapping order
-    for (int i = 0; i < nodeCount; i++) {
-        Node *node = mappings[i].node;
-        
-        // Write isQuestion (1 byte)
-        uint8_t isQuestion = node->isQuestion;
-        if (fwrite(&isQuestion, sizeof(uint8_t), 1, fp) != 1) {
-            fclose(fp);
-            free(mappings);
-            q_free(&q);
-            return 0;  // Failed to write node type
+    if (version == VERSION_V4 && !strip_crc(map, &fileSize, parts)) {
+        return NULL;  // Torn or corrupted file
+    }
+    
+    // VERSION 2 has no IDs (positions are used); VERSION 3 IDs must all
+    // fall below nextId, which can't be smaller than the node count
+    int hasIds = (version >= VERSION_V3);
+    uint64_t nextId = hasIds ? header->nextId : count;
+    if ((!hasIds && header->nextId != 0) ||
+        nextId < count || nextId > INT32_MAX) {
+        return NULL;
+    }
+    
+    size_t recordSize = hasIds ? sizeof(NodeRecordV3) : sizeof(NodeRecordV2);
+    uint64_t tableBytes = count * recordSize;
+    if (header->stringBytes > (uint64_t)fileSize ||
+        sizeof(HeaderV2) + tableBytes + header->stringBytes != (uint64_t)fileSize) {
+        return NULL;  // Truncated or padded file
+    }
+    
+    // Node structs still come from the arena, but in one block
+    if (!arena_reserve(&pool->nodes, count * sizeof(Node))) {
+        return NULL;
+    }
+    V2Job job;
+    job.table = (const char *)(header + 1);
+    job.blob = job.table + tableBytes;
+    job.recordSize = recordSize;
+    job.hasIds = hasIds;
+    job.count = count;
+    job.nextId = nextId;
+    job.stringBytes = header->stringBytes;
+    job.nodes = arena_alloc(&pool->nodes, count * sizeof(Node));
+    job.claimed = calloc(count, sizeof(uint8_t));
+    job.idSeen = hasIds ? calloc((nextId + 7) / 8, sizeof(uint8_t)) : NULL;
+    job.shared = parts > 1;
+    if (job.nodes == NULL || job.claimed == NULL || (hasIds && job.idSeen == NULL)) {
+        free(job.claimed);
+        free(job.idSeen);
+        return NULL;
+    }
+    
+    run_parts(v2_part, &job, parts);
+    free(job.claimed);
+    free(job.idSeen);
+    for (int i = 0; i < parts; i++) {
+        if (!job.ok[i]) {
+            return NULL;
         }
-        
-        // Write textLen (4 bytes)
-        uint32_t textLen = strlen(node->text);
-        if (fwrite(&textLen, sizeof(uint32_t), 1, fp) != 1) {
-            fclose(fp);
-            free(mappings);
-            q_free(&q);
-            return 0;  // Failed to write text length
+    }
+    *outNextId = (int)nextId;
+    return &job.nodes[0];
+}
+
+/* One VERSION 5 load */
+typedef struct {
+    const NodeRecordV5 *records;
+    const char *blob;
+    const uint64_t *stringOffsets;
+    uint32_t stringCount;
+    uint64_t count;
+    uint64_t nextId;
+    Node *nodes;
+    uint8_t *claimed;
+    uint8_t *idSeen;      /* one bit per stable ID */
+    int shared;
+    int ok[LOAD_MAX_THREADS];
+} V5Job;
+
+static void v5_part(void *arg, int part, int parts)
+{
+    V5Job *job = arg;
+    uint64_t begin, end;
+    part_range(job->count, part, parts, &begin, &end);
+    job->ok[part] = 0;
+    for (uint64_t i = begin; i < end; i++) {
+        const NodeRecordV5 *rec = &job->records[i];
+        uint32_t text = rec->text & ~V5_QUESTION;
+        if (text >= job->stringCount || rec->id < 0 || (uint64_t)rec->id >= job->nextId ||
+            !claim_id(job->idSeen, rec->id, job->shared)) {
+            return;  // Bad text index, or an ID out of range or repeated
         }
-        
-        // Write text (textLen bytes, no null terminator)
-        // Note: We don't write the null terminator to save space
-        if (fwrite(node->text, 1, textLen, fp) != textLen) {
-            fclose(fp);
-            free(mappings);
-            q_free(&q);
-            return 0;  // Failed to write text content
+        Node *node = &job->nodes[i];
+        node->text = (char *)(job->blob + job->stringOffsets[text]);
+        node->isQuestion = (rec->text & V5_QUESTION) != 0;
+        node->isPooled = 1;
+        node->id = rec->id;
+        if (!link_children(job->nodes, node, rec->yesId, rec->noId, job->count,
+                           job->claimed, job->shared)) {
+            return;
         }
-        
-        // Find yes child's id in mappings (or -1 if NULL)
-        int32_t yesId = -1;
-        if (node->yes != NULL) {
-            // Linear search through mappings to find matching node pointer
-            for (int j = 0; j < nodeCount; j++) {
-                if (mappings[j].node == node->yes) {
-                    yesId = mappings[j].id;
-                    break;
-                }
-            }
+    }
+    job->ok[part] = 1;
+}
+
+/* Counts a VERSION 5 or 6 header must satisfy before anything is
+ * sized from them
+ */
+static int v5_header_ok(const HeaderV5 *header)
+{
+    uint64_t count = header->base.count;
+    uint64_t strings = header->stringCount;
+    uint64_t nextId = header->base.nextId;
+    return count > 0 && count <= INT32_MAX && strings > 0 && strings <= count &&
+           nextId >= count && nextId <= INT32_MAX;
+}
+
+/* Build the node table over a VERSION 5 image (header and body, CRC
+ * already checked and dropped) that pool->map holds. Nodes sharing a
+ * text point at its one copy in the image, and the string table seeds
+ * the pool's intern table.
+ */
+static Node *build_v5(const char *image, uint64_t size, NodePool *pool, int parts,
+                      int *outNextId)
+{
+    const HeaderV5 *header = (const HeaderV5 *)image;
+    uint64_t count = header->base.count;
+    uint64_t strings = header->stringCount;
+    uint64_t nextId = header->base.nextId;
+    
+    // String table, node table and blob must exactly cover the image
+    uint64_t stringBytes = header->base.stringBytes;
+    uint64_t tableBytes = strings * sizeof(uint64_t) + count * sizeof(NodeRecordV5);
+    if (stringBytes == 0 || stringBytes > size ||
+        sizeof(HeaderV5) + tableBytes + stringBytes != size) {
+        return NULL;
+    }
+    const uint64_t *offsets = (const uint64_t *)(header + 1);
+    const char *blob = image + sizeof(HeaderV5) + tableBytes;
+    
+    // A null last byte ends every text inside the blob; each must start
+    // inside it (empty texts are allowed, as in load_v1)
+    if (blob[stringBytes - 1] != '\0') {
+        return NULL;
+    }
+    for (uint64_t k = 0; k < strings; k++) {
+        if (offsets[k] >= stringBytes) {
+            return NULL;
         }
-        
-        // Find no child's id in mappings (or -1 if NULL)
-        int32_t noId = -1;
-        if (node->no != NULL) {
-            // Linear search through mappings to find matching node pointer
-            for (int j = 0; j < nodeCount; j++) {
-                if (mappings[j].node == node->no) {
-                    noId = mappings[j].id;
-                    break;
-                }
-            }
+    }
+    
+    if (!arena_reserve(&pool->nodes, count * sizeof(Node))) {
+        return NULL;
+    }
+    V5Job job;
+    job.records = (const NodeRecordV5 *)(offsets + strings);
+    job.blob = blob;
+    job.stringOffsets = offsets;
+    job.stringCount = (uint32_t)strings;
+    job.count = count;
+    job.nextId = nextId;
+    job.nodes = arena_alloc(&pool->nodes, count * sizeof(Node));
+    job.claimed = calloc(count, sizeof(uint8_t));
+    job.idSeen = calloc((nextId + 7) / 8, sizeof(uint8_t));
+    job.shared = parts > 1;
+    if (job.nodes == NULL || job.claimed == NULL || job.idSeen == NULL) {
+        free(job.claimed);
+        free(job.idSeen);
+        return NULL;
+    }
+    run_parts(v5_part, &job, parts);
+    free(job.claimed);
+    free(job.idSeen);
+    for (int i = 0; i < parts; i++) {
+        if (!job.ok[i]) {
+            return NULL;
         }
-        
-        // Write yesId, noId to maintain tree structure
-        if (fwrite(&yesId, sizeof(int32_t), 1, fp) != 1 ||
-            fwrite(&noId, sizeof(int32_t), 1, fp) != 1) {
-            fclose(fp);
-            free(mappings);
-            q_free(&q);
-            return 0;  // Failed to write child IDs
+    }
+    
+    pool->seedBlob = blob;
+    pool->seedOffsets = offsets;
+    pool->seedCount = (uint32_t)strings;
+    *outNextId = (int)nextId;
+    return &job.nodes[0];
+}
+
+/* Map a VERSION 5 file and build the node table straight over it */
+static Node *load_v5(FILE *fp, long fileSize, NodePool *pool, int *outNextId)
+{
+    if ((size_t)fileSize < sizeof(HeaderV5)) {
+        return NULL;
+    }
+    void *map = mmap(NULL, (size_t)fileSize, PROT_READ, MAP_PRIVATE, fileno(fp), 0);
+    if (map == MAP_FAILED) {
+        return NULL;
+    }
+    pool->map = map;
+    pool->mapLength = (size_t)fileSize;
+    
+    if (!v5_header_ok(map)) {
+        return NULL;
+    }
+    int parts = load_parts(((const HeaderV5 *)map)->base.count);
+    if (!strip_crc(map, &fileSize, parts)) {
+        return NULL;  // Torn or corrupted file
+    }
+    return build_v5(map, (uint64_t)fileSize, pool, parts, outNextId);
+}
+
+/* One VERSION 6 decompression */
+typedef struct {
+    const unsigned char *packed;  /* first compressed block */
+    const uint64_t *starts;       /* offset of each block in packed, then the end */
+    unsigned char *raw;           /* the VERSION 5 body being rebuilt */
+    uint64_t rawBytes;
+    uint32_t blockBytes;
+    uint32_t blockCount;
+    int ok[LOAD_MAX_THREADS];
+} V6Job;
+
+static void v6_part(void *arg, int part, int parts)
+{
+    V6Job *job = arg;
+    uint64_t begin, end;
+    part_range(job->blockCount, part, parts, &begin, &end);
+    job->ok[part] = 0;
+    for (uint64_t b = begin; b < end; b++) {
+        uint64_t rawAt = b * job->blockBytes;
+        uint64_t rawLen = job->rawBytes - rawAt < job->blockBytes ?
+                          job->rawBytes - rawAt : job->blockBytes;
+        const unsigned char *src = job->packed + job->starts[b];
+        uint64_t packedLen = job->starts[b + 1] - job->starts[b];
+        if (packedLen == rawLen) {
+            memcpy(job->raw + rawAt, src, rawLen);  // Stored block
+        } else if (lz_decompress(src, packedLen, job->raw + rawAt, rawLen) != (long)rawLen) {
+            return;
+        }
+    }
+    job->ok[part] = 1;
+}
+
+/* Map a VERSION 6 file, decompress its blocks in parallel into an
+ * anonymous mapping laid out as a VERSION 5 file, and build the node
+ * table over that. The pool keeps the decompressed image as its map.
+ */
+static Node *load_v6(FILE *fp, long fileSize, NodePool *pool, int *outNextId)
+{
+    if ((size_t)fileSize < sizeof(HeaderV6)) {
+        return NULL;
+    }
+    void *map = mmap(NULL, (size_t)fileSize, PROT_READ, MAP_PRIVATE, fileno(fp), 0);
+    if (map == MAP_FAILED) {
+        return NULL;
+    }
+    pool->map = map;
+    pool->mapLength = (size_t)fileSize;
+    
+    const HeaderV6 *header = map;
+    if (!v5_header_ok(&header->v5)) {
+        return NULL;
+    }
+    uint64_t count = header->v5.base.count;
+    int parts = load_parts(count);
+    if (!strip_crc(map, &fileSize, parts)) {
+        return NULL;  // Torn or corrupted file
+    }
+    
+    // The blocks must rebuild exactly the body the header describes, and
+    // no packed byte can expand past V6_MAX_RATIO, which bounds the
+    // allocation by the file size
+    uint64_t stringBytes = header->v5.base.stringBytes;
+    uint64_t blockBytes = header->blockBytes;
+    uint64_t blockCount = header->blockCount;
+    if (stringBytes / V6_MAX_RATIO > (uint64_t)fileSize ||
+        blockBytes == 0 || blockBytes > V6_MAX_BLOCK) {
+        return NULL;
+    }
+    uint64_t rawBytes = header->v5.stringCount * sizeof(uint64_t) +
+                        count * sizeof(NodeRecordV5) + stringBytes;
+    uint64_t indexBytes = blockCount * sizeof(uint32_t);
+    if (blockCount != (rawBytes + blockBytes - 1) / blockBytes ||
+        sizeof(HeaderV6) + indexBytes > (uint64_t)fileSize) {
+        return NULL;
+    }
+    uint64_t packedBytes = (uint64_t)fileSize - sizeof(HeaderV6) - indexBytes;
+    if (rawBytes / V6_MAX_RATIO > packedBytes) {
+        return NULL;
+    }
+    
+    // Block sizes (unaligned after the blocks) become start offsets
+    uint64_t *starts = malloc((blockCount + 1) * sizeof(uint64_t));
+    if (starts == NULL) {
+        return NULL;
+    }
+    const char *index = (const char *)map + sizeof(HeaderV6) + packedBytes;
+    starts[0] = 0;
+    for (uint64_t b = 0; b < blockCount; b++) {
+        uint32_t packed;
+        memcpy(&packed, index + b * sizeof(uint32_t), sizeof(packed));
+        uint64_t rawLen = rawBytes - b * blockBytes < blockBytes ?
+                          rawBytes - b * blockBytes : blockBytes;
+        if (packed == 0 || packed > rawLen) {
+            free(starts);
+            return NULL;
         }
+        starts[b + 1] = starts[b] + packed;
+    }
+    if (starts[blockCount] != packedBytes) {
+        free(starts);
+        return NULL;
     }
     
-    // Step 7: Clean up and return 1 on success
-    fclose(fp);
-    free(mappings);
-    q_free(&q);
+    size_t imageLength = sizeof(HeaderV5) + rawBytes;
+    char *image = mmap(NULL, imageLength, PROT_READ | PROT_WRITE,
+                       MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (image == MAP_FAILED) {
+        free(starts);
+        return NULL;
+    }
+    HeaderV5 *imageHeader = (HeaderV5 *)image;
+    *imageHeader = header->v5;
+    imageHeader->base.version = VERSION_V5;
     
-    return 1;  // Successfully saved tree
+    V6Job job;
+    job.packed = (const unsigned char *)map + sizeof(HeaderV6);
+    job.starts = starts;
+    job.raw = (unsigned char *)image + sizeof(HeaderV5);
+    job.rawBytes = rawBytes;
+    job.blockBytes = (uint32_t)blockBytes;
+    job.blockCount = (uint32_t)blockCount;
+    int blockParts = (uint64_t)parts > blockCount ? (int)blockCount : parts;
+    run_parts(v6_part, &job, blockParts);
+    free(starts);
+    
+    // The compressed file is done with; the pool owns the image instead
+    munmap(map, pool->mapLength);
+    mprotect(image, imageLength, PROT_READ);
+    pool->map = image;
+    pool->mapLength = imageLength;
+    for (int i = 0; i < blockParts; i++) {
+        if (!job.ok[i]) {
+            return NULL;
+        }
+    }
+    return build_v5(image, rawBytes + sizeof(HeaderV5), pool, parts, outNextId);
 }
 
 /* TODO 28: Implement load_tree
@@ -199,30 +1507,24 @@ int save_tree(const char *filename)
  * 
  * Steps:
  * 1. Open file for reading binary ("rb")
- * 2. Read and validate header (magic, version, count)
- * 3. Allocate arrays for nodes and child IDs:
- *    - Node **nodes = calloc(count, sizeof(Node*))
- *    - int32_t *yesIds = calloc(count, sizeof(int32_t))
- *    - int32_t *noIds = calloc(count, sizeof(int32_t))
- * 4. Read each node:
- *    - Read isQuestion, textLen
- *    - Validate textLen (e.g., < 10000)
- *    - Allocate and read text string (add null terminator!)
- *    - Read yesId, noId
- *    - Validate IDs are in range [-1, count)
- *    - Create Node and store in nodes[i]
- * 5. Link nodes using stored IDs:
- *    - For each node i:
- *      - If yesIds[i] >= 0: nodes[i]->yes = nodes[yesIds[i]]
- *      - If noIds[i] >= 0: nodes[i]->no = nodes[noIds[i]]
- * 6. Free old g_root if not NULL
- * 7. Set g_root = nodes[0]
- * 8. Clean up temporary arrays
- * 9. Return 1 on success
- * 
- * Error handling:
- * - If any read fails or validation fails, goto load_error
- * - In load_error: free all allocated memory and return 0
+ * 2. Read and validate magic and version, and find the file size
+ * 3. Build the tree into a fresh NodePool:
+ *    - VERSION 1 (load_v1): scan the record offsets, then copy text
+ *      into the pool's string arena and link children by ID
+ *    - VERSION 2/3/4 (load_v2): mmap the file, verify the VERSION 4
+ *      checksum and point nodes at the mapped strings (zero-copy)
+ *    - VERSION 5 (load_v5): the same, with nodes sharing each distinct
+ *      string; its string table seeds the pool's intern table
+ *    - VERSION 6 (load_v6): decompress the blocks into a VERSION 5 image
+ *      and load that as load_v5 does
+ *    Files before VERSION 3 don't store IDs, so nodes get their position
+ * 4. On failure free the new pool and return 0; the current tree is
+ *    left untouched
+ * 5. Release the old tree (tree_release), adopt the new pool as g_pool
+ *    and continue ID numbering from the file's next free ID
+ * 6. Set g_root to the loaded root, rebuild g_index and g_stats
+ * 7. Replay "<filename>.journal" if there is one (journal.c) and
+ *    return 1
  */
 int load_tree(const char *filename) {
     // Step 1: Open file for reading binary ("rb")
@@ -231,151 +1533,63 @@ int load_tree(const char *filename) {
         return 0;  // File doesn't exist or can't be opened
     }
     
-    // Variables for cleanup in case of error
-    Node **nodes = NULL;
-    int32_t *yesIds = NULL;
-    int32_t *noIds = NULL;
+    NodePool pool;
+    pool_init(&pool);
+    Node *root = NULL;
+    int nextId = 0;
     
-    // Step 2: Read and validate header (magic, version, count)
+    // Step 2: Read and validate header (magic, version)
     uint32_t magic, version, count;
-    
-    // Read header from file
     if (fread(&magic, sizeof(uint32_t), 1, fp) != 1 ||
         fread(&version, sizeof(uint32_t), 1, fp) != 1 ||
-        fread(&count, sizeof(uint32_t), 1, fp) != 1) {
-        goto load_error;  // Failed to read header
-    }
-    
-    // Validate magic number and version for file format compatibility
-    if (magic != MAGIC || version != VERSION) {
-        goto load_error;  // Invalid file format or incompatible version
-    }
-    
-    // Validate count is reasonable (sanity check)
-    if (count == 0 || count > 100000) {
-        goto load_error;  // Unreasonable node count (corrupted file?)
+        fread(&count, sizeof(uint32_t), 1, fp) != 1 ||
+        magic != MAGIC) {
+        fclose(fp);
+        return 0;  // Short file or invalid format
     }
     
-    // Step 3: Allocate arrays for nodes and child IDs
-    // Use calloc to initialize all pointers to NULL
-    nodes = calloc(count, sizeof(Node*));
-    yesIds = calloc(count, sizeof(int32_t));
-    noIds = calloc(count, sizeof(int32_t));
-    
-    if (nodes == NULL || yesIds == NULL || noIds == NULL) {
-        goto load_error;  // Memory allocation failed
+    struct stat st;
+    if (fstat(fileno(fp), &st) != 0) {
+        fclose(fp);
+        return 0;  // Can't determine file size
     }
+    long fileSize = (long)st.st_size;
     
-    // Step 4: Read each node from file
-    for (uint32_t i = 0; i < count; i++) {
-        uint8_t isQuestion;
-        uint32_t textLen;
-        
-        // Read isQuestion flag and text length
-        if (fread(&isQuestion, sizeof(uint8_t), 1, fp) != 1 ||
-            fread(&textLen, sizeof(uint32_t), 1, fp) != 1) {
-            goto load_error;  // Failed to read node metadata
-        }
-        
-        // Validate textLen to prevent excessive memory allocation
-        if (textLen == 0 || textLen >= 10000) {
-            goto load_error;  // Invalid text length (corrupted data?)
-        }
-        
-        // Allocate and read text string (add null terminator!)
-        char *text = malloc(textLen + 1);  // +1 for null terminator
-        if (text == NULL) {
-            goto load_error;  // Memory allocation failed
-        }
-        
-        // Read text content from file
-        if (fread(text, 1, textLen, fp) != textLen) {
-            free(text);
-            goto load_error;  // Failed to read text
-        }
-        text[textLen] = '\0';  // CRITICAL: Add null terminator since file doesn't store it
-        
-        // Read child node IDs
-        if (fread(&yesIds[i], sizeof(int32_t), 1, fp) != 1 ||
-            fread(&noIds[i], sizeof(int32_t), 1, fp) != 1) {
-            free(text);
-            goto load_error;  // Failed to read child IDs
-        }
-        
-        // Validate IDs are in valid range [-1, count)
-        if (yesIds[i] < -1 || yesIds[i] >= (int32_t)count ||
-            noIds[i] < -1 || noIds[i] >= (int32_t)count) {
-            free(text);
-            goto load_error;  // Invalid child ID (corrupted data?)
-        }
-        
-        // Create Node and store in nodes array
-        Node *newNode = malloc(sizeof(Node));
-        if (newNode == NULL) {
-            free(text);
-            goto load_error;  // Memory allocation failed
-        }
-        
-        // Initialize node with read data
-        newNode->text = text;
-        newNode->isQuestion = isQuestion;
-        newNode->yes = NULL;  // Will link in next phase
-        newNode->no = NULL;   // Will link in next phase
-        
-        nodes[i] = newNode;
+    // Step 3: Build the tree for this version
+    if (version == VERSION_V1) {
+        root = load_v1(fp, count, fileSize, &pool, &nextId);
+    } else if (version >= VERSION_V2 && version <= VERSION_V4) {
+        root = load_v2(fp, fileSize, version, &pool, &nextId);
+    } else if (version == VERSION_V5) {
+        root = load_v5(fp, fileSize, &pool, &nextId);
+    } else if (version == VERSION_V6) {
+        root = load_v6(fp, fileSize, &pool, &nextId);
     }
     
-    // Step 5: Link nodes using stored IDs (second pass)
-    for (uint32_t i = 0; i < count; i++) {
-        // Link yes child if ID is valid (>= 0)
-        if (yesIds[i] >= 0) {
-            nodes[i]->yes = nodes[yesIds[i]];
-        }
-        
-        // Link no child if ID is valid (>= 0)
-        if (noIds[i] >= 0) {
-            nodes[i]->no = nodes[noIds[i]];
-        }
+    // A journal names the file it extends by size, CRC and next ID
+    TreeFileId id;
+    if (root != NULL && !tree_file_id(fileno(fp), version >= VERSION_V4, nextId, &id)) {
+        root = NULL;
     }
+    fclose(fp);  // A mapping stays valid after its file is closed
     
-    // Step 6: Free old g_root if not NULL
-    if (g_root != NULL) {
-        free_tree(g_root);  // Clean up existing tree before replacing
+    // Step 4: Leave the current tree alone if anything went wrong
+    if (root == NULL) {
+        pool_free(&pool);
+        return 0;  // Failed to load tree
     }
     
-    // Step 7: Set g_root = nodes[0] (root is always first in BFS order)
-    g_root = nodes[0];
+    // Step 5: Release the old tree and hand the new pool to the tree
+    tree_release();
+    g_pool = pool;
+    g_nextId = nextId;
     
-    // Step 8: Clean up temporary arrays (no longer needed)
-    free(nodes);
-    free(yesIds);
-    free(noIds);
-    fclose(fp);
+    // Step 6: Set g_root to the loaded root and index its questions
+    g_root = root;
+    index_rebuild();
+    stats_rebuild();
     
-    // Step 9: Return 1 on success
+    // Step 7: Apply edits journaled since the file was written
+    journal_replay(filename, &id);
     return 1;
-    
-load_error:
-    // Error handling: free all allocated memory and return 0
-    if (nodes != NULL) {
-        // Free all allocated nodes and their text
-        for (uint32_t i = 0; i < count; i++) {
-            if (nodes[i] != NULL) {
-                if (nodes[i]->text != NULL) {
-                    free(nodes[i]->text);
-                }
-                free(nodes[i]);
-            }
-        }
-        free(nodes);
-    }
-    // Free ID arrays if allocated
-    if (yesIds != NULL) {
-        free(yesIds);
-    }
-    if (noIds != NULL) {
-        free(noIds);
-    }
-    fclose(fp);
-    return 0;  // Failed to load tree
-}
\ No newline at end of file
+}
@@ -0,0 +1,795 @@
+/*
+ * server.c - 20 Questions over a socket
+ *
+ * Usage: ./animal_server [-u socket path | -p port] [-f tree file] [-t threads]
+ *   -u  listen on a Unix-domain socket (default: animal.sock)
+ *   -p  listen on 127.0.0.1:port instead
+ *   -f  tree to load (the starting tree if it doesn't exist yet); learns
+ *       are journaled to <tree file>.journal, fsync'd once per pass of
+ *       the event loop, and folded into the tree file on SIGINT/SIGTERM.
+ *       A LEARNED reply is only sent once that fsync has succeeded.
+ *   -t  reader mode: serve games from this many worker threads
+ *
+ * By default one thread, one epoll loop, any number of players. Each
+ * connection is a fixed-size Conn: its GameSession (current node and
+ * parent/answer, the same state play_game keeps) plus line buffers, so
+ * 10K idle sessions cost 10K Conns and nothing else.
+ *
+ * In reader mode the main thread only accepts and learns. Connections
+ * are dealt round-robin to worker threads, each with its own epoll loop,
+ * which play NEW and ANSWER on the current snapshot (snapshot.c) with
+ * flat_walk and never touch g_root. A LEARN is queued to the main
+ * thread, which applies the pass's learns to g_root, journal_syncs them,
+ * publishes a new snapshot and only then hands the replies back, so a
+ * player's next NEW already sees what they taught.
+ *
+ * Protocol: one command per line, one reply line each.
+ *   NEW                              -> ASK <question> | GUESS <animal>
+ *   ANSWER y|n                       -> ASK <question> | GUESS <animal> |
+ *                                       WON | LOST
+ *   LEARN <animal>\t<question>\ty|n  -> LEARNED   (after LOST)
+ *   QUIT                             -> connection closed
+ * Anything out of turn gets ERR <reason>. A session's learn follows its
+ * leaf even if other sessions split it in the meantime (game_learn).
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <signal.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/epoll.h>
+#include <sys/resource.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+#include "lab5.h"
+
+#define CONN_LINE_MAX 512
+#define MAX_EVENTS 256
+#define MAX_WORKERS 64
+#define JOURNAL_SYNC_EVERY 4096            /* journal_sync runs every loop pass anyway */
+#define JOURNAL_COMPACT_BYTES (64L << 20)  /* rewrite the tree file past 64 MB of journal */
+
+struct Worker;
+
+typedef struct Conn {
+    int fd;
+    int epoll;              /* g_epoll, or its worker's */
+    GameSession game;
+    int held;               /* reply waits for journal_sync (on g_held) */
+    struct Conn *nextHeld;
+    /* Reader mode: the game is played on snapshots */
+    struct Worker *worker;
+    int closing;            /* hung up while its learn was queued */
+    unsigned char *path;    /* answers so far */
+    int pathLen;
+    int pathCap;
+    uint64_t version;       /* snapshot at was found in */
+    int at;                 /* flat index of the current node there */
+    int leafId;             /* ID of the animal guessed */
+    int inLen;
+    int outLen;   /* bytes of out not yet written */
+    int outSent;  /* bytes of out already written */
+    char in[CONN_LINE_MAX];
+    char out[CONN_LINE_MAX + 16];
+} Conn;
+
+/* A learn handed from a worker to the main thread and back */
+typedef struct LearnRequest {
+    Conn *conn;
+    int answer;
+    int learned;  /* set by the main thread */
+    struct LearnRequest *next;
+    char text[];  /* animal, then question, null-terminated */
+} LearnRequest;
+
+typedef struct Worker {
+    int index;           /* reader slot in g_store */
+    int epoll;
+    int wake[2];         /* pipe: done has replies, or g_workersStop */
+    pthread_t thread;
+    pthread_mutex_t lock;
+    LearnRequest *done;  /* applied learns to reply to, under lock */
+} Worker;
+
+static volatile sig_atomic_t g_stop = 0;
+static int g_epoll = -1;
+static long g_sessions = 0;  /* open connections */
+static Conn *g_held = NULL;  /* connections that learned this pass */
+
+/* Reader mode */
+static SnapshotStore g_store;
+static Worker *g_workers = NULL;
+static int g_workerCount = 0;
+static int g_nextWorker = 0;
+static int g_workersStop = 0;              /* atomic; set by workers_stop */
+static pthread_mutex_t g_learnLock = PTHREAD_MUTEX_INITIALIZER;
+static LearnRequest *g_learnQueue = NULL;  /* newest first, under g_learnLock */
+static LearnRequest *g_applied = NULL;     /* applied this pass, newest first */
+static int g_appliedLearned = 0;           /* of which made a split */
+static int g_learnWake[2] = {-1, -1};      /* pipe: g_learnQueue has requests */
+
+static void on_signal(int sig) {
+    (void)sig;
+    g_stop = 1;
+}
+
+static int set_nonblocking(int fd) {
+    int flags = fcntl(fd, F_GETFL, 0);
+    return flags < 0 ? -1 : fcntl(fd, F_SETFL, flags | O_NONBLOCK);
+}
+
+static void wake(int fd) {
+    char byte = 1;
+    if (write(fd, &byte, 1) < 0) {
+        // EAGAIN: the pipe is full, so a wakeup is pending anyway
+    }
+}
+
+static void drain(int fd) {
+    char buf[64];
+    while (read(fd, buf, sizeof(buf)) > 0) {
+    }
+}
+
+/* The tree main.c starts with */
+static void starting_tree() {
+    tree_release();
+    pool_init(&g_pool);
+    g_root = pool_node(&g_pool, "Does it live in water?", 1);
+    g_root->yes = pool_node(&g_pool, "Fish", 0);
+    g_root->no = pool_node(&g_pool, "Dog", 0);
+    g_root->id = g_nextId++;
+    g_root->yes->id = g_nextId++;
+    g_root->no->id = g_nextId++;
+    index_rebuild();
+    stats_rebuild();
+}
+
+static void conn_close(Conn *c) {
+    if (c->held && c->worker == NULL) {
+        Conn **link = &g_held;
+        while (*link != c) {
+            link = &(*link)->nextHeld;
+        }
+        *link = c->nextHeld;
+    }
+    epoll_ctl(c->epoll, EPOLL_CTL_DEL, c->fd, NULL);
+    close(c->fd);
+    free(c->path);
+    free(c);
+    __atomic_sub_fetch(&g_sessions, 1, __ATOMIC_RELAXED);
+}
+
+/* Queue one reply line (truncated to fit) */
+static void conn_reply(Conn *c, const char *verb, const char *text) {
+    int room = (int)sizeof(c->out) - c->outSent - c->outLen;
+    int n = text != NULL
+        ? snprintf(c->out + c->outSent + c->outLen, room, "%s %s\n", verb, text)
+        : snprintf(c->out + c->outSent + c->outLen, room, "%s\n", verb);
+    if (n >= room) {
+        n = room - 1;
+        c->out[c->outSent + c->outLen + n - 1] = '\n';
+    }
+    c->outLen += n;
+}
+
+/* Reply with the game's state; text is the current node's */
+static void conn_reply_state(Conn *c, const char *text) {
+    switch (c->game.state) {
+        case GAME_QUESTION: conn_reply(c, "ASK", text); break;
+        case GAME_GUESS: conn_reply(c, "GUESS", text); break;
+        case GAME_WON: conn_reply(c, "WON", NULL); break;
+        case GAME_LOST: conn_reply(c, "LOST", NULL); break;
+        case GAME_OVER: conn_reply(c, "OVER", NULL); break;
+    }
+}
+
+/* Reader mode: start c's game (answer -1) or answer on the current
+ * snapshot, and queue the reply. The session keeps its answers and the
+ * flat index they reached; if a learn has published a new snapshot
+ * since, the answers are walked again from its root. That only differs
+ * where a guessed leaf has been split: the player is asked the new
+ * question instead.
+ * Returns 0 if there is no tree or nothing is being asked.
+ */
+static int reader_play(Conn *c, int answer) {
+    const Snapshot *snap = snap_enter(&g_store, c->worker->index);
+    const FlatTree *ft = &snap->tree;
+    int ok = 1;
+    if (ft->count == 0) {
+        ok = 0;
+    } else if (answer < 0) {
+        c->pathLen = 0;
+        c->at = 0;
+        c->version = snap->version;
+        c->game.state = FLAT_IS_QUESTION(ft, 0) ? GAME_QUESTION : GAME_GUESS;
+    } else if (c->game.state == GAME_QUESTION) {
+        if (c->pathLen == c->pathCap) {
+            int cap = c->pathCap ? c->pathCap * 2 : 64;
+            unsigned char *grown = realloc(c->path, cap);
+            if (grown == NULL) {
+                snap_exit(&g_store, c->worker->index);
+                return 0;
+            }
+            c->path = grown;
+            c->pathCap = cap;
+        }
+        c->path[c->pathLen++] = (unsigned char)answer;
+        int next = c->version == snap->version ? FLAT_CHILD(ft, c->at, answer)
+                 : flat_walk(ft, c->path, c->pathLen);
+        if (next < 0) {
+            c->game.state = GAME_OVER;  // Malformed question; nowhere to go
+        } else {
+            c->at = next;
+            c->version = snap->version;
+            c->game.state = FLAT_IS_QUESTION(ft, next) ? GAME_QUESTION : GAME_GUESS;
+        }
+    } else if (c->game.state == GAME_GUESS) {
+        c->game.state = answer ? GAME_WON : GAME_LOST;
+    } else {
+        ok = 0;
+    }
+    if (ok) {
+        if (c->game.state == GAME_GUESS) {
+            c->leafId = ft->ids[c->at];
+        }
+        conn_reply_state(c, ft->strings + ft->textOffset[c->at]);  // Copied
+    }
+    snap_exit(&g_store, c->worker->index);
+    return ok;
+}
+
+/* Reader mode: hand a learn to the main thread. c is held until the
+ * reply comes back (worker_release), and its path isn't touched.
+ * Returns 0 on allocation failure.
+ */
+static int reader_learn(Conn *c, const char *animal, const char *question, int answer) {
+    size_t animalBytes = strlen(animal) + 1;
+    size_t questionBytes = strlen(question) + 1;
+    LearnRequest *r = malloc(sizeof(LearnRequest) + animalBytes + questionBytes);
+    if (r == NULL) {
+        return 0;
+    }
+    r->conn = c;
+    r->answer = answer;
+    r->learned = 0;
+    memcpy(r->text, animal, animalBytes);
+    memcpy(r->text + animalBytes, question, questionBytes);
+    c->held = 1;
+    pthread_mutex_lock(&g_learnLock);
+    r->next = g_learnQueue;
+    g_learnQueue = r;
+    pthread_mutex_unlock(&g_learnLock);
+    wake(g_learnWake[1]);
+    return 1;
+}
+
+/* Handle one command line (without its newline).
+ * Returns 0 if the connection should be closed.
+ */
+static int conn_command(Conn *c, char *line) {
+    if (strcmp(line, "NEW") == 0) {
+        if (c->worker != NULL ? reader_play(c, -1) : game_start(&c->game)) {
+            if (c->worker == NULL) {
+                conn_reply_state(c, game_text(&c->game));
+            }
+        } else {
+            conn_reply(c, "ERR", "no tree");
+        }
+    } else if (strncmp(line, "ANSWER ", 7) == 0) {
+        char a = line[7] | 0x20;  // ASCII lowercase
+        if ((a != 'y' && a != 'n') || line[8] != '\0') {
+            conn_reply(c, "ERR", "answer y or n");
+        } else if (c->worker != NULL) {
+            if (!reader_play(c, a == 'y')) {
+                conn_reply(c, "ERR", "nothing asked");
+            }
+        } else if (!game_answer(&c->game, a == 'y')) {
+            conn_reply(c, "ERR", "nothing asked");
+        } else {
+            conn_reply_state(c, game_text(&c->game));
+        }
+    } else if (strncmp(line, "LEARN ", 6) == 0) {
+        char *animal = line + 6;
+        char *question = strchr(animal, '\t');
+        char *answer = question != NULL ? strchr(question + 1, '\t') : NULL;
+        if (answer == NULL) {
+            conn_reply(c, "ERR", "LEARN animal<TAB>question<TAB>y|n");
+            return 1;
+        }
+        *question++ = '\0';
+        *answer++ = '\0';
+        if (c->worker != NULL) {
+            // The reply comes from worker_release once the learn is synced
+            if (c->game.state != GAME_LOST ||
+                !reader_learn(c, animal, question, (*answer | 0x20) == 'y')) {
+                conn_reply(c, "ERR", "cannot learn now");
+            }
+        } else if (game_learn(&c->game, animal, question, (*answer | 0x20) == 'y')) {
+            // Only durable learns are acknowledged: the reply is sent
+            // after this pass's journal_sync (release_held)
+            conn_reply(c, "LEARNED", NULL);
+            c->held = 1;
+            c->nextHeld = g_held;
+            g_held = c;
+        } else {
+            conn_reply(c, "ERR", "cannot learn now");
+        }
+    } else if (strcmp(line, "QUIT") == 0) {
+        return 0;
+    } else {
+        conn_reply(c, "ERR", "unknown command");
+    }
+    return 1;
+}
+
+/* Write out what is queued. Returns 1 when it's all written, 0 if the
+ * socket is full, -1 on error.
+ */
+static int conn_flush(Conn *c) {
+    while (c->outLen > 0) {
+        ssize_t n = send(c->fd, c->out + c->outSent, c->outLen, MSG_NOSIGNAL);
+        if (n < 0) {
+            return errno == EAGAIN || errno == EWOULDBLOCK ? 0 : -1;
+        }
+        c->outSent += n;
+        c->outLen -= n;
+    }
+    c->outSent = 0;
+    return 1;
+}
+
+/* Run every complete buffered line, stopping early while a reply is
+ * waiting for the socket (the client isn't reading) or for the journal.
+ * Returns 0 if the connection should be closed.
+ */
+static int conn_process(Conn *c) {
+    if (c->held) {
+        return 1;  // Lines wait behind the held reply
+    }
+    int start = 0;
+    for (;;) {
+        char *nl = memchr(c->in + start, '\n', c->inLen - start);
+        if (nl == NULL) {
+            break;
+        }
+        *nl = '\0';
+        if (nl > c->in + start && nl[-1] == '\r') {
+            nl[-1] = '\0';
+        }
+        int keep = conn_command(c, c->in + start);
+        start = (int)(nl - c->in) + 1;
+        if (keep && c->held) {
+            break;
+        }
+        int flushed = keep ? conn_flush(c) : -1;
+        if (flushed < 0) {
+            return 0;
+        }
+        if (flushed == 0) {
+            struct epoll_event ev = {EPOLLOUT, {.ptr = c}};
+            epoll_ctl(c->epoll, EPOLL_CTL_MOD, c->fd, &ev);
+            break;
+        }
+    }
+    memmove(c->in, c->in + start, c->inLen - start);
+    c->inLen -= start;
+
+    if (c->inLen == CONN_LINE_MAX && c->outLen == 0) {
+        c->inLen = 0;  // No newline in a full buffer: drop it
+        conn_reply(c, "ERR", "line too long");
+        return conn_flush(c) >= 0;
+    }
+    return 1;
+}
+
+static void on_readable(Conn *c) {
+    ssize_t n = recv(c->fd, c->in + c->inLen, CONN_LINE_MAX - c->inLen, 0);
+    if (n == 0 || (n < 0 && errno != EAGAIN && errno != EWOULDBLOCK)) {
+        if (c->held && c->worker != NULL) {
+            // The main thread has its learn: close once it comes back
+            c->closing = 1;
+            epoll_ctl(c->epoll, EPOLL_CTL_DEL, c->fd, NULL);
+        } else {
+            conn_close(c);
+        }
+        return;
+    }
+    if (n > 0) {
+        c->inLen += n;
+        if (!conn_process(c)) {
+            conn_close(c);
+        }
+    }
+}
+
+static void on_writable(Conn *c) {
+    int flushed = conn_flush(c);
+    if (flushed < 0) {
+        conn_close(c);
+        return;
+    }
+    if (flushed > 0) {
+        struct epoll_event ev = {EPOLLIN, {.ptr = c}};
+        epoll_ctl(c->epoll, EPOLL_CTL_MOD, c->fd, &ev);
+        if (!conn_process(c)) {  // Lines that waited behind the reply
+            conn_close(c);
+        }
+    }
+}
+
+/* Send a held reply, then run the lines that waited behind it */
+static void conn_release(Conn *c) {
+    c->held = 0;
+    int flushed = conn_flush(c);
+    if (flushed < 0 || (flushed > 0 && !conn_process(c))) {
+        conn_close(c);
+    } else if (flushed == 0) {
+        struct epoll_event ev = {EPOLLOUT, {.ptr = c}};
+        epoll_ctl(c->epoll, EPOLL_CTL_MOD, c->fd, &ev);
+    }
+}
+
+/* Send the replies held until journal_sync. A connection that learns
+ * again is held for the next pass.
+ */
+static void release_held() {
+    Conn *c = g_held;
+    g_held = NULL;
+    while (c != NULL) {
+        Conn *next = c->nextHeld;
+        conn_release(c);
+        c = next;
+    }
+}
+
+/* Reader mode, main thread: apply the queued learns to g_root in the
+ * order they were sent. Their replies wait for journal_sync
+ * (learns_release).
+ */
+static void learns_apply() {
+    drain(g_learnWake[0]);
+    pthread_mutex_lock(&g_learnLock);
+    LearnRequest *r = g_learnQueue;
+    g_learnQueue = NULL;
+    pthread_mutex_unlock(&g_learnLock);
+
+    LearnRequest *oldestFirst = NULL;
+    while (r != NULL) {
+        LearnRequest *next = r->next;
+        r->next = oldestFirst;
+        oldestFirst = r;
+        r = next;
+    }
+    for (r = oldestFirst; r != NULL; ) {
+        LearnRequest *next = r->next;
+        Conn *c = r->conn;
+        const char *question = r->text + strlen(r->text) + 1;
+        GameSession g;
+        r->learned = game_resume(&g, c->path, c->pathLen, c->leafId) &&
+                     game_learn(&g, r->text, question, r->answer);
+        g_appliedLearned += r->learned;
+        r->next = g_applied;
+        g_applied = r;
+        r = next;
+    }
+}
+
+/* Reader mode, main thread, after journal_sync: publish the pass's
+ * learns and hand their replies back to the workers
+ */
+static void learns_release() {
+    if (g_applied == NULL) {
+        return;
+    }
+    if (g_appliedLearned > 0 && !snap_publish(&g_store, g_root)) {
+        fprintf(stderr, "animal_server: can't publish a snapshot\n");
+    }
+    while (g_applied != NULL) {
+        LearnRequest *r = g_applied;
+        g_applied = r->next;
+        Worker *w = r->conn->worker;
+        pthread_mutex_lock(&w->lock);
+        r->next = w->done;
+        w->done = r;
+        pthread_mutex_unlock(&w->lock);
+        wake(w->wake[1]);
+    }
+    g_appliedLearned = 0;
+}
+
+/* Reader mode, worker: reply to the learns the main thread has synced */
+static void worker_release(Worker *w) {
+    drain(w->wake[0]);
+    pthread_mutex_lock(&w->lock);
+    LearnRequest *r = w->done;
+    w->done = NULL;
+    pthread_mutex_unlock(&w->lock);
+    while (r != NULL) {
+        LearnRequest *next = r->next;
+        Conn *c = r->conn;
+        if (c->closing) {
+            conn_close(c);
+        } else {
+            if (r->learned) {
+                c->game.state = GAME_OVER;
+                conn_reply(c, "LEARNED", NULL);
+            } else {
+                conn_reply(c, "ERR", "cannot learn now");
+            }
+            conn_release(c);
+        }
+        free(r);
+        r = next;
+    }
+}
+
+static void *worker_main(void *arg) {
+    Worker *w = arg;
+    struct epoll_event events[MAX_EVENTS];
+    while (!__atomic_load_n(&g_workersStop, __ATOMIC_RELAXED)) {
+        int n = epoll_wait(w->epoll, events, MAX_EVENTS, -1);
+        for (int i = 0; i < n; i++) {
+            Conn *c = events[i].data.ptr;
+            if (c == NULL) {
+                worker_release(w);  // NULL marks the wake pipe
+            } else if (events[i].events & EPOLLOUT) {
+                on_writable(c);
+            } else if (events[i].events & (EPOLLIN | EPOLLHUP | EPOLLERR)) {
+                on_readable(c);
+            }
+        }
+    }
+    return NULL;
+}
+
+/* Start count workers, with SIGINT/SIGTERM left to the main thread.
+ * Returns 1 on success.
+ */
+static int workers_start(int count) {
+    g_workers = calloc(count, sizeof(Worker));
+    if (g_workers == NULL || !snap_init(&g_store, count) || !snap_publish(&g_store, g_root) ||
+        pipe(g_learnWake) < 0 || set_nonblocking(g_learnWake[0]) < 0 ||
+        set_nonblocking(g_learnWake[1]) < 0) {
+        return 0;
+    }
+    sigset_t block, old;
+    sigemptyset(&block);
+    sigaddset(&block, SIGINT);
+    sigaddset(&block, SIGTERM);
+    pthread_sigmask(SIG_BLOCK, &block, &old);
+    int ok = 1;
+    for (int i = 0; i < count && ok; i++) {
+        Worker *w = &g_workers[i];
+        w->index = i;
+        pthread_mutex_init(&w->lock, NULL);
+        w->epoll = epoll_create1(0);
+        struct epoll_event ev = {EPOLLIN, {.ptr = NULL}};
+        ok = w->epoll >= 0 && pipe(w->wake) == 0 && set_nonblocking(w->wake[0]) == 0 &&
+             set_nonblocking(w->wake[1]) == 0 &&
+             epoll_ctl(w->epoll, EPOLL_CTL_ADD, w->wake[0], &ev) == 0 &&
+             pthread_create(&w->thread, NULL, worker_main, w) == 0;
+        if (ok) {
+            g_workerCount++;
+        }
+    }
+    pthread_sigmask(SIG_SETMASK, &old, NULL);
+    return ok;
+}
+
+/* Stop and join the workers, and free the snapshots. Connections they
+ * still hold are left open, as in the single-threaded loop.
+ */
+static void workers_stop() {
+    __atomic_store_n(&g_workersStop, 1, __ATOMIC_RELAXED);
+    for (int i = 0; i < g_workerCount; i++) {
+        wake(g_workers[i].wake[1]);
+    }
+    for (int i = 0; i < g_workerCount; i++) {
+        pthread_join(g_workers[i].thread, NULL);
+        close(g_workers[i].epoll);
+        close(g_workers[i].wake[0]);
+        close(g_workers[i].wake[1]);
+        pthread_mutex_destroy(&g_workers[i].lock);
+    }
+    free(g_workers);
+    snap_free(&g_store);
+}
+
+static void on_accept(int listenFd) {
+    for (;;) {
+        int fd = accept(listenFd, NULL, NULL);
+        if (fd < 0) {
+            if (errno == EMFILE || errno == ENFILE) {
+                fprintf(stderr, "animal_server: out of file descriptors at %ld sessions\n",
+                        g_sessions);
+            }
+            return;  // EAGAIN: accepted everything pending
+        }
+        Conn *c = malloc(sizeof(Conn));
+        if (c == NULL || set_nonblocking(fd) < 0) {
+            free(c);
+            close(fd);
+            continue;
+        }
+        memset(c, 0, sizeof(*c));
+        c->fd = fd;
+        c->epoll = g_epoll;
+        c->game.state = GAME_OVER;  // Nothing asked until NEW
+        if (g_workerCount > 0) {
+            c->worker = &g_workers[g_nextWorker];
+            c->epoll = c->worker->epoll;
+            g_nextWorker = (g_nextWorker + 1) % g_workerCount;
+        }
+        __atomic_add_fetch(&g_sessions, 1, __ATOMIC_RELAXED);  // Before a worker can close it
+        struct epoll_event ev = {EPOLLIN, {.ptr = c}};
+        if (epoll_ctl(c->epoll, EPOLL_CTL_ADD, fd, &ev) < 0) {
+            __atomic_sub_fetch(&g_sessions, 1, __ATOMIC_RELAXED);
+            close(fd);
+            free(c);
+            continue;
+        }
+    }
+}
+
+static int listen_on(const char *path, int port) {
+    int fd;
+    if (port > 0) {
+        fd = socket(AF_INET, SOCK_STREAM, 0);
+        int one = 1;
+        setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one));
+        struct sockaddr_in addr;
+        memset(&addr, 0, sizeof(addr));
+        addr.sin_family = AF_INET;
+        addr.sin_port = htons(port);
+        addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+        if (fd < 0 || bind(fd, (struct sockaddr*)&addr, sizeof(addr)) < 0) {
+            return -1;
+        }
+    } else {
+        fd = socket(AF_UNIX, SOCK_STREAM, 0);
+        struct sockaddr_un addr;
+        memset(&addr, 0, sizeof(addr));
+        addr.sun_family = AF_UNIX;
+        if (strlen(path) >= sizeof(addr.sun_path)) {
+            return -1;
+        }
+        strcpy(addr.sun_path, path);
+        unlink(path);
+        if (fd < 0 || bind(fd, (struct sockaddr*)&addr, sizeof(addr)) < 0) {
+            return -1;
+        }
+    }
+    if (listen(fd, SOMAXCONN) < 0 || set_nonblocking(fd) < 0) {
+        return -1;
+    }
+    return fd;
+}
+
+int main(int argc, char **argv) {
+    const char *path = "animal.sock";
+    const char *treeFile = NULL;
+    int port = 0;
+    int threads = 0;
+    int opt;
+    while ((opt = getopt(argc, argv, "u:p:f:t:")) != -1) {
+        switch (opt) {
+            case 'u': path = optarg; break;
+            case 'p': port = atoi(optarg); break;
+            case 'f': treeFile = optarg; break;
+            case 't': threads = atoi(optarg); break;
+            default:
+                fprintf(stderr, "usage: %s [-u socket path | -p port] [-f tree file] [-t threads]\n",
+                        argv[0]);
+                return 1;
+        }
+    }
+    if (threads < 0 || threads > MAX_WORKERS) {
+        fprintf(stderr, "animal_server: -t takes 1 to %d threads\n", MAX_WORKERS);
+        return 1;
+    }
+
+    if (treeFile != NULL && access(treeFile, F_OK) == 0) {
+        if (!load_tree(treeFile)) {
+            fprintf(stderr, "animal_server: can't load %s\n", treeFile);
+            return 1;
+        }
+    } else {
+        starting_tree();
+    }
+    if (treeFile != NULL && !journal_open(treeFile, JOURNAL_SYNC_EVERY, JOURNAL_COMPACT_BYTES)) {
+        fprintf(stderr, "animal_server: can't journal to %s\n", treeFile);
+        return 1;
+    }
+
+    // One descriptor per session: take as many as we're allowed
+    struct rlimit lim;
+    if (getrlimit(RLIMIT_NOFILE, &lim) == 0 && lim.rlim_cur < lim.rlim_max) {
+        lim.rlim_cur = lim.rlim_max;
+        setrlimit(RLIMIT_NOFILE, &lim);
+    }
+
+    struct sigaction sa;
+    memset(&sa, 0, sizeof(sa));
+    sa.sa_handler = on_signal;
+    sigaction(SIGINT, &sa, NULL);
+    sigaction(SIGTERM, &sa, NULL);
+
+    int listenFd = listen_on(path, port);
+    g_epoll = epoll_create1(0);
+    if (listenFd < 0 || g_epoll < 0) {
+        perror("animal_server");
+        return 1;
+    }
+    struct epoll_event ev = {EPOLLIN, {.ptr = NULL}};  // NULL marks the listener
+    epoll_ctl(g_epoll, EPOLL_CTL_ADD, listenFd, &ev);
+    if (threads > 0) {
+        struct epoll_event learnEv = {EPOLLIN, {.ptr = g_learnWake}};
+        if (!workers_start(threads) ||
+            epoll_ctl(g_epoll, EPOLL_CTL_ADD, g_learnWake[0], &learnEv) < 0) {
+            fprintf(stderr, "animal_server: can't start %d threads\n", threads);
+            return 1;
+        }
+    }
+    if (port > 0) {
+        printf("animal_server: listening on 127.0.0.1:%d\n", port);
+    } else {
+        printf("animal_server: listening on %s\n", path);
+    }
+    fflush(stdout);
+
+    struct epoll_event events[MAX_EVENTS];
+    while (!g_stop) {
+        // Don't block while replies are held for the next sync
+        int n = epoll_wait(g_epoll, events, MAX_EVENTS, g_held != NULL ? 0 : -1);
+        for (int i = 0; i < n; i++) {
+            Conn *c = events[i].data.ptr;
+            if (c == NULL) {
+                on_accept(listenFd);
+            } else if ((void*)c == (void*)g_learnWake) {
+                learns_apply();
+            } else if (events[i].events & EPOLLOUT) {
+                on_writable(c);
+            } else if (events[i].events & (EPOLLIN | EPOLLHUP | EPOLLERR)) {
+                on_readable(c);
+            }
+        }
+        // Group commit: one fsync covers every learn of this pass, and
+        // only then are they acknowledged
+        if (treeFile != NULL && !journal_sync()) {
+            fprintf(stderr, "animal_server: journal write failed\n");
+            break;
+        }
+        release_held();
+        learns_release();
+    }
+    if (threads > 0) {
+        workers_stop();
+    }
+
+    printf("animal_server: %ld sessions open at shutdown, %d animals known\n",
+           g_sessions, g_stats.leaves);
+    int status = 0;
+    if (treeFile != NULL) {
+        if (!journal_checkpoint()) {
+            fprintf(stderr, "animal_server: can't save %s\n", treeFile);
+            status = 1;
+        }
+        journal_close();
+    }
+    close(listenFd);
+    close(g_epoll);
+    if (port == 0) {
+        unlink(path);
+    }
+    tree_release();
+    free_edit_stack(&g_undo);
+    free_edit_stack(&g_redo);
+    h_free(&g_index);
+    return status;
+}
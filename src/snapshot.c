@@ -0,0 +1,122 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "lab5.h"
+
+/* ========== Snapshots ========== */
+
+/* Epoch-based reclamation. The store's epoch starts at 1 and goes up by
+ * one per publish; a reader slot holds the epoch the reader entered at,
+ * or 0 while it is outside. A snapshot replaced while the epoch was E can
+ * only be held by readers that entered at E or earlier (a reader that saw
+ * E + 1 did so after the swap, so it loaded the new snapshot), and is
+ * freed once no reader is inside at E or earlier.
+ */
+
+int snap_init(SnapshotStore *s, int maxReaders) {
+    memset(s, 0, sizeof(*s));
+    if (maxReaders < 1) {
+        return 0;
+    }
+    s->readers = calloc(maxReaders, sizeof(ReaderSlot));
+    if (s->readers == NULL) {
+        return 0;
+    }
+    s->maxReaders = maxReaders;
+    s->epoch = 1;
+    pthread_mutex_init(&s->writeLock, NULL);
+    return 1;
+}
+
+/* Free retired snapshots no reader can still be inside. Caller holds
+ * writeLock.
+ */
+static void snap_reclaim(SnapshotStore *s) {
+    uint64_t oldest = UINT64_MAX;
+    for (int i = 0; i < s->maxReaders; i++) {
+        uint64_t e = __atomic_load_n(&s->readers[i].epoch, __ATOMIC_SEQ_CST);
+        if (e != 0 && e < oldest) {
+            oldest = e;
+        }
+    }
+    Snapshot **link = &s->retired;
+    while (*link != NULL) {
+        Snapshot *snap = *link;
+        if (snap->retiredAt < oldest) {
+            *link = snap->nextRetired;
+            flat_free(&snap->tree);
+            free(snap);
+            s->retiredCount--;
+        } else {
+            link = &snap->nextRetired;
+        }
+    }
+}
+
+/* Publish an immutable copy of the tree under root as the current
+ * snapshot. Writers are serialized; readers are never blocked, and keep
+ * the snapshot they entered with until they exit.
+ * Returns 1 on success, 0 on allocation failure (the current snapshot
+ * stays).
+ */
+int snap_publish(SnapshotStore *s, Node *root) {
+    Snapshot *snap = malloc(sizeof(Snapshot));
+    if (snap == NULL) {
+        return 0;
+    }
+    memset(snap, 0, sizeof(*snap));
+
+    pthread_mutex_lock(&s->writeLock);
+    if (!flat_from_tree(&snap->tree, root)) {
+        pthread_mutex_unlock(&s->writeLock);
+        free(snap);
+        return 0;
+    }
+    snap->version = s->published + 1;
+
+    Snapshot *old = __atomic_exchange_n(&s->current, snap, __ATOMIC_SEQ_CST);
+    uint64_t epoch = __atomic_fetch_add(&s->epoch, 1, __ATOMIC_SEQ_CST);
+    s->published++;
+    if (old != NULL) {
+        old->retiredAt = epoch;
+        old->nextRetired = s->retired;
+        s->retired = old;
+        s->retiredCount++;
+    }
+    snap_reclaim(s);
+    pthread_mutex_unlock(&s->writeLock);
+    return 1;
+}
+
+/* Enter as reader (0 .. maxReaders-1, one per thread) and return the
+ * current snapshot, or NULL if none has been published. Wait-free; the
+ * snapshot stays valid until snap_exit.
+ */
+const Snapshot *snap_enter(SnapshotStore *s, int reader) {
+    uint64_t epoch = __atomic_load_n(&s->epoch, __ATOMIC_SEQ_CST);
+    __atomic_store_n(&s->readers[reader].epoch, epoch, __ATOMIC_SEQ_CST);
+    return __atomic_load_n(&s->current, __ATOMIC_SEQ_CST);
+}
+
+void snap_exit(SnapshotStore *s, int reader) {
+    __atomic_store_n(&s->readers[reader].epoch, 0, __ATOMIC_RELEASE);
+}
+
+/* Free every snapshot. No reader may be inside. */
+void snap_free(SnapshotStore *s) {
+    if (s->current != NULL) {
+        flat_free(&s->current->tree);
+        free(s->current);
+    }
+    while (s->retired != NULL) {
+        Snapshot *next = s->retired->nextRetired;
+        flat_free(&s->retired->tree);
+        free(s->retired);
+        s->retired = next;
+    }
+    if (s->readers != NULL) {
+        pthread_mutex_destroy(&s->writeLock);
+    }
+    free(s->readers);
+    memset(s, 0, sizeof(*s));
+}
@@ -15,9 +15,18 @@
 /* Global tree root */
 Node *g_root = NULL;
 
+/* Next unused node ID for g_root's tree */
+int g_nextId = 0;
+
+/* Maintained node/leaf/depth counts for g_root */
+TreeStats g_stats = {0, 0, 0, NULL, 0};
+
+/* Storage pool owning the nodes of g_root */
+NodePool g_pool = {{NULL, 0}, {NULL, 0}, NULL, 0, {NULL, NULL, NULL, 0, 0}, NULL, NULL, 0};
+
 /* Global undo/redo stacks */
 EditStack g_undo = {NULL, 0, 0};
 EditStack g_redo = {NULL, 0, 0};
 
 /* Global attribute index */
-Hash g_index = {NULL, 0, 0};
+Hash g_index = {NULL, 0, 0, NULL, 0, 0, 0, 0};
@@ -2,6 +2,15 @@
 #include <stdlib.h>
 #include <string.h>
 #include <assert.h>
+#include <ctype.h>
+#include <time.h>
+#include <unistd.h>
+#include <signal.h>
+#include <sys/resource.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <sys/wait.h>
 #include "lab5.h"
 
 /* Test Frame Stack */
@@ -77,6 +86,24 @@ void test_queue() {
     assert(q_empty(&q));
     assert(!q_dequeue(&q, &n, &id));
     
+    /* Keep the ring wrapped while it grows: FIFO order must survive */
+    Node many[100];
+    int next_in = 0, next_out = 0;
+    for (int round = 0; round < 50; round++) {
+        q_enqueue(&q, &many[next_in % 100], next_in);
+        next_in++;
+        q_enqueue(&q, &many[next_in % 100], next_in);
+        next_in++;
+        assert(q_dequeue(&q, &n, &id));
+        assert(id == next_out && n == &many[next_out % 100]);
+        next_out++;
+    }
+    while (q_dequeue(&q, &n, &id)) {
+        assert(id == next_out);
+        next_out++;
+    }
+    assert(next_out == next_in && q_empty(&q));
+    
     q_free(&q);
     printf("  ✓ Queue tests passed\n");
 }
@@ -115,7 +142,162 @@ void test_hash() {
     
     assert(h.size > 2);
     
+    /* Test growth: table rehashes and keeps every key/id reachable */
+    for (int i = 0; i < 20000; i++) {
+        char key[32];
+        sprintf(key, "does_it_have_%d", i);
+        assert(h_put(&h, key, i));
+        assert(!h_put(&h, key, i));
+    }
+    assert(h.size == 20052);
+    assert((long)h.size * 10 <= (long)h.nslots * 7);
+    for (int i = 0; i < 20000; i++) {
+        char key[32];
+        sprintf(key, "does_it_have_%d", i);
+        assert(h_contains(&h, key, i));
+        assert(!h_contains(&h, key, i + 1));
+    }
+    ids = h_get_ids(&h, "meow", &count);
+    assert(count == 2);
+    
+    /* Test removal: every other key goes, the rest stay reachable */
+    for (int i = 0; i < 20000; i += 2) {
+        char key[32];
+        sprintf(key, "does_it_have_%d", i);
+        assert(h_remove(&h, key, i));
+        assert(!h_remove(&h, key, i));
+    }
+    assert(h.size == 10052);
+    for (int i = 0; i < 20000; i++) {
+        char key[32];
+        sprintf(key, "does_it_have_%d", i);
+        assert(h_contains(&h, key, i) == (i % 2));
+    }
+    assert(h_remove(&h, "meow", 1));
+    assert(h_contains(&h, "meow", 3) && !h_contains(&h, "meow", 1));
+    
     h_free(&h);
+    assert(h.slots == NULL && h.size == 0);
+    
+    /* Small id lists live inline; the third id spills to the heap and
+     * later removals and backward shifts keep every id reachable
+     */
+    Hash sb;
+    h_init(&sb, 8);
+    assert(h_put(&sb, "one", 1));
+    for (int i = 0; i < sb.nslots; i++) {
+        if (sb.slots[i].vals.count) assert(sb.slots[i].vals.capacity == IDLIST_INLINE);
+    }
+    assert(h_put(&sb, "one", 2));
+    ids = h_get_ids(&sb, "one", &count);
+    assert(count == 2 && ids[0] == 1 && ids[1] == 2);
+    for (int i = 3; i <= 10; i++) assert(h_put(&sb, "one", i));
+    ids = h_get_ids(&sb, "one", &count);
+    assert(count == 10);
+    for (int i = 1; i <= 10; i++) assert(h_contains(&sb, "one", i));
+    for (int i = 1; i <= 9; i++) assert(h_remove(&sb, "one", i));
+    assert(h_contains(&sb, "one", 10) && sb.size == 1);
+    assert(h_remove(&sb, "one", 10) && sb.size == 0);
+    for (int i = 0; i < 500; i++) {
+        char key[32];
+        sprintf(key, "k%d", i);
+        for (int j = 0; j <= i % 4; j++) assert(h_put(&sb, key, j));
+    }
+    for (int i = 0; i < 500; i += 3) {
+        char key[32];
+        sprintf(key, "k%d", i);
+        for (int j = 0; j <= i % 4; j++) assert(h_remove(&sb, key, j));
+    }
+    for (int i = 0; i < 500; i++) {
+        char key[32];
+        sprintf(key, "k%d", i);
+        h_get_ids(&sb, key, &count);
+        assert(count == (i % 3 ? i % 4 + 1 : 0));
+        for (int j = 0; j < count; j++) assert(h_contains(&sb, key, j));
+    }
+    h_free(&sb);
+    
+    /* A zeroed table (like g_index before h_init) works lazily */
+    Hash z = {0};
+    assert(!h_contains(&z, "meow", 1));
+    assert(h_put(&z, "meow", 1));
+    assert(h_contains(&z, "meow", 1));
+    h_free(&z);
+    
+    /* h_hash: deterministic, and every length path (0-3, 4-16, 17-48,
+     * longer) must see every byte: changing any one changes the hash
+     */
+    char buf[128];
+    memset(buf, 'a', sizeof(buf));
+    for (int len = 0; len < 100; len++) {
+        buf[len] = '\0';
+        unsigned base = h_hash(buf);
+        assert(base == h_hash(buf));
+        assert(h_hash_seeded(buf, 1) != base || h_hash_seeded(buf, 2) != base);
+        for (int i = 0; i < len; i++) {
+            buf[i] = 'b';
+            assert(h_hash(buf) != base);
+            buf[i] = 'a';
+        }
+        buf[len] = 'a';
+    }
+    
+    /* Near-identical keys spread over the low bits used to pick slots */
+    int used[1024] = {0};
+    int distinct = 0;
+    for (int i = 0; i < 1024; i++) {
+        char key[32];
+        sprintf(key, "does_it_have_%d", i);
+        int slot = h_hash(key) & 1023;
+        if (!used[slot]++) distinct++;
+    }
+    assert(distinct > 600);  // ~647 expected for a uniform hash
+    
+    /* A seeded table behaves the same, and keeps its seed over h_free */
+    Hash s;
+    h_init_seeded(&s, 8, 0x1234);
+    for (int i = 0; i < 1000; i++) {
+        char key[32];
+        sprintf(key, "does_it_have_%d", i);
+        assert(h_put(&s, key, i));
+    }
+    for (int i = 0; i < 1000; i++) {
+        char key[32];
+        sprintf(key, "does_it_have_%d", i);
+        assert(h_contains(&s, key, i));
+        assert(h_remove(&s, key, i));
+    }
+    assert(s.size == 0);
+    h_free(&s);
+    assert(s.seed == 0x1234);
+    assert(h_put(&s, "meow", 1) && h_contains(&s, "meow", 1));
+    h_free(&s);
+    
+    /* Remove/re-put cycles at a steady size keep the key buffer bounded:
+     * removed keys' bytes are compacted away, not just on grow */
+    Hash c;
+    h_init(&c, 64);
+    for (int i = 0; i < 32; i++) {
+        char key[32];
+        sprintf(key, "does_it_have_%d", i);
+        assert(h_put(&c, key, i));
+    }
+    size_t live = c.keyBytes;
+    int slots = c.nslots;
+    for (int round = 0; round < 100000; round++) {
+        char key[32];
+        sprintf(key, "does_it_have_%d", round % 32);
+        assert(h_remove(&c, key, round % 32));
+        assert(h_put(&c, key, round % 32));
+        assert(c.keyBytes <= 2 * live + 16 && c.keyCapacity <= 4 * live + 256);
+    }
+    assert(c.size == 32 && c.nslots == slots);
+    for (int i = 0; i < 32; i++) {
+        char key[32];
+        sprintf(key, "does_it_have_%d", i);
+        assert(h_contains(&c, key, i));
+    }
+    h_free(&c);
     printf("  ✓ Hash table tests passed\n");
 }
 
@@ -146,6 +328,7 @@ void test_persistence() {
     assert(g_root->isQuestion);
     assert(strcmp(g_root->text, "Test question?") == 0);
     assert(strcmp(g_root->yes->text, "Cat") == 0);
+    assert(g_root->isPooled && g_root->no->no->isPooled);
     
     /* Round-trip test */
     assert(save_tree("test2.dat"));
@@ -164,7 +347,7 @@ void test_persistence() {
     fclose(f2);
     
     /* Restore original root */
-    free_tree(g_root);
+    tree_release();
     g_root = saved_root;
     
     remove("test.dat");
@@ -173,6 +356,681 @@ void test_persistence() {
     printf("  ✓ Persistence tests passed\n");
 }
 
+static char *read_file(const char *name, long *size) {
+    FILE *f = fopen(name, "rb");
+    assert(f != NULL);
+    fseek(f, 0, SEEK_END);
+    *size = ftell(f);
+    fseek(f, 0, SEEK_SET);
+    char *buf = malloc(*size);
+    assert(fread(buf, 1, *size, f) == (size_t)*size);
+    fclose(f);
+    return buf;
+}
+
+static void write_file(const char *name, const char *buf, long size) {
+    FILE *f = fopen(name, "wb");
+    assert(f != NULL);
+    assert(fwrite(buf, 1, size, f) == (size_t)size);
+    fclose(f);
+}
+
+/* Test VERSION 1 / VERSION 2 formats */
+void test_file_versions() {
+    printf("Testing File Versions...\n");
+    
+    Node *saved_root = g_root;
+    g_root = create_question_node("Does it bark?");
+    g_root->yes = create_animal_node("Dog");
+    g_root->no = create_animal_node("Cat");
+    
+    /* VERSION 1 is still readable */
+    assert(save_tree_version("test.dat", 1));
+    assert(load_tree("test.dat"));
+    assert(g_pool.map == NULL);
+    assert(strcmp(g_root->no->text, "Cat") == 0);
+    
+    /* Legacy VERSION 1 files may hold empty texts (the old UI took an
+     * empty line); they load and survive a save in every later version */
+    char legacy[64];
+    long len = 0;
+    uint32_t header[3] = {0x41544C35, 1, 3};
+    memcpy(legacy, header, sizeof(header));
+    len += sizeof(header);
+    struct { uint8_t isQuestion; const char *text; int32_t yes, no; } recs[3] = {
+        {1, "", 1, 2}, {0, "Dog", -1, -1}, {0, "", -1, -1}
+    };
+    for (int i = 0; i < 3; i++) {
+        uint32_t textLen = strlen(recs[i].text);
+        legacy[len++] = (char)recs[i].isQuestion;
+        memcpy(legacy + len, &textLen, 4);
+        memcpy(legacy + len + 4, recs[i].text, textLen);
+        memcpy(legacy + len + 4 + textLen, &recs[i].yes, 4);
+        memcpy(legacy + len + 8 + textLen, &recs[i].no, 4);
+        len += 12 + textLen;
+    }
+    write_file("test.dat", legacy, len);
+    assert(load_tree("test.dat"));
+    assert(g_root->text[0] == '\0' && g_root->no->text[0] == '\0');
+    assert(strcmp(g_root->yes->text, "Dog") == 0);
+    for (int version = 1; version <= 6; version++) {
+        assert(save_tree_version("test.dat", version));
+        assert(load_tree("test.dat"));
+        assert(count_nodes(g_root) == 3 && g_root->no->text[0] == '\0');
+    }
+    tree_release();
+    g_root = create_question_node("Does it bark?");
+    g_root->yes = create_animal_node("Dog");
+    g_root->no = create_animal_node("Cat");
+    
+    /* VERSION 2 loads straight off the mapping */
+    assert(save_tree_version("test.dat", 2));
+    assert(load_tree("test.dat"));
+    assert(g_pool.map != NULL);
+    assert(g_root->isPooled && g_root->isQuestion);
+    assert(strcmp(g_root->text, "Does it bark?") == 0);
+    assert(strcmp(g_root->yes->text, "Dog") == 0);
+    assert(g_root->text >= (char*)g_pool.map &&
+           g_root->text < (char*)g_pool.map + g_pool.mapLength);
+    
+    /* Learned nodes graft onto a mapped tree */
+    Node *oldLeaf = g_root->no;
+    Node *q = pool_node(&g_pool, "Does it meow?", 1);
+    q->yes = pool_node(&g_pool, "Cat", 0);
+    q->no = oldLeaf;
+    g_root->no = q;
+    
+    /* Saving over the mapped file must not disturb the live tree */
+    assert(save_tree("test.dat"));
+    assert(strcmp(g_root->yes->text, "Dog") == 0);
+    assert(load_tree("test.dat"));
+    assert(count_nodes(g_root) == 5);
+    assert(strcmp(g_root->no->text, "Does it meow?") == 0);
+    
+    /* A truncated VERSION 2 file is rejected and the tree kept */
+    FILE *f = fopen("test.dat", "rb");
+    fseek(f, 0, SEEK_END);
+    long size = ftell(f);
+    fseek(f, 0, SEEK_SET);
+    char *buf = malloc(size);
+    assert(fread(buf, 1, size, f) == (size_t)size);
+    fclose(f);
+    f = fopen("test2.dat", "wb");
+    fwrite(buf, 1, size - 3, f);
+    fclose(f);
+    Node *before = g_root;
+    assert(!load_tree("test2.dat"));
+    assert(g_root == before);
+    
+    /* A string offset outside the blob is rejected */
+    buf[24] = 0x7f;  /* first record's textOffset */
+    f = fopen("test2.dat", "wb");
+    fwrite(buf, 1, size, f);
+    fclose(f);
+    assert(!load_tree("test2.dat"));
+    free(buf);
+    
+    tree_release();
+    g_root = saved_root;
+    remove("test.dat");
+    remove("test2.dat");
+    printf("  ✓ File version tests passed\n");
+}
+
+/* Test CRC32C against known values, whatever path computes it */
+void test_crc32c() {
+    printf("Testing CRC32C...\n");
+    
+    assert(crc32c(0, "", 0) == 0);
+    assert(crc32c(0, "123456789", 9) == 0xE3069283u);
+    char zeros[32] = {0};
+    assert(crc32c(0, zeros, 32) == 0x8A9136AAu);
+    
+    /* Chained calls at any split and alignment match one call */
+    char data[301];
+    for (int i = 0; i < 301; i++) {
+        data[i] = (char)(i * 37 + 11);
+    }
+    for (int start = 0; start < 8; start++) {
+        uint32_t whole = crc32c(0, data + start, 293);
+        for (int split = 0; split <= 293; split += 7) {
+            uint32_t crc = crc32c(0, data + start, split);
+            assert(crc32c(crc, data + start + split, 293 - split) == whole);
+        }
+    }
+    
+    /* Large inputs (the multi-lane path) match small chained pieces */
+    size_t big = 100003;
+    unsigned char *buf = malloc(big);
+    for (size_t i = 0; i < big; i++) {
+        buf[i] = (unsigned char)(i * 2654435761u >> 24);
+    }
+    uint32_t pieces = 0;
+    for (size_t off = 0; off < big; off += 1000) {
+        pieces = crc32c(pieces, buf + off, big - off < 1000 ? big - off : 1000);
+    }
+    assert(crc32c(0, buf, big) == pieces);
+    assert(crc32c(0, buf + 3, big - 3) == crc32c(crc32c(0, buf + 3, 50000), buf + 50003, big - 50003));
+    free(buf);
+    printf("  ✓ CRC32C tests passed\n");
+}
+
+/* Read a whole file into a malloc'd buffer */
+/* Test the bulk writer on every back end: bytes, checksum, fallbacks */
+void test_bulk_io() {
+    printf("Testing Bulk I/O...\n");
+    
+    /* Pieces of every size, one bigger than the whole buffer */
+    long total = 3 * (1 << 20) + 12345;
+    char *expected = malloc(total);
+    for (long i = 0; i < total; i++) {
+        expected[i] = (char)(i * 131 + (i >> 11));
+    }
+    IoBackend backends[] = {IO_FD, IO_DIRECT, IO_URING};
+    for (int b = 0; b < 3; b++) {
+        BulkWriter w;
+        assert(bw_open(&w, "test.bin", backends[b]));
+        assert(w.backend == backends[b] || w.backend == IO_FD);
+        w.checksum = 1;
+        long pos = 0;
+        srand(7);
+        while (pos < total) {
+            long n = (pos == 4096) ? (1 << 20) + 3 : rand() % 300;
+            if (n > total - pos) {
+                n = total - pos;
+            }
+            if (n < 1000 && rand() % 2) {
+                char *at = bw_reserve(&w, n);
+                assert(at != NULL);
+                memcpy(at, expected + pos, n);
+            } else {
+                assert(bw_write(&w, expected + pos, n));
+            }
+            pos += n;
+        }
+        assert(bw_crc(&w) == crc32c(0, expected, total));
+        assert(w.writes >= 2);
+        assert(bw_close(&w, 1));
+        
+        long size;
+        char *got = read_file("test.bin", &size);
+        assert(size == total && memcmp(got, expected, total) == 0);
+        free(got);
+    }
+    free(expected);
+    
+    /* save_tree writes the same bytes through every back end */
+    Node *saved_root = g_root;
+    int n = 100001;
+    Node **nodes = malloc(n * sizeof(Node*));
+    for (int i = 0; i < n; i++) {
+        nodes[i] = (2 * i + 2 < n) ? create_question_node("Does it fly?")
+                                   : create_animal_node("Eagle");
+    }
+    for (int i = 0; 2 * i + 2 < n; i++) {
+        nodes[i]->yes = nodes[2 * i + 1];
+        nodes[i]->no = nodes[2 * i + 2];
+    }
+    g_root = nodes[0];
+    free(nodes);
+    for (int version = 1; version <= 4; version += 3) {
+        long goodSize;
+        set_io_backend(IO_FD);
+        assert(save_tree_version("test.dat", version));
+        char *good = read_file("test.dat", &goodSize);
+        for (int b = 1; b < 3; b++) {
+            long size;
+            set_io_backend(backends[b]);
+            assert(save_tree_version("test.dat", version));
+            char *got = read_file("test.dat", &size);
+            assert(size == goodSize && memcmp(got, good, size) == 0);
+            free(got);
+        }
+        free(good);
+    }
+    set_io_backend(IO_FD);
+    assert(load_tree("test.dat"));
+    assert(count_nodes(g_root) == n);
+    tree_release();
+    
+    g_root = saved_root;
+    remove("test.bin");
+    remove("test.dat");
+    printf("  ✓ Bulk I/O tests passed\n");
+}
+
+/* Test the LZ block codec */
+void test_lz_codec() {
+    printf("Testing LZ Block Codec...\n");
+    
+    /* Round trips: empty, tiny, runs, text, noise and overlapping matches */
+    size_t max = 70000;
+    unsigned char *in = malloc(max);
+    unsigned char *packed = malloc(lz_bound(max));
+    unsigned char *out = malloc(max);
+    srand(24);
+    for (int kind = 0; kind < 5; kind++) {
+        for (size_t i = 0; i < max; i++) {
+            switch (kind) {
+                case 0: in[i] = 'a'; break;
+                case 1: in[i] = "Does it have feature 12?"[i % 24]; break;
+                case 2: in[i] = (unsigned char)rand(); break;
+                case 3: in[i] = (unsigned char)(i % 3 ? (int)(i / 7) : rand()); break;
+                default: in[i] = (unsigned char)(rand() % 4); break;
+            }
+        }
+        size_t sizes[] = {0, 1, 3, 4, 5, 15, 16, 19, 300, 65536, max};
+        for (int s = 0; s < 11; s++) {
+            size_t len = sizes[s];
+            assert(lz_compress(in, len, packed, lz_bound(len) - 1) == 0);
+            size_t n = lz_compress(in, len, packed, lz_bound(len));
+            assert(n > 0 && n <= lz_bound(len));
+            assert(lz_decompress(packed, n, out, len) == (long)len);
+            assert(memcmp(in, out, len) == 0);
+            if (len > 0) {
+                assert(lz_decompress(packed, n, out, len - 1) == -1);
+            }
+        }
+    }
+    /* Tree-file-like text compresses well */
+    size_t len = 0;
+    for (int i = 0; len + 32 < 65536; i++) {
+        len += sprintf((char *)in + len, "Animal species %d", rand() % 500) + 1;
+    }
+    size_t n = lz_compress(in, len, packed, lz_bound(len));
+    assert(n < len / 2);
+    
+    /* Corrupted blocks fail or stay within the output buffer */
+    for (int iter = 0; iter < 5000; iter++) {
+        unsigned char *bad = malloc(n);
+        memcpy(bad, packed, n);
+        for (int f = 1 + rand() % 3; f > 0; f--) {
+            bad[rand() % n] = (unsigned char)rand();
+        }
+        size_t cut = rand() % 4 ? n : (size_t)(rand() % (int)n);
+        long got = lz_decompress(bad, cut, out, 65536);
+        assert(got >= -1 && got <= 65536);
+        free(bad);
+    }
+    unsigned char before[] = {0x04, 'a', 0x05, 0x00};  // Offset past the start
+    assert(lz_decompress(before, 4, out, 100) == -1);
+    unsigned char zero[] = {0x14, 'a', 0x00, 0x00};   // Offset 0
+    assert(lz_decompress(zero, 4, out, 100) == -1);
+    unsigned char run[] = {0x1F, 'a', 0x01, 0x00, 0x01};  // 'a' x 21, overlapping
+    assert(lz_decompress(run, 5, out, 100) == 21);
+    assert(out[0] == 'a' && out[20] == 'a');
+    
+    free(in);
+    free(packed);
+    free(out);
+    printf("  ✓ LZ block codec tests passed\n");
+}
+
+/* Fuzz-style load validation: truncations, random corruption and
+ * hostile headers must be rejected (or yield a proper tree), never crash
+ */
+void test_persistence_fuzz() {
+    printf("Testing Persistence Fuzzing...\n");
+    
+    Node *saved_root = g_root;
+    g_root = create_question_node("Is it big?");
+    g_root->yes = create_question_node("Does it have a trunk?");
+    g_root->yes->yes = create_animal_node("Elephant");
+    g_root->yes->no = create_animal_node("Whale");
+    g_root->no = create_question_node("Does it meow?");
+    g_root->no->yes = create_animal_node("Cat");
+    g_root->no->no = create_animal_node("Mouse");
+    
+    /* load_tree releases the tree it replaces, so work on loaded copies
+     * and reload the good file after any corrupted load succeeds */
+    srand(312);
+    for (int version = 1; version <= 6; version++) {
+        long size;
+        assert(save_tree_version("test.dat", version));
+        assert(load_tree("test.dat"));
+        Node *original = g_root;
+        char *good = read_file("test.dat", &size);
+        char *buf = malloc(size);
+        
+        /* Every truncation is caught by the size checks */
+        for (long len = 0; len < size; len++) {
+            write_file("test2.dat", good, len);
+            assert(!load_tree("test2.dat"));
+            assert(g_root == original);
+        }
+        
+        /* Trailing bytes are rejected too */
+        char *longer = malloc(size + 1);
+        memcpy(longer, good, size);
+        longer[size] = 'x';
+        write_file("test2.dat", longer, size + 1);
+        assert(!load_tree("test2.dat"));
+        free(longer);
+        
+        /* Hostile node counts fail before any large allocation */
+        uint32_t hostile[] = {0, 8, 0x7FFFFFFF, 0x80000000, 0xFFFFFFFF};
+        for (int i = 0; i < 5; i++) {
+            memcpy(buf, good, size);
+            memcpy(buf + 8, &hostile[i], sizeof(uint32_t));
+            write_file("test2.dat", buf, size);
+            assert(!load_tree("test2.dat"));
+        }
+        
+        /* Random byte corruption: any tree that loads must be a tree */
+        for (int iter = 0; iter < 2000; iter++) {
+            memcpy(buf, good, size);
+            int flips = 1 + rand() % 4;
+            for (int f = 0; f < flips; f++) {
+                buf[12 + rand() % (size - 12)] = (char)rand();
+            }
+            write_file("test2.dat", buf, size);
+            if (load_tree("test2.dat")) {
+                /* VERSION 4 and 5 checksums catch every changed file */
+                assert(version < 4 || memcmp(buf, good, size) == 0);
+                assert(count_nodes(g_root) <= 7);
+                assert(load_tree("test.dat"));
+                original = g_root;
+            }
+        }
+        
+        /* Behind a checksum, re-stamp it so the other checks are reached */
+        for (int iter = 0; version >= 4 && iter < 2000; iter++) {
+            memcpy(buf, good, size);
+            buf[12 + rand() % (size - 16)] = (char)rand();
+            uint32_t crc = crc32c(0, buf, size - 4);
+            memcpy(buf + size - 4, &crc, sizeof(crc));
+            write_file("test2.dat", buf, size);
+            if (load_tree("test2.dat")) {
+                assert(count_nodes(g_root) <= 7);
+                assert(load_tree("test.dat"));
+                original = g_root;
+            }
+        }
+        
+        free(buf);
+        free(good);
+    }
+    
+    tree_release();
+    
+    /* Trees past the old 100000-node cap load fine */
+    int n = 150001;
+    Node **nodes = malloc(n * sizeof(Node*));
+    for (int i = 0; i < n; i++) {
+        nodes[i] = (2 * i + 2 < n) ? create_question_node("Q?") : create_animal_node("A");
+    }
+    for (int i = 0; 2 * i + 2 < n; i++) {
+        nodes[i]->yes = nodes[2 * i + 1];
+        nodes[i]->no = nodes[2 * i + 2];
+    }
+    g_root = nodes[0];
+    free(nodes);
+    for (int version = 1; version <= 6; version++) {
+        assert(save_tree_version("test.dat", version));
+        /* Big enough for two load threads: same tree either way */
+        for (int threads = 1; threads <= 2; threads++) {
+            set_load_threads(threads);
+            assert(load_tree("test.dat"));
+            assert(count_nodes(g_root) == n);
+            assert(check_integrity());
+        }
+    }
+    
+    /* VERSION 6 compresses its many blocks; a damaged block whose CRC
+     * still matches fails to decompress instead of overrunning */
+    long size5, size6;
+    assert(save_tree_version("test.dat", 5));
+    free(read_file("test.dat", &size5));
+    assert(save_tree_version("test.dat", 6));
+    char *packed = read_file("test.dat", &size6);
+    assert(size6 < size5 * 2 / 3);
+    for (int iter = 0; iter < 40; iter++) {
+        char *bad = malloc(size6);
+        memcpy(bad, packed, size6);
+        bad[40 + rand() % (size6 - 44)] ^= (char)(1 + rand() % 255);
+        uint32_t crc = crc32c(0, bad, size6 - 4);
+        memcpy(bad + size6 - 4, &crc, sizeof(crc));
+        write_file("test2.dat", bad, size6);
+        if (load_tree("test2.dat")) {
+            assert(count_nodes(g_root) <= n);
+        }
+        free(bad);
+    }
+    free(packed);
+    
+    /* A second parent in the second thread's half is still caught */
+    long size;
+    assert(save_tree_version("test.dat", 3));
+    char *good = read_file("test.dat", &size);
+    int32_t shared = 1;
+    memcpy(good + 24 + (long)(n - 1) * 32 + 8, &shared, sizeof(shared));
+    write_file("test2.dat", good, size);
+    assert(!load_tree("test2.dat"));
+    free(good);
+    set_load_threads(0);
+    tree_release();
+    
+    g_root = saved_root;
+    remove("test.dat");
+    remove("test2.dat");
+    printf("  ✓ Persistence fuzz tests passed\n");
+}
+
+/* Test stable node IDs */
+void test_stable_ids() {
+    printf("Testing Stable IDs...\n");
+    
+    Node *saved_root = g_root;
+    g_root = create_question_node("Does it live in water?");
+    g_root->yes = create_animal_node("Fish");
+    g_root->no = create_animal_node("Dog");
+    
+    /* Saving assigns IDs to nodes built outside the game */
+    assert(save_tree("test.dat"));
+    assert(g_root->id >= 0 && g_root->yes->id >= 0 && g_root->no->id >= 0);
+    assert(g_nextId == 3);
+    assert(load_tree("test.dat"));
+    assert(g_nextId == 3);
+    
+    /* Learn, undo (unlink), learn again: IDs keep climbing */
+    Node *dog = g_root->no;
+    Node *q1 = pool_node(&g_pool, "Does it meow?", 1);
+    q1->id = g_nextId++;
+    Node *cat = pool_node(&g_pool, "Cat", 0);
+    cat->id = g_nextId++;
+    g_root->no = dog;  /* undone */
+    Node *q2 = pool_node(&g_pool, "Does it bark?", 1);
+    q2->id = g_nextId++;
+    Node *wolf = pool_node(&g_pool, "Wolf", 0);
+    wolf->id = g_nextId++;
+    q2->yes = wolf;
+    q2->no = dog;
+    g_root->no = q2;
+    assert(wolf->id != cat->id && wolf->id == 6);
+    
+    /* IDs and the counter survive a round trip */
+    int dogId = dog->id;
+    assert(save_tree("test.dat"));
+    assert(load_tree("test.dat"));
+    assert(g_nextId == 7);
+    assert(g_root->no->id == 5);
+    assert(g_root->no->yes->id == 6);
+    assert(g_root->no->no->id == dogId);
+    assert(h_contains(&g_index, "does_it_bark", 6));
+    assert(h_contains(&g_index, "does_it_bark", dogId));
+    
+    /* A file repeating an ID, or using one at or past nextId, is rejected */
+    for (int version = 3; version <= 5; version++) {
+        long size;
+        assert(save_tree_version("test.dat", version));
+        char *good = read_file("test.dat", &size);
+        char *buf = malloc(size);
+        uint32_t strings;
+        memcpy(&strings, good + 24, sizeof(strings));
+        long first = version == 5 ? 32 + (long)strings * 8 + 12 : 24 + 24;
+        long stride = version == 5 ? 16 : 32;
+        int32_t bad[2];
+        memcpy(&bad[0], good + first + stride, sizeof(int32_t));  /* record 1's ID */
+        bad[1] = g_nextId;
+        for (int k = 0; k < 2; k++) {
+            memcpy(buf, good, size);
+            memcpy(buf + first + 2 * stride, &bad[k], sizeof(int32_t));
+            if (version >= 4) {
+                uint32_t crc = crc32c(0, buf, size - 4);
+                memcpy(buf + size - 4, &crc, sizeof(crc));
+            }
+            write_file("test2.dat", buf, size);
+            assert(!load_tree("test2.dat"));
+        }
+        free(buf);
+        free(good);
+    }
+    assert(g_nextId == 7 && g_root->no->no->id == dogId);
+    remove("test2.dat");
+    
+    /* Older formats number nodes by file position */
+    assert(save_tree_version("test.dat", 2));
+    assert(load_tree("test.dat"));
+    assert(g_nextId == 5 && g_root->id == 0 && g_root->no->no->id == 4);
+    
+    tree_release();
+    h_free(&g_index);
+    g_root = saved_root;
+    remove("test.dat");
+    printf("  ✓ Stable ID tests passed\n");
+}
+
+/* Test maintained tree statistics */
+void test_stats() {
+    printf("Testing Tree Statistics...\n");
+    
+    Node *saved_root = g_root;
+    g_root = create_question_node("Is it big?");
+    g_root->yes = create_animal_node("Elephant");
+    g_root->no = create_question_node("Does it meow?");
+    g_root->no->yes = create_animal_node("Cat");
+    g_root->no->no = create_animal_node("Mouse");
+    
+    /* Loading restores the counters */
+    assert(save_tree("test.dat"));
+    assert(load_tree("test.dat"));
+    assert(g_stats.nodes == 5 && g_stats.leaves == 3 && g_stats.maxDepth == 2);
+    
+    /* Split Elephant (depth 1): no new max depth */
+    Node *elephant = g_root->yes;
+    Node *q = pool_node(&g_pool, "Does it have a trunk?", 1);
+    q->yes = elephant;
+    q->no = pool_node(&g_pool, "Whale", 0);
+    g_root->yes = q;
+    stats_apply_split(1);
+    assert(g_stats.nodes == 7 && g_stats.leaves == 4 && g_stats.maxDepth == 2);
+    
+    /* Chain splits down the no side raise max depth one level each */
+    Node *leaf = g_root->no->no;
+    Node *parent = g_root->no;
+    for (int depth = 2; depth < 1000; depth++) {
+        Node *split = pool_node(&g_pool, "Q?", 1);
+        split->yes = pool_node(&g_pool, "A", 0);
+        split->no = leaf;
+        parent->no = split;
+        parent = split;
+        stats_apply_split(depth);
+        assert(g_stats.maxDepth == depth + 1);
+    }
+    int nodes = g_stats.nodes;
+    int leaves = g_stats.leaves;
+    stats_rebuild();
+    assert(g_stats.nodes == nodes && g_stats.leaves == leaves);
+    assert(g_stats.maxDepth == 1000);
+    
+    /* Reverting the deepest split drops max depth back a level */
+    stats_revert_split(999);
+    assert(g_stats.maxDepth == 999 && g_stats.nodes == nodes - 2);
+    
+    tree_release();
+    assert(g_stats.nodes == 0 && g_stats.leafDepths == NULL);
+    h_free(&g_index);
+    g_root = saved_root;
+    remove("test.dat");
+    printf("  ✓ Tree statistics tests passed\n");
+}
+
+/* Test g_index rebuild and split maintenance */
+void test_index() {
+    printf("Testing Question Index...\n");
+    
+    Node *saved_root = g_root;
+    g_root = create_question_node("Does it live in water?");
+    g_root->yes = create_animal_node("Fish");
+    g_root->no = create_animal_node("Dog");
+    
+    /* Loading rebuilds the index from the file */
+    assert(save_tree("test.dat"));
+    assert(load_tree("test.dat"));
+    int fish = g_root->yes->id;
+    int dog = g_root->no->id;
+    assert(fish != dog);
+    assert(g_index.size == 1);
+    assert(h_contains(&g_index, "does_it_live_in_water", fish));
+    assert(h_contains(&g_index, "does_it_live_in_water", dog));
+    
+    /* Learn "Cat" under the no branch */
+    Edit e;
+    e.type = EDIT_INSERT_SPLIT;
+    e.parent = g_root;
+    e.wasYesChild = 0;
+    e.oldLeaf = g_root->no;
+    e.newQuestion = pool_node(&g_pool, "Does it meow?", 1);
+    e.newLeaf = pool_node(&g_pool, "Cat", 0);
+    e.newQuestion->id = 3;
+    e.newLeaf->id = 4;
+    e.newQuestion->yes = e.newLeaf;
+    e.newQuestion->no = e.oldLeaf;
+    g_root->no = e.newQuestion;
+    index_apply_split(&e);
+    
+    assert(!h_contains(&g_index, "does_it_live_in_water", dog));
+    assert(h_contains(&g_index, "does_it_meow", 4));
+    assert(h_contains(&g_index, "does_it_meow", dog));
+    
+    /* Incremental state matches a from-scratch rebuild */
+    index_rebuild();
+    assert(g_index.size == 2);
+    assert(h_contains(&g_index, "does_it_live_in_water", fish));
+    assert(!h_contains(&g_index, "does_it_live_in_water", dog));
+    assert(h_contains(&g_index, "does_it_meow", 4));
+    assert(h_contains(&g_index, "does_it_meow", dog));
+    
+    /* Undo: unlink and revert */
+    g_root->no = e.oldLeaf;
+    index_revert_split(&e);
+    int count;
+    assert(h_get_ids(&g_index, "does_it_meow", &count) == NULL && count == 0);
+    assert(h_contains(&g_index, "does_it_live_in_water", dog));
+    
+    /* Redo: relink and reapply */
+    g_root->no = e.newQuestion;
+    index_apply_split(&e);
+    assert(h_contains(&g_index, "does_it_meow", 4));
+    
+    /* A seeded index stays seeded across rebuilds (load, initialize) */
+    h_free(&g_index);
+    h_init_seeded(&g_index, 8, 0x5EED);
+    index_rebuild();
+    assert(g_index.seed == 0x5EED && g_index.size == 2);
+    assert(h_contains(&g_index, "does_it_meow", dog));
+    assert(load_tree("test.dat"));
+    assert(g_index.seed == 0x5EED);
+    assert(h_contains(&g_index, "does_it_live_in_water", dog));
+    
+    tree_release();
+    h_free(&g_index);
+    g_index.seed = 0;  // Later tests expect the unseeded index
+    g_root = saved_root;
+    remove("test.dat");
+    printf("  ✓ Question index tests passed\n");
+}
+
 /* Test Integrity Checker */
 void test_integrity() {
     printf("Testing Integrity Checker...\n");
@@ -202,6 +1060,141 @@ void test_integrity() {
     printf("  ✓ Integrity tests passed\n");
 }
 
+/* Test Flat Tree */
+void test_flat_tree() {
+    printf("Testing Flat Tree...\n");
+    
+    Node *root = create_question_node("Is it big?");
+    root->yes = create_question_node("Does it have stripes?");
+    root->no = create_animal_node("Mouse");
+    root->yes->yes = create_animal_node("Tiger");
+    root->yes->no = create_animal_node("Elephant");
+    
+    /* BFS order: root, its yes and no, then the yes side's children */
+    FlatTree ft;
+    assert(flat_from_tree(&ft, root));
+    assert(ft.count == 5);
+    assert(FLAT_YES(&ft, 0) == 1 && FLAT_NO(&ft, 0) == 2);
+    assert(FLAT_YES(&ft, 1) == 3 && FLAT_NO(&ft, 1) == 4);
+    assert(FLAT_YES(&ft, 2) == -1 && FLAT_NO(&ft, 2) == -1);
+    assert(FLAT_CHILD(&ft, 1, 1) == 3 && FLAT_CHILD(&ft, 1, 0) == 4);
+    assert(FLAT_IS_QUESTION(&ft, 0) && FLAT_IS_QUESTION(&ft, 1));
+    assert(!FLAT_IS_QUESTION(&ft, 2) && !FLAT_IS_QUESTION(&ft, 4));
+    assert(strcmp(ft.strings + ft.textOffset[2], "Mouse") == 0);
+    assert(strcmp(ft.strings + ft.textOffset[4], "Elephant") == 0);
+    assert(flat_check_integrity(&ft));
+    
+    /* Flattening hands out IDs to nodes that had none */
+    assert(root->id >= 0 && ft.ids[0] == root->id);
+    assert(ft.ids[3] == root->yes->yes->id);
+    
+    /* Replay: big, no stripes -> Elephant; small -> Mouse */
+    unsigned char bigPlain[] = {1, 0};
+    unsigned char small[] = {0, 1, 1};
+    assert(flat_walk(&ft, bigPlain, 2) == 4);
+    assert(flat_walk(&ft, small, 3) == 2);
+    assert(flat_walk(&ft, bigPlain, 1) == 1);  // Ran out of answers
+    
+    /* Back to a pooled pointer tree with the same shape, text and IDs */
+    NodePool pool;
+    pool_init(&pool);
+    Node *copy = flat_to_tree(&ft, &pool);
+    assert(copy != NULL && copy->isPooled);
+    assert(count_nodes(copy) == 5);
+    assert(strcmp(copy->yes->no->text, "Elephant") == 0);
+    assert(copy->yes->no->id == root->yes->no->id);
+    assert(copy->isQuestion && !copy->no->isQuestion);
+    
+    FlatTree again;
+    assert(flat_from_tree(&again, copy));
+    assert(again.count == ft.count && again.stringBytes == ft.stringBytes);
+    assert(memcmp(again.children, ft.children, ft.count * 2 * sizeof(int32_t)) == 0);
+    assert(memcmp(again.ids, ft.ids, ft.count * sizeof(int32_t)) == 0);
+    assert(memcmp(again.strings, ft.strings, ft.stringBytes) == 0);
+    flat_free(&again);
+    pool_free(&pool);
+    flat_free(&ft);
+    
+    /* Same rules as check_integrity */
+    Node *saved = g_root;
+    g_root = root;
+    free_tree(root->no);
+    root->no = NULL;
+    assert(flat_from_tree(&ft, root));
+    assert(!flat_check_integrity(&ft));
+    assert(!check_integrity());
+    flat_free(&ft);
+    
+    root->no = create_animal_node("Mouse");
+    root->no->yes = create_animal_node("Cat");
+    assert(flat_from_tree(&ft, root));
+    assert(!flat_check_integrity(&ft));
+    assert(!check_integrity());
+    flat_free(&ft);
+    
+    /* Empty tree */
+    assert(flat_from_tree(&ft, NULL));
+    assert(ft.count == 0 && flat_check_integrity(&ft));
+    assert(flat_walk(&ft, small, 3) == -1);
+    assert(flat_to_tree(&ft, &pool) == NULL);
+    flat_free(&ft);
+    
+    free_tree(root);
+    g_root = saved;
+    
+    printf("  ✓ Flat tree tests passed\n");
+}
+
+/* Test Deep Trees
+ * A chain of questions a million levels deep (each one with a leaf on
+ * its yes side) must not overflow the call stack in any tree walk.
+ */
+#define DEEP_CHAIN_QUESTIONS 1000000
+
+void test_deep_chain() {
+    printf("Testing Deep Chains...\n");
+    
+    Node *saved = g_root;
+    Node *root = create_question_node("Q");
+    Node *cur = root;
+    for (int i = 1; i < DEEP_CHAIN_QUESTIONS; i++) {
+        cur->yes = create_animal_node("A");
+        cur->no = create_question_node("Q");
+        cur = cur->no;
+    }
+    cur->yes = create_animal_node("A");
+    cur->no = create_animal_node("B");
+    g_root = root;
+    
+    int expected = 2 * DEEP_CHAIN_QUESTIONS + 1;
+    assert(count_nodes(g_root) == expected);
+    assert(check_integrity());
+    
+    FlatTree ft;
+    assert(flat_from_tree(&ft, g_root));
+    assert(ft.count == expected && flat_check_integrity(&ft));
+    flat_free(&ft);
+    
+    /* Round trip through the mapped format: the loaded tree is pooled */
+    assert(save_tree("test_deep.dat"));
+    free_tree(g_root);
+    g_root = NULL;
+    
+    assert(load_tree("test_deep.dat"));
+    assert(count_nodes(g_root) == expected);
+    assert(check_integrity());
+    assert(g_stats.nodes == expected);
+    assert(g_stats.leaves == DEEP_CHAIN_QUESTIONS + 1);
+    assert(g_stats.maxDepth == DEEP_CHAIN_QUESTIONS);
+    
+    tree_release();
+    
+    remove("test_deep.dat");
+    g_root = saved;
+    
+    printf("  ✓ Deep chain tests passed\n");
+}
+
 /* Test Canonicalization */
 void test_canonicalize() {
     printf("Testing Canonicalization...\n");
@@ -218,6 +1211,40 @@ void test_canonicalize() {
     assert(strcmp(c3, "abc123") == 0);
     free(c3);
     
+    /* Buffer variant, long enough to take the vector paths */
+    char out[128];
+    const char *longQ = "Does It Live In The Water And Eat Fish, Or Does It Fly?!";
+    size_t len = canonicalize_into(longQ, out);
+    assert(strcmp(out, "does_it_live_in_the_water_and_eat_fish_or_does_it_fly") == 0);
+    assert(len == strlen(out));
+    assert(canonicalize_into("", out) == 0 && out[0] == '\0');
+    
+    /* Random bytes (including tabs, punctuation and non-ASCII) at every
+     * length and alignment must match the byte-at-a-time ctype version
+     */
+    unsigned seed = 1;
+    char in[100], expect[100];
+    for (int round = 0; round < 20000; round++) {
+        int n = round % 99;
+        for (int i = 0; i < n; i++) {
+            seed = seed * 1103515245u + 12345u;
+            unsigned char c = (seed >> 16) & 0xFF;
+            /* Bias towards letters and spaces so full blocks occur */
+            if (round & 1) c = "aZ q9\t"[c % 6];
+            in[i] = c ? (char)c : 'x';
+        }
+        in[n] = '\0';
+        int j = 0;
+        for (int i = 0; i < n; i++) {
+            unsigned char c = in[i];
+            if (isalnum(c)) expect[j++] = tolower(c);
+            else if (isspace(c)) expect[j++] = '_';
+        }
+        expect[j] = '\0';
+        assert(canonicalize_into(in, out) == (size_t)j);
+        assert(strcmp(out, expect) == 0);
+    }
+    
     printf("  ✓ Canonicalization tests passed\n");
 }
 
@@ -253,6 +1280,69 @@ void test_nodes() {
     printf("  ✓ Node tests passed\n");
 }
 
+/* Test Arena / Node Pool */
+void test_pool() {
+    printf("Testing Node Pool...\n");
+    
+    NodePool p;
+    pool_init(&p);
+    
+    Node *q = pool_node(&p, "Does it fly?", 1);
+    assert(q != NULL && q->isPooled && q->isQuestion);
+    assert(strcmp(q->text, "Does it fly?") == 0);
+    assert(q->yes == NULL && q->no == NULL);
+    
+    /* Incremental inserts spanning many blocks */
+    Node *curr = q;
+    for (int i = 0; i < 10000; i++) {
+        char text[32];
+        sprintf(text, "Animal %d", i);
+        curr->yes = pool_node(&p, text, 0);
+        curr->no = pool_node(&p, "Next?", 1);
+        assert(strcmp(curr->yes->text, text) == 0);
+        curr = curr->no;
+    }
+    curr->isQuestion = 0;
+    assert(count_nodes(q) == 20001);
+    
+    /* Repeated texts share one interned copy */
+    assert(q->no->text == q->no->no->text);
+    assert(q->yes->text != q->no->yes->text);
+    assert(pool_intern(&p, "Animal 7") == q->no->no->no->no->no->no->no->yes->text);
+    
+    /* Reservation keeps a large request in one block */
+    assert(arena_reserve(&p.strings, 1 << 20));
+    char *big = arena_alloc(&p.strings, 1 << 20);
+    assert(big != NULL);
+    memset(big, 'x', 1 << 20);
+    
+    /* free_tree leaves pooled nodes to their pool */
+    free_tree(q);
+    assert(strcmp(q->yes->text, "Animal 0") == 0);
+    
+    pool_free(&p);
+    assert(p.nodes.head == NULL && p.strings.head == NULL);
+    assert(p.interned.count == 0);
+    
+    /* A VERSION 5 load stores "Cat" once and new nodes reuse that copy */
+    Node *saved_root = g_root;
+    g_root = create_question_node("Does it meow?");
+    g_root->yes = create_animal_node("Cat");
+    g_root->no = create_question_node("Is it a pet?");
+    g_root->no->yes = create_animal_node("Cat");
+    g_root->no->no = create_animal_node("Mouse");
+    assert(save_tree_version("test.dat", 5));
+    assert(load_tree("test.dat"));
+    assert(g_root->yes->text == g_root->no->yes->text);
+    Node *cat = pool_node(&g_pool, "Cat", 0);
+    assert(cat->text == g_root->yes->text);
+    assert(pool_node(&g_pool, "Dog", 0)->text != cat->text);
+    tree_release();
+    g_root = saved_root;
+    remove("test.dat");
+    printf("  ✓ Node pool tests passed\n");
+}
+
 /* Test Edit Stack */
 void test_edit_stack() {
     printf("Testing Edit Stack...\n");
@@ -296,17 +1386,885 @@ void test_edit_stack() {
     printf("  ✓ Edit stack tests passed\n");
 }
 
+void test_game_engine() {
+    printf("Testing Game Engine...\n");
+    
+    Node *saved_root = g_root;
+    g_root = create_question_node("Does it live in water?");
+    g_root->yes = create_animal_node("Fish");
+    g_root->no = create_animal_node("Dog");
+    assert(save_tree("test.dat"));
+    assert(load_tree("test.dat"));
+    es_clear(&g_undo);
+    es_clear(&g_redo);
+    int dog = g_root->no->id;
+    
+    /* Wrong guess, then learn "Cat" */
+    GameSession g;
+    assert(game_start(&g));
+    assert(g.state == GAME_QUESTION);
+    assert(strcmp(game_text(&g), "Does it live in water?") == 0);
+    assert(game_answer(&g, 0));
+    assert(g.state == GAME_GUESS && strcmp(game_text(&g), "Dog") == 0);
+    assert(!game_learn(&g, "Cat", "Does it meow?", 1));  // Not lost yet
+    assert(game_answer(&g, 0));
+    assert(g.state == GAME_LOST);
+    assert(!game_learn(&g, "", "Does it meow?", 1));
+    assert(game_learn(&g, "Cat", "Does it meow?", 1));
+    assert(g.state == GAME_OVER && game_text(&g) == NULL);
+    assert(!game_answer(&g, 1));
+    
+    Node *meow = g_root->no;
+    assert(meow->isQuestion && strcmp(meow->text, "Does it meow?") == 0);
+    assert(strcmp(meow->yes->text, "Cat") == 0 && meow->no->id == dog);
+    assert(check_integrity());
+    assert(g_stats.leaves == 3 && g_stats.maxDepth == 2);
+    assert(h_contains(&g_index, "does_it_meow", meow->yes->id));
+    assert(h_contains(&g_index, "does_it_meow", dog));
+    assert(g_undo.size == 1 && g_redo.size == 0);
+    
+    /* The tree now knows the cat */
+    assert(game_start(&g));
+    game_answer(&g, 0);
+    game_answer(&g, 1);
+    assert(g.state == GAME_GUESS && strcmp(game_text(&g), "Cat") == 0);
+    assert(game_answer(&g, 1) && g.state == GAME_WON);
+    assert(!game_learn(&g, "Lion", "Does it roar?", 1));
+    
+    /* Engine edits undo and redo like any other */
+    assert(undo_last_edit());
+    assert(g_root->no->id == dog && g_stats.leaves == 2);
+    assert(!h_contains(&g_index, "does_it_meow", dog));
+    assert(redo_last_edit());
+    assert(g_root->no == meow && g_stats.leaves == 3);
+    
+    /* A session parked under a question that is then undone can't learn
+     * into the detached question, which still points at its leaf */
+    GameSession parked;
+    assert(game_start(&parked));
+    game_answer(&parked, 0);
+    game_answer(&parked, 0);
+    assert(parked.parent == meow && parked.current->id == dog);
+    assert(game_answer(&parked, 0) && parked.state == GAME_LOST);
+    assert(undo_last_edit());
+    assert(meow->no->id == dog);
+    assert(!game_learn(&parked, "Wolf", "Does it howl?", 1));
+    assert(meow->no->id == dog && g_root->no->id == dog);
+    assert(g_undo.size == 0 && g_redo.size == 1);
+    assert(check_integrity() && g_stats.leaves == 2);
+    
+    /* A session started after the undo learns normally */
+    assert(game_start(&parked));
+    game_answer(&parked, 0);
+    game_answer(&parked, 0);
+    assert(game_learn(&parked, "Wolf", "Does it howl?", 1));
+    assert(strcmp(g_root->no->text, "Does it howl?") == 0 && g_root->no->no->id == dog);
+    assert(g_redo.size == 0 && check_integrity());
+    
+    /* Sessions share the tree: learns made while another session sits
+     * on the same leaf move that leaf, and its learn follows it */
+    tree_release();
+    g_root = create_question_node("Does it live in water?");
+    g_root->yes = create_animal_node("Fish");
+    g_root->no = create_animal_node("Dog");
+    assert(save_tree("test.dat"));
+    assert(load_tree("test.dat"));
+    Node *dogLeaf = g_root->no;
+    GameSession s1, s2, s3;
+    GameSession *all[3] = {&s1, &s2, &s3};
+    for (int i = 0; i < 3; i++) {
+        game_start(all[i]);
+        game_answer(all[i], 0);
+        game_answer(all[i], 0);
+    }
+    assert(game_learn(&s1, "Cat", "Does it meow?", 1));
+    assert(game_start(&g));
+    game_answer(&g, 0);
+    game_answer(&g, 1);
+    game_answer(&g, 0);
+    assert(game_learn(&g, "Lion", "Does it roar?", 1));  // Splits Cat
+    assert(game_learn(&s2, "Cow", "Does it moo?", 0));  // Dog sits below Cat's split
+    assert(game_learn(&s3, "Horse", "Does it neigh?", 1));
+    assert(check_integrity());
+    assert(g_stats.leaves == 6);
+    Node *dogParent = g_root->no->no;  // meow -> no -> moo
+    assert(strcmp(dogParent->text, "Does it moo?") == 0);
+    assert(strcmp(dogParent->yes->text, "Does it neigh?") == 0);
+    assert(dogParent->yes->no == dogLeaf);
+    
+    /* A game lost on a snapshot from before those learns resumes on
+     * the leaf it guessed, wherever that hangs now */
+    unsigned char answers[2] = {0, 0};
+    assert(game_resume(&g, answers, 2, dogLeaf->id));
+    assert(g.state == GAME_LOST && g.current == dogLeaf);
+    assert(g.parent == dogParent->yes && g.parentAnswer == 0 && g.depth == 4);
+    assert(game_learn(&g, "Wolf", "Does it howl?", 1));
+    assert(dogParent->yes->no->no == dogLeaf && check_integrity());
+    assert(undo_last_edit() && dogParent->yes->no == dogLeaf);
+    answers[0] = 1;
+    assert(game_resume(&g, answers, 1, g_root->yes->id) && g.depth == 1);
+    assert(!game_resume(&g, answers, 2, g_root->yes->id));  // Past the leaf
+    assert(!game_resume(&g, answers, 1, dogLeaf->id) && g.state == GAME_OVER);
+    
+    /* Many sessions on random paths, each learning a new animal */
+    unsigned seed = 7;
+    char animal[32], question[32];
+    for (int i = 0; i < 1000; i++) {
+        assert(game_start(&g));
+        while (g.state == GAME_QUESTION) {
+            seed = seed * 1103515245u + 12345u;
+            game_answer(&g, (seed >> 16) & 1);
+        }
+        game_answer(&g, 0);
+        snprintf(animal, sizeof(animal), "Animal %d", i);
+        snprintf(question, sizeof(question), "Question %d?", i);
+        assert(game_learn(&g, animal, question, i & 1));
+    }
+    assert(check_integrity());
+    assert(g_stats.leaves == 1006 && g_stats.nodes == 2011);
+    int indexed = g_index.size;
+    index_rebuild();
+    assert(g_index.size == indexed);
+    
+    tree_release();
+    
+    /* A lone leaf: learning replaces the root */
+    g_root = create_animal_node("Fish");
+    assert(game_start(&g) && g.state == GAME_GUESS);
+    game_answer(&g, 0);
+    assert(game_learn(&g, "Dog", "Does it bark?", 1));
+    assert(g_root->isQuestion && strcmp(g_root->no->text, "Fish") == 0);
+    assert(undo_last_edit() && !g_root->isQuestion);
+    tree_release();
+    
+    /* No tree, no game */
+    g_root = NULL;
+    assert(!game_start(&g) && game_text(&g) == NULL);
+    
+    es_clear(&g_undo);
+    es_clear(&g_redo);
+    h_free(&g_index);
+    g_root = saved_root;
+    remove("test.dat");
+    printf("  ✓ Game engine tests passed\n");
+}
+
+void test_replay() {
+    printf("Testing Transcript Replay...\n");
+    
+    const char *transcripts =
+        "y\n"
+        "n\tCat\tDoes it meow?\ty\n"
+        "\n"
+        "N\tcat!\tDoes it meow?\ty\n"
+        "n\tCat\tDoes it meow?\ty\n"
+        "n\tCow\tDoes it moo?\ty\n"
+        "yy\n"
+        "x\n"
+        "n\tCat\n";
+    FILE *fp = fopen("test.txt", "w");
+    assert(fp != NULL);
+    fputs(transcripts, fp);
+    fclose(fp);
+    
+    /* One batch: every line resolves against the starting tree */
+    Node *saved_root = g_root;
+    g_root = create_question_node("Does it live in water?");
+    g_root->yes = create_animal_node("Fish");
+    g_root->no = create_animal_node("Dog");
+    assert(save_tree("test.dat"));
+    assert(load_tree("test.dat"));
+    
+    ReplayStats stats;
+    fp = fopen("test.txt", "r");
+    assert(replay_transcripts(fp, 100, &stats));
+    fclose(fp);
+    assert(stats.sessions == 8 && stats.resolved == 5 && stats.unresolved == 3);
+    assert(stats.corrections == 4 && stats.distinctCorrections == 2);
+    assert(stats.learned == 2);
+    
+    /* Cat once; Cow split Dog again under the Cat question */
+    Node *meow = g_root->no;
+    assert(strcmp(meow->text, "Does it meow?") == 0);
+    assert(strcmp(meow->yes->text, "Cat") == 0);
+    assert(strcmp(meow->no->text, "Does it moo?") == 0);
+    assert(strcmp(meow->no->yes->text, "Cow") == 0);
+    assert(strcmp(meow->no->no->text, "Dog") == 0);
+    assert(check_integrity());
+    assert(g_stats.leaves == 4 && g_stats.maxDepth == 3);
+    assert(h_contains(&g_index, "does_it_moo", meow->no->no->id));
+    
+    /* Batches of one: learning lengthens the path, so later copies of a
+     * correction no longer end at a leaf */
+    assert(load_tree("test.dat"));
+    fp = fopen("test.txt", "r");
+    assert(replay_transcripts(fp, 1, &stats));
+    fclose(fp);
+    assert(stats.learned == 1 && stats.unresolved == 6);
+    assert(g_stats.leaves == 3);
+    
+    fp = fopen("test.txt", "r");
+    assert(!replay_transcripts(fp, 0, &stats));
+    fclose(fp);
+    
+    tree_release();
+    h_free(&g_index);
+    g_root = saved_root;
+    remove("test.dat");
+    remove("test.txt");
+    printf("  ✓ Transcript replay tests passed\n");
+}
+
+typedef struct {
+    SnapshotStore *store;
+    int reader;
+    int *stop;
+    long walks;
+    int ok;
+} SnapReader;
+
+/* Walk random paths until told to stop; every walk must end at a leaf
+ * and versions must never go backwards */
+static void *snap_reader(void *arg) {
+    SnapReader *r = arg;
+    unsigned seed = 17 + r->reader;
+    unsigned char answers[64];
+    uint64_t lastVersion = 0;
+    r->ok = 1;
+    while (!__atomic_load_n(r->stop, __ATOMIC_ACQUIRE) || r->walks == 0) {
+        const Snapshot *snap = snap_enter(r->store, r->reader);
+        for (int a = 0; a < 64; a++) {
+            seed = seed * 1103515245u + 12345u;
+            answers[a] = (seed >> 16) & 1;
+        }
+        int leaf = flat_walk(&snap->tree, answers, 64);
+        if (leaf < 0 || FLAT_IS_QUESTION(&snap->tree, leaf) ||
+            snap->version < lastVersion) {
+            r->ok = 0;
+        }
+        lastVersion = snap->version;
+        snap_exit(r->store, r->reader);
+        r->walks++;
+    }
+    return NULL;
+}
+
+void test_snapshots() {
+    printf("Testing Snapshots...\n");
+    
+    Node *saved_root = g_root;
+    g_root = create_question_node("Does it live in water?");
+    g_root->yes = create_animal_node("Fish");
+    g_root->no = create_animal_node("Dog");
+    assert(save_tree("test.dat"));
+    assert(load_tree("test.dat"));
+    
+    SnapshotStore store;
+    assert(!snap_init(&store, 0));
+    assert(snap_init(&store, 4));
+    assert(snap_enter(&store, 0) == NULL);
+    snap_exit(&store, 0);
+    
+    assert(snap_publish(&store, g_root));
+    const Snapshot *first = snap_enter(&store, 0);
+    assert(first->version == 1 && first->tree.count == 3);
+    
+    /* A reader inside keeps its snapshot across publishes */
+    GameSession g;
+    game_start(&g);
+    game_answer(&g, 0);
+    game_answer(&g, 0);
+    assert(game_learn(&g, "Cat", "Does it meow?", 1));
+    assert(snap_publish(&store, g_root));
+    assert(store.retiredCount == 1);
+    assert(first->tree.count == 3);
+    const Snapshot *second = snap_enter(&store, 1);
+    assert(second->version == 2 && second->tree.count == 5);
+    unsigned char noYes[2] = {0, 1};
+    assert(strcmp(second->tree.strings +
+                  second->tree.textOffset[flat_walk(&second->tree, noYes, 2)], "Cat") == 0);
+    
+    /* Once both leave, the next publish frees everything retired */
+    snap_exit(&store, 0);
+    assert(snap_publish(&store, g_root));
+    assert(store.retiredCount == 1);  // second is still held by reader 1
+    snap_exit(&store, 1);
+    assert(snap_publish(&store, g_root));
+    assert(store.retiredCount == 0);
+    
+    /* Readers walking while the writer learns and publishes */
+    int stop = 0;
+    SnapReader readers[3];
+    pthread_t threads[3];
+    for (int i = 0; i < 3; i++) {
+        readers[i].store = &store;
+        readers[i].reader = i;
+        readers[i].stop = &stop;
+        readers[i].walks = 0;
+        assert(pthread_create(&threads[i], NULL, snap_reader, &readers[i]) == 0);
+    }
+    unsigned seed = 3;
+    char animal[32], question[32];
+    for (int i = 0; i < 300; i++) {
+        game_start(&g);
+        while (g.state == GAME_QUESTION) {
+            seed = seed * 1103515245u + 12345u;
+            game_answer(&g, (seed >> 16) & 1);
+        }
+        game_answer(&g, 0);
+        snprintf(animal, sizeof(animal), "Animal %d", i);
+        snprintf(question, sizeof(question), "Question %d?", i);
+        assert(game_learn(&g, animal, question, i & 1));
+        assert(snap_publish(&store, g_root));
+    }
+    __atomic_store_n(&stop, 1, __ATOMIC_RELEASE);
+    for (int i = 0; i < 3; i++) {
+        pthread_join(threads[i], NULL);
+        assert(readers[i].ok && readers[i].walks > 0);
+    }
+    assert(store.current->tree.count == g_stats.nodes);
+    assert(flat_check_integrity(&store.current->tree));
+    
+    snap_free(&store);
+    tree_release();
+    h_free(&g_index);
+    g_root = saved_root;
+    remove("test.dat");
+    printf("  ✓ Snapshot tests passed\n");
+}
+
+/* Same shape, IDs and text */
+static int flat_equal(const FlatTree *a, const FlatTree *b) {
+    return a->count == b->count && a->stringBytes == b->stringBytes &&
+           memcmp(a->children, b->children, 2 * a->count * sizeof(int32_t)) == 0 &&
+           memcmp(a->ids, b->ids, a->count * sizeof(int32_t)) == 0 &&
+           memcmp(a->questionBits, b->questionBits, (a->count + 63) / 64 * sizeof(uint64_t)) == 0 &&
+           memcmp(a->strings, b->strings, a->stringBytes) == 0;
+}
+
+/* Learn one animal along a pseudo-random path */
+static void learn_random(unsigned *seed, int i) {
+    GameSession g;
+    char animal[32], question[32];
+    game_start(&g);
+    while (g.state == GAME_QUESTION) {
+        *seed = *seed * 1103515245u + 12345u;
+        game_answer(&g, (*seed >> 16) & 1);
+    }
+    game_answer(&g, 0);
+    snprintf(animal, sizeof(animal), "Animal %d", i);
+    snprintf(question, sizeof(question), "Question %d?", i);
+    assert(game_learn(&g, animal, question, i & 1));
+}
+
+void test_journal() {
+    printf("Testing Learning Journal...\n");
+    
+    Node *saved_root = g_root;
+    remove("test.dat.journal");
+    remove("test.dat.journal.new");
+    g_root = create_question_node("Does it live in water?");
+    g_root->yes = create_animal_node("Fish");
+    g_root->no = create_animal_node("Dog");
+    assert(save_tree("test.dat"));
+    assert(load_tree("test.dat"));
+    
+    /* Learns, undos and redos are journaled without rewriting the tree */
+    struct stat before, after;
+    assert(journal_open("test.dat", 4, 0));
+    assert(stat("test.dat", &before) == 0);
+    unsigned seed = 5;
+    for (int i = 0; i < 50; i++) {
+        learn_random(&seed, i);
+    }
+    assert(undo_last_edit() && undo_last_edit());
+    assert(redo_last_edit());
+    journal_close();
+    assert(stat("test.dat", &after) == 0);
+    assert(before.st_size == after.st_size && before.st_ino == after.st_ino);
+    
+    FlatTree expected, got;
+    assert(flat_from_tree(&expected, g_root));
+    int undoSize = g_undo.size, redoSize = g_redo.size, nextId = g_nextId;
+    
+    /* load_tree replays it all, stacks included */
+    tree_release();
+    assert(load_tree("test.dat"));
+    assert(flat_from_tree(&got, g_root));
+    assert(flat_equal(&expected, &got));
+    assert(g_undo.size == undoSize && g_redo.size == redoSize && g_nextId == nextId);
+    assert(check_integrity() && g_stats.leaves == 2 + 49);
+    assert(redo_last_edit());  // The replayed redo stack is live
+    assert(undo_last_edit());
+    flat_free(&got);
+    
+    /* Reopening keeps appending; a torn last record is dropped */
+    assert(journal_open("test.dat", 1, 0));
+    learn_random(&seed, 50);
+    journal_close();
+    struct stat js;
+    assert(stat("test.dat.journal", &js) == 0);
+    assert(truncate("test.dat.journal", js.st_size - 3) == 0);
+    tree_release();
+    assert(load_tree("test.dat"));
+    assert(flat_from_tree(&got, g_root));
+    assert(flat_equal(&expected, &got));
+    flat_free(&got);
+    flat_free(&expected);
+    
+    /* Past the threshold the tree file is rewritten in the background
+     * and the journal starts over */
+    assert(journal_open("test.dat", 8, 4096));
+    for (int i = 100; i < 400; i++) {
+        learn_random(&seed, i);
+    }
+    assert(undo_last_edit());
+    journal_close();
+    long bytes, compactions;
+    journal_stats(&bytes, &compactions);
+    assert(access("test.dat.journal.new", F_OK) != 0 && access("test.dat.compact", F_OK) != 0);
+    assert(stat("test.dat.journal", &js) == 0 && js.st_size < 4096 + 1024);
+    assert(flat_from_tree(&expected, g_root));
+    nextId = g_nextId;
+    tree_release();
+    assert(load_tree("test.dat"));
+    assert(flat_from_tree(&got, g_root));
+    assert(flat_equal(&expected, &got) && g_nextId == nextId);
+    flat_free(&got);
+    flat_free(&expected);
+    
+    /* A checkpoint leaves an empty journal that still matches */
+    assert(journal_open("test.dat", 8, 0));
+    learn_random(&seed, 1000);
+    assert(journal_checkpoint());
+    journal_close();
+    assert(stat("test.dat.journal", &js) == 0 && js.st_size == 24);
+    assert(flat_from_tree(&expected, g_root));
+    tree_release();
+    assert(load_tree("test.dat"));
+    assert(flat_from_tree(&got, g_root));
+    assert(flat_equal(&expected, &got));
+    flat_free(&got);
+    flat_free(&expected);
+    
+    /* Crash during a compaction: before the tree file moves, .journal
+     * still extends it; after, .journal.new does, and loading finishes
+     * the handoff */
+    long treeSize, journalSize, newSize, size;
+    FlatTree beforeCompaction;
+    assert(journal_open("test.dat", 1, 0));
+    learn_random(&seed, 1002);
+    journal_close();
+    assert(flat_from_tree(&beforeCompaction, g_root));
+    char *oldTree = read_file("test.dat", &treeSize);
+    char *oldJournal = read_file("test.dat.journal", &journalSize);
+    assert(journal_open("test.dat", 1, 0));
+    learn_random(&seed, 1003);
+    assert(journal_checkpoint());
+    learn_random(&seed, 1004);  /* lands in the new journal */
+    journal_close();
+    assert(flat_from_tree(&expected, g_root));
+    char *newJournal = read_file("test.dat.journal", &newSize);
+    assert(newSize > 24);
+    write_file("test.dat.journal", oldJournal, journalSize);  /* moved tree only */
+    write_file("test.dat.journal.new", newJournal, newSize);
+    tree_release();
+    assert(load_tree("test.dat"));
+    assert(flat_from_tree(&got, g_root));
+    assert(flat_equal(&expected, &got));
+    flat_free(&got);
+    assert(access("test.dat.journal.new", F_OK) != 0);
+    free(read_file("test.dat.journal", &size));
+    assert(size == newSize);
+    write_file("test.dat", oldTree, treeSize);  /* nothing moved yet */
+    write_file("test.dat.journal", oldJournal, journalSize);
+    write_file("test.dat.journal.new", newJournal, newSize);
+    tree_release();
+    assert(load_tree("test.dat"));
+    assert(flat_from_tree(&got, g_root));
+    assert(flat_equal(&beforeCompaction, &got));
+    flat_free(&got);
+    flat_free(&beforeCompaction);
+    assert(journal_open("test.dat", 1, 0));  /* appends; drops the stale .journal.new */
+    assert(access("test.dat.journal.new", F_OK) != 0);
+    journal_close();
+    free(oldTree);
+    free(oldJournal);
+    free(newJournal);
+    flat_free(&expected);
+    
+    /* Opening a journal on a tree just loaded without one doesn't
+     * rewrite the tree file */
+    assert(save_tree("test.dat"));
+    remove("test.dat.journal");
+    assert(load_tree("test.dat"));
+    assert(stat("test.dat", &before) == 0);
+    assert(journal_open("test.dat", 1, 0));
+    learn_random(&seed, 1005);
+    journal_close();
+    assert(stat("test.dat", &after) == 0 && before.st_ino == after.st_ino);
+    assert(flat_from_tree(&expected, g_root));
+    tree_release();
+    assert(load_tree("test.dat"));
+    assert(flat_from_tree(&got, g_root));
+    assert(flat_equal(&expected, &got));
+    flat_free(&got);
+    flat_free(&expected);
+    /* ...but an edited one is saved first */
+    learn_random(&seed, 1006);
+    remove("test.dat.journal");
+    assert(journal_open("test.dat", 1, 0));
+    journal_close();
+    assert(stat("test.dat", &after) == 0 && before.st_ino != after.st_ino);
+    
+    /* A journal from before a newer save is ignored */
+    assert(journal_open("test.dat", 1, 0));
+    learn_random(&seed, 1001);
+    journal_close();
+    tree_release();
+    g_root = create_animal_node("Fish");
+    assert(save_tree("test.dat"));
+    assert(load_tree("test.dat"));
+    assert(g_stats.leaves == 1);
+    
+    tree_release();
+    h_free(&g_index);
+    g_root = saved_root;
+    remove("test.dat");
+    remove("test.dat.journal");
+    printf("  ✓ Journal tests passed\n");
+}
+
+/* Start ./animal_server on test.sock serving tree, with file writes
+ * capped at fileLimit bytes (0: no cap) and in reader mode with threads
+ * workers (0: single-threaded), and connect to it
+ */
+static pid_t server_start(const char *tree, long fileLimit, const char *threads, int *outFd) {
+    remove("test.sock");
+    fflush(stdout);
+    pid_t pid = fork();
+    assert(pid >= 0);
+    if (pid == 0) {
+        if (fileLimit > 0) {
+            struct rlimit lim = {(rlim_t)fileLimit, (rlim_t)fileLimit};
+            setrlimit(RLIMIT_FSIZE, &lim);
+            signal(SIGXFSZ, SIG_IGN);  // Failed writes return EFBIG instead
+        }
+        freopen("/dev/null", "w", stdout);
+        freopen("/dev/null", "w", stderr);
+        if (threads != NULL) {
+            execl("./animal_server", "animal_server", "-u", "test.sock", "-f", tree,
+                  "-t", threads, (char*)NULL);
+        }
+        execl("./animal_server", "animal_server", "-u", "test.sock", "-f", tree, (char*)NULL);
+        _exit(127);
+    }
+    struct sockaddr_un addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sun_family = AF_UNIX;
+    strcpy(addr.sun_path, "test.sock");
+    for (int tries = 0; tries < 500; tries++) {
+        int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+        assert(fd >= 0);
+        if (connect(fd, (struct sockaddr*)&addr, sizeof(addr)) == 0) {
+            *outFd = fd;
+            return pid;
+        }
+        close(fd);
+        struct timespec pause = {0, 10000000};  // 10 ms
+        nanosleep(&pause, NULL);
+    }
+    assert(0 && "animal_server did not start");
+    return -1;
+}
+
+/* Send one command and read one reply line; returns 0 at end of stream */
+static int server_ask(int fd, const char *command, char *line, int size) {
+    assert(write(fd, command, strlen(command)) == (ssize_t)strlen(command));
+    int len = 0;
+    while (len < size - 1) {
+        ssize_t n = read(fd, line + len, 1);
+        if (n <= 0) {
+            break;
+        }
+        if (line[len] == '\n') {
+            line[len] = '\0';
+            return 1;
+        }
+        len++;
+    }
+    line[len] = '\0';
+    return 0;
+}
+
+/* Test that animal_server acknowledges a learn only once it is synced */
+void test_server_journal() {
+    printf("Testing Server Journal Sync...\n");
+    
+    Node *saved_root = g_root;
+    remove("test_server.dat.journal");
+    g_root = create_question_node("Does it live in water?");
+    g_root->yes = create_animal_node("Fish");
+    g_root->no = create_animal_node("Dog");
+    assert(save_tree("test_server.dat"));
+    tree_release();
+    g_root = saved_root;
+    struct stat st;
+    assert(stat("test_server.dat", &st) == 0);
+    long treeBytes = (long)st.st_size;
+    
+    /* A question longer than the tree file makes its journal record
+     * the first write past a cap that still lets the server start */
+    char question[400], learn[480], line[256];
+    memset(question, 'q', 300);
+    strcpy(question + 300, "?");
+    snprintf(learn, sizeof(learn), "LEARN Cat\t%s\ty\nNEW\n", question);
+    
+    /* When LEARNED arrives the record is already in the journal, and
+     * the line sent behind the learn is answered after it */
+    int fd;
+    pid_t pid = server_start("test_server.dat", 0, NULL, &fd);
+    assert(server_ask(fd, "NEW\n", line, sizeof(line)) && strncmp(line, "ASK ", 4) == 0);
+    assert(server_ask(fd, "ANSWER n\n", line, sizeof(line)) && strcmp(line, "GUESS Dog") == 0);
+    assert(server_ask(fd, "ANSWER n\n", line, sizeof(line)) && strcmp(line, "LOST") == 0);
+    assert(stat("test_server.dat.journal", &st) == 0);
+    long journalBytes = (long)st.st_size;
+    assert(server_ask(fd, learn, line, sizeof(line)) && strcmp(line, "LEARNED") == 0);
+    assert(stat("test_server.dat.journal", &st) == 0);
+    assert((long)st.st_size > journalBytes + 300);
+    assert(server_ask(fd, "", line, sizeof(line)) && strncmp(line, "ASK ", 4) == 0);
+    close(fd);
+    int status;
+    kill(pid, SIGTERM);
+    assert(waitpid(pid, &status, 0) == pid && WIFEXITED(status) && WEXITSTATUS(status) == 0);
+    
+    /* If the sync fails the learn is never acknowledged: the server
+     * stops without sending LEARNED */
+    remove("test_server.dat.journal");
+    g_root = create_question_node("Does it live in water?");
+    g_root->yes = create_animal_node("Fish");
+    g_root->no = create_animal_node("Dog");
+    assert(save_tree("test_server.dat"));
+    tree_release();
+    g_root = saved_root;
+    pid = server_start("test_server.dat", treeBytes, NULL, &fd);
+    assert(server_ask(fd, "NEW\n", line, sizeof(line)));
+    assert(server_ask(fd, "ANSWER n\n", line, sizeof(line)));
+    assert(server_ask(fd, "ANSWER n\n", line, sizeof(line)) && strcmp(line, "LOST") == 0);
+    assert(!server_ask(fd, learn, line, sizeof(line)) && line[0] == '\0');
+    close(fd);
+    assert(waitpid(pid, &status, 0) == pid && WIFEXITED(status) && WEXITSTATUS(status) != 0);
+    
+    remove("test_server.dat");
+    remove("test_server.dat.journal");
+    remove("test_server.dat.journal.new");
+    remove("test.sock");
+    printf("  ✓ Server journal sync tests passed\n");
+}
+
+/* Test animal_server's reader mode: games are played on snapshots by
+ * worker threads, and a learn is published before it is acknowledged
+ */
+void test_server_readers() {
+    printf("Testing Server Reader Mode...\n");
+    
+    Node *saved_root = g_root;
+    remove("test_server.dat.journal");
+    g_root = create_question_node("Does it live in water?");
+    g_root->yes = create_animal_node("Fish");
+    g_root->no = create_animal_node("Dog");
+    assert(save_tree("test_server.dat"));
+    tree_release();
+    g_root = saved_root;
+    
+    /* Two connections land on different workers. The second guesses Dog
+     * on the snapshot from before the first one's learn */
+    int fd, other;
+    char line[256];
+    pid_t pid = server_start("test_server.dat", 0, "2", &fd);
+    struct sockaddr_un addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sun_family = AF_UNIX;
+    strcpy(addr.sun_path, "test.sock");
+    other = socket(AF_UNIX, SOCK_STREAM, 0);
+    assert(other >= 0 && connect(other, (struct sockaddr*)&addr, sizeof(addr)) == 0);
+    assert(server_ask(other, "NEW\n", line, sizeof(line)) && strncmp(line, "ASK ", 4) == 0);
+    assert(server_ask(other, "ANSWER n\n", line, sizeof(line)) && strcmp(line, "GUESS Dog") == 0);
+    assert(server_ask(fd, "NEW\n", line, sizeof(line)) && strncmp(line, "ASK ", 4) == 0);
+    assert(server_ask(fd, "ANSWER n\n", line, sizeof(line)) && strcmp(line, "GUESS Dog") == 0);
+    assert(server_ask(fd, "LEARN Cat\tDoes it meow?\ty\n", line, sizeof(line)) &&
+           strcmp(line, "ERR cannot learn now") == 0);  // Not lost yet
+    assert(server_ask(fd, "ANSWER n\n", line, sizeof(line)) && strcmp(line, "LOST") == 0);
+    assert(server_ask(fd, "LEARN Cat\tDoes it meow?\ty\n", line, sizeof(line)) &&
+           strcmp(line, "LEARNED") == 0);
+    
+    /* Once LEARNED arrives every worker plays the new snapshot */
+    assert(server_ask(fd, "NEW\n", line, sizeof(line)));
+    assert(server_ask(fd, "ANSWER n\n", line, sizeof(line)) && strcmp(line, "ASK Does it meow?") == 0);
+    assert(server_ask(fd, "ANSWER y\n", line, sizeof(line)) && strcmp(line, "GUESS Cat") == 0);
+    assert(server_ask(fd, "ANSWER y\n", line, sizeof(line)) && strcmp(line, "WON") == 0);
+    assert(server_ask(fd, "ANSWER y\n", line, sizeof(line)) && strcmp(line, "ERR nothing asked") == 0);
+    
+    /* The older game's learn follows Dog below the cat's question */
+    assert(server_ask(other, "ANSWER n\n", line, sizeof(line)) && strcmp(line, "LOST") == 0);
+    assert(server_ask(other, "LEARN Cow\tDoes it moo?\ty\n", line, sizeof(line)) &&
+           strcmp(line, "LEARNED") == 0);
+    assert(server_ask(other, "NEW\n", line, sizeof(line)));
+    assert(server_ask(other, "ANSWER n\n", line, sizeof(line)));
+    assert(server_ask(other, "ANSWER n\n", line, sizeof(line)) && strcmp(line, "ASK Does it moo?") == 0);
+    close(other);
+    close(fd);
+    int status;
+    kill(pid, SIGTERM);
+    assert(waitpid(pid, &status, 0) == pid && WIFEXITED(status) && WEXITSTATUS(status) == 0);
+    
+    /* Both learns reached the tree file */
+    assert(load_tree("test_server.dat"));
+    assert(check_integrity() && g_stats.leaves == 4);
+    assert(strcmp(g_root->no->text, "Does it meow?") == 0);
+    assert(strcmp(g_root->no->no->text, "Does it moo?") == 0);
+    assert(strcmp(g_root->no->no->no->text, "Dog") == 0);
+    
+    tree_release();
+    h_free(&g_index);
+    g_root = saved_root;
+    remove("test_server.dat");
+    remove("test_server.dat.journal");
+    remove("test.sock");
+    printf("  ✓ Server reader mode tests passed\n");
+}
+
+/* Run find_shortest_path with stdout sent to a file; returns its first line */
+static void shortest_path_line(const char *a, const char *b, char *line, int size) {
+    fflush(stdout);
+    int saved = dup(1);
+    FILE *f = fopen("test.out", "w+");
+    assert(f != NULL && saved >= 0);
+    dup2(fileno(f), 1);
+    find_shortest_path(a, b);
+    fflush(stdout);
+    dup2(saved, 1);
+    close(saved);
+    rewind(f);
+    assert(fgets(line, size, f) != NULL);
+    fclose(f);
+    remove("test.out");
+}
+
+/* Test the path index: LCA, distinguishing questions and rebuilds */
+void test_path_index() {
+    printf("Testing Path Index...\n");
+    
+    Node *saved_root = g_root;
+    g_root = create_question_node("Does it live in water?");
+    g_root->yes = create_question_node("Does it have fins?");
+    g_root->yes->yes = create_animal_node("Fish");
+    g_root->yes->no = create_animal_node("Frog");
+    g_root->no = create_question_node("Does it meow?");
+    g_root->no->yes = create_animal_node("Cat");
+    g_root->no->no = create_animal_node("Dog");
+    
+    PathIndex pi;
+    assert(path_index_build(&pi, g_root));
+    assert(pi.count == 7 && pi.nodes[0] == g_root && pi.nodes[1] == g_root->yes);
+    assert(path_find(&pi, "Dog") == 6 && path_find(&pi, "Horse") == -1);
+    assert(path_lca(&pi, 2, 3) == 1 && path_lca(&pi, 3, 5) == 0 && path_lca(&pi, 1, 3) == 1);
+    
+    /* Split question first, then each side top down */
+    PathStep steps[8];
+    assert(path_between(&pi, "Fish", "Cat", steps, 8) == 3);
+    assert(steps[0].question == g_root && steps[0].answer == 1 && steps[0].side == 0);
+    assert(steps[1].question == g_root->yes && steps[1].answer == 1 && steps[1].side == 1);
+    assert(steps[2].question == g_root->no && steps[2].answer == 1 && steps[2].side == 2);
+    assert(path_between(&pi, "Dog", "Cat", steps, 8) == 1);
+    assert(steps[0].question == g_root->no && steps[0].answer == 0);
+    assert(path_between(&pi, "Cat", "Cat", steps, 8) == 0);
+    assert(path_between(&pi, "Cat", "Horse", steps, 8) == -1);
+    assert(path_between(&pi, "Frog", "Dog", steps, 1) == 3);  // Only steps[0] written
+    assert(steps[0].question == g_root && steps[0].answer == 1);
+    path_index_free(&pi);
+    
+    /* On a learned tree, every LCA matches walking up the parent links */
+    assert(save_tree("test.dat"));
+    assert(load_tree("test.dat"));
+    unsigned seed = 11;
+    for (int i = 0; i < 5000; i++) {
+        learn_random(&seed, i);
+    }
+    assert(path_index_build(&pi, g_root));
+    assert(pi.count == count_nodes(g_root) && pi.blocks > 64);
+    srand(25);
+    for (int iter = 0; iter < 20000; iter++) {
+        int u = rand() % pi.count;
+        int v = rand() % pi.count;
+        int a = u, b = v;
+        while (pi.depth[a] > pi.depth[b]) a = pi.parent[a];
+        while (pi.depth[b] > pi.depth[a]) b = pi.parent[b];
+        while (a != b) {
+            a = pi.parent[a];
+            b = pi.parent[b];
+        }
+        assert(path_lca(&pi, u, v) == a);
+    }
+    char a1[32], a2[32];
+    for (int iter = 0; iter < 2000; iter++) {
+        snprintf(a1, sizeof(a1), "Animal %d", rand() % 5000);
+        snprintf(a2, sizeof(a2), "Animal %d", rand() % 5000);
+        int u = path_find(&pi, a1), v = path_find(&pi, a2);
+        int lca = path_lca(&pi, u, v);
+        int count = path_between(&pi, a1, a2, NULL, 0);
+        assert(u == v ? count == 0 : count == pi.depth[u] + pi.depth[v] - 2 * pi.depth[lca] - 1);
+    }
+    path_index_free(&pi);
+    
+    /* find_shortest_path follows the tree as it is edited */
+    char line[256];
+    shortest_path_line("Animal 4999", "Fish", line, sizeof(line));
+    assert(strstr(line, "differ at") != NULL);
+    shortest_path_line("Animal 5000", "Fish", line, sizeof(line));
+    assert(strstr(line, "Unknown animal: Animal 5000") != NULL);
+    learn_random(&seed, 5000);
+    shortest_path_line("Animal 5000", "Fish", line, sizeof(line));
+    assert(strstr(line, "differ at") != NULL);
+    assert(undo_last_edit());
+    shortest_path_line("Animal 5000", "Fish", line, sizeof(line));
+    assert(strstr(line, "Unknown animal") != NULL);
+    
+    tree_release();
+    g_root = saved_root;
+    remove("test.dat");
+    printf("  ✓ Path index tests passed\n");
+}
+
 int main() {
     printf("\n=== Running Unit Tests ===\n\n");
     
     test_nodes();
+    test_pool();
     test_stack();
     test_edit_stack();
     test_queue();
     test_canonicalize();
     test_hash();
     test_persistence();
+    test_file_versions();
+    test_crc32c();
+    test_bulk_io();
+    test_lz_codec();
+    test_persistence_fuzz();
+    test_index();
+    test_stable_ids();
+    test_stats();
     test_integrity();
+    test_flat_tree();
+    test_deep_chain();
+    test_game_engine();
+    test_replay();
+    test_snapshots();
+    test_journal();
+    test_server_journal();
+    test_server_readers();
+    test_path_index();
     
     printf("\n=== All Tests Passed! ===\n\n");
     printf("Great job! Your implementations are working correctly.\n");
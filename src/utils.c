@@ -58,8 +58,10 @@ int check_integrity() {
                 break;  // Stop checking once we find an error
             }
             // Valid question node - enqueue both children for checking
-            q_enqueue(&q, node->yes, id * 2 + 1);  // Left child gets odd ID
-            q_enqueue(&q, node->no, id * 2 + 2);   // Right child gets even ID
+            // (heap-style id*2+1 numbering would overflow on deep chains,
+            // and nothing reads the ids, so they just carry depth)
+            q_enqueue(&q, node->yes, id + 1);
+            q_enqueue(&q, node->no, id + 1);
         }
         else {
             // Leaf nodes (animals) must NOT have any children
@@ -77,36 +79,495 @@ int check_integrity() {
     return valid;  // Return 1 if valid, 0 if invalid
 }
 
-typedef struct PathNode {
-    Node *treeNode;
-    struct PathNode *parent;
-    int viaYes;  /* 1 if reached via yes, 0 if via no, -1 for root */
-} PathNode;
+/* ========== Path Index ========== */
+
+/* Whichever of preorder indices a and b is shallower (a on ties) */
+static int path_shallower(const PathIndex *pi, int a, int b) {
+    return pi->depth[b] < pi->depth[a] ? b : a;
+}
+
+/* Index the tree under root: one preorder pass records parents, depths
+ * and each animal's first leaf, then the block sparse table is filled.
+ * Returns 1 on success, 0 on allocation failure (pi is left empty).
+ */
+int path_index_build(PathIndex *pi, Node *root) {
+    memset(pi, 0, sizeof(*pi));
+    st_init(&pi->animals);
+    if (root == NULL) {
+        return 1;
+    }
+    
+    int n = count_nodes(root);
+    pi->nodes = malloc(n * sizeof(Node*));
+    pi->parent = malloc(n * sizeof(int));
+    pi->depth = malloc(n * sizeof(int));
+    pi->prefixMin = malloc(n * sizeof(int));
+    pi->suffixMin = malloc(n * sizeof(int));
+    Node **stackNodes = malloc(n * sizeof(Node*));
+    int *stackParents = malloc(n * sizeof(int));
+    int ok = pi->nodes && pi->parent && pi->depth && pi->prefixMin && pi->suffixMin &&
+             stackNodes && stackParents;
+    
+    // Preorder with an explicit stack (yes pushed last, so visited first)
+    int top = 0;
+    if (ok) {
+        stackNodes[top] = root;
+        stackParents[top++] = -1;
+    }
+    while (ok && top > 0) {
+        top--;
+        Node *node = stackNodes[top];
+        int p = stackParents[top];
+        int i = pi->count++;
+        pi->nodes[i] = node;
+        pi->parent[i] = p;
+        pi->depth[i] = p < 0 ? 0 : pi->depth[p] + 1;
+        if (!node->isQuestion && st_find(&pi->animals, node->text) < 0) {
+            ok = st_add(&pi->animals, node->text, i);
+        }
+        if (node->no != NULL) {
+            stackNodes[top] = node->no;
+            stackParents[top++] = i;
+        }
+        if (node->yes != NULL) {
+            stackNodes[top] = node->yes;
+            stackParents[top++] = i;
+        }
+    }
+    free(stackNodes);
+    free(stackParents);
+    
+    // Minima within each block, then level 0 of the sparse table is each
+    // block's shallowest node and level k covers 2^k blocks
+    if (ok) {
+        pi->blocks = (n + PATH_BLOCK - 1) / PATH_BLOCK;
+        pi->levels = 1;
+        while ((1 << pi->levels) <= pi->blocks) {
+            pi->levels++;
+        }
+        pi->blockMin = malloc((size_t)pi->levels * pi->blocks * sizeof(int));
+        ok = pi->blockMin != NULL;
+    }
+    if (ok) {
+        for (int i = 0; i < n; i++) {
+            pi->prefixMin[i] = (i % PATH_BLOCK == 0) ? i : path_shallower(pi, pi->prefixMin[i - 1], i);
+        }
+        for (int i = n - 1; i >= 0; i--) {
+            int last = (i % PATH_BLOCK == PATH_BLOCK - 1) || i == n - 1;
+            pi->suffixMin[i] = last ? i : path_shallower(pi, i, pi->suffixMin[i + 1]);
+        }
+        for (int b = 0; b < pi->blocks; b++) {
+            pi->blockMin[b] = pi->suffixMin[b * PATH_BLOCK];
+        }
+        for (int k = 1; k < pi->levels; k++) {
+            int *prev = pi->blockMin + (size_t)(k - 1) * pi->blocks;
+            int *row = pi->blockMin + (size_t)k * pi->blocks;
+            for (int b = 0; b + (1 << k) <= pi->blocks; b++) {
+                row[b] = path_shallower(pi, prev[b], prev[b + (1 << (k - 1))]);
+            }
+        }
+    }
+    if (!ok) {
+        path_index_free(pi);
+    }
+    return ok;
+}
+
+void path_index_free(PathIndex *pi) {
+    free(pi->nodes);
+    free(pi->parent);
+    free(pi->depth);
+    free(pi->prefixMin);
+    free(pi->suffixMin);
+    free(pi->blockMin);
+    st_free(&pi->animals);
+    memset(pi, 0, sizeof(*pi));
+}
+
+/* Preorder index of the first leaf holding animal, or -1 */
+int path_find(const PathIndex *pi, const char *animal) {
+    long slot = st_find(&pi->animals, animal);
+    return slot < 0 ? -1 : pi->animals.values[slot];
+}
+
+/* Lowest common ancestor of preorder indices u and v. Every node after u
+ * and up to v lies below the LCA, and the shallowest of them is one of
+ * its children. Within one block that range is scanned (under PATH_BLOCK
+ * nodes); otherwise its ends come from the block minima and the middle
+ * from two overlapping sparse-table entries.
+ */
+int path_lca(const PathIndex *pi, int u, int v) {
+    if (u == v) {
+        return u;
+    }
+    if (u > v) {
+        int t = u;
+        u = v;
+        v = t;
+    }
+    int l = u + 1;
+    int best = l;
+    int bl = l / PATH_BLOCK;
+    int br = v / PATH_BLOCK;
+    if (bl == br) {
+        for (int i = l + 1; i <= v; i++) {
+            best = path_shallower(pi, best, i);
+        }
+        return pi->parent[best];
+    }
+    best = path_shallower(pi, pi->suffixMin[l], pi->prefixMin[v]);
+    if (bl + 1 < br) {
+        int span = br - bl - 1;
+        int k = 31 - __builtin_clz((unsigned)span);
+        const int *row = pi->blockMin + (size_t)k * pi->blocks;
+        best = path_shallower(pi, best, row[bl + 1]);
+        best = path_shallower(pi, best, row[br - (1 << k)]);
+    }
+    return pi->parent[best];
+}
+
+/* Questions on the path strictly between leaf and its ancestor lca, top
+ * down, into steps[first...] (as far as cap allows)
+ */
+static void path_side(const PathIndex *pi, int leaf, int lca, int side, PathStep *steps,
+                      int first, int cap) {
+    int x = leaf;
+    for (int p = pi->parent[x]; p != lca; x = p, p = pi->parent[p]) {
+        int at = first + pi->depth[p] - pi->depth[lca] - 1;
+        if (at < cap) {
+            steps[at].question = pi->nodes[p];
+            steps[at].answer = pi->nodes[p]->yes == pi->nodes[x];
+            steps[at].side = side;
+        }
+    }
+}
+
+/* The questions between animal1 and animal2: steps[0] is the question
+ * that splits them (answered as animal1 would), followed by the questions
+ * below it toward animal1 (side 1) and then toward animal2 (side 2), each
+ * top down. Fills at most cap steps and returns how many there are, 0 if
+ * both name the same leaf, or -1 if either animal isn't in the tree.
+ * The count and the split (cap 1) are O(1); listing the rest of the path
+ * is O(its length).
+ */
+int path_between(const PathIndex *pi, const char *animal1, const char *animal2,
+                 PathStep *steps, int cap) {
+    int a = path_find(pi, animal1);
+    int b = path_find(pi, animal2);
+    if (a < 0 || b < 0) {
+        return -1;
+    }
+    if (a == b) {
+        return 0;
+    }
+    int lca = path_lca(pi, a, b);
+    int down1 = pi->depth[a] - pi->depth[lca] - 1;
+    int down2 = pi->depth[b] - pi->depth[lca] - 1;
+    if (cap > 0) {
+        // Preorder visits the yes subtree first, so animal1 answered yes
+        // exactly when its leaf comes before animal2's
+        steps[0].question = pi->nodes[lca];
+        steps[0].answer = a < b;
+        steps[0].side = 0;
+    }
+    if (cap > 1) {
+        path_side(pi, a, lca, 1, steps, 1, cap);
+        path_side(pi, b, lca, 2, steps, 1 + down1, cap);
+    }
+    return 1 + down1 + down2;
+}
+
+/* The index find_shortest_path queries, rebuilt when g_root is replaced
+ * or edited: index_rebuild and the split hooks count tree versions.
+ */
+static PathIndex g_paths;
+static const Node *g_pathsRoot = NULL;
+static unsigned long g_treeVersion = 1;
+static unsigned long g_pathsVersion = 0;
+
+/* Counts index_rebuild and index_revert_split calls, the two ways nodes
+ * leave the tree (replaced wholesale, or a split unlinked)
+ */
+static unsigned long g_unlinkEpoch = 1;
+
+unsigned long tree_unlink_epoch() {
+    return g_unlinkEpoch;
+}
+
+static const PathIndex *current_paths() {
+    if (g_pathsVersion != g_treeVersion || g_pathsRoot != g_root) {
+        path_index_free(&g_paths);
+        g_pathsVersion = 0;
+        if (!path_index_build(&g_paths, g_root)) {
+            return NULL;
+        }
+        g_pathsRoot = g_root;
+        g_pathsVersion = g_treeVersion;
+    }
+    return &g_paths;
+}
 
 /* TODO 30: Implement find_shortest_path (OPTIONAL CHALLENGE)
- * Find the shortest distinguishing path between two animals
- * 
- * This is an optional challenge problem. If you want to attempt it:
+ * Print the questions that distinguish two animals
  * 
  * Steps:
- * 1. Use BFS to find paths to both animals
- * 2. Build PathNode structures that track parent and direction
- * 3. Build arrays of PathNodes from each animal to root
- * 4. Find the Lowest Common Ancestor (LCA)
- * 5. Print the questions that distinguish them
- * 
- * Algorithm:
- * - Use BFS with a PathNode array to track the path taken
- * - For each node visited, record its parent and which branch (yes/no)
- * - Once both animals are found, trace back to root for each
- * - Find where the paths diverge (LCA)
- * - Print the distinguishing questions from LCA to each animal
+ * 1. Return if g_root is NULL
+ * 2. Get the path index for the current tree (built once per version)
+ * 3. Look up both animals and their lowest common ancestor: the
+ *    question where their answers part
+ * 4. Print that question with each animal's answer, then the remaining
+ *    questions on each side down to the animal
  */
 void find_shortest_path(const char *animal1, const char *animal2) {
     if (g_root == NULL) return;
     
-    // TODO: Implement this function (OPTIONAL CHALLENGE)
-    // This is complex and requires careful path tracking
+    const PathIndex *pi = current_paths();
+    if (pi == NULL) {
+        printf("find_shortest_path: out of memory\n");
+        return;
+    }
     
-    printf("find_shortest_path not yet implemented\n");
-}
\ No newline at end of file
+    PathStep local[64];
+    PathStep *steps = local;
+    int count = path_between(pi, animal1, animal2, steps, 64);
+    if (count > 64) {
+        steps = malloc(count * sizeof(PathStep));
+        if (steps == NULL) {
+            printf("find_shortest_path: out of memory\n");
+            return;
+        }
+        path_between(pi, animal1, animal2, steps, count);
+    }
+    
+    if (count < 0) {
+        printf("Unknown animal: %s\n", path_find(pi, animal1) < 0 ? animal1 : animal2);
+    } else if (count == 0) {
+        printf("%s and %s are the same animal\n", animal1, animal2);
+    } else {
+        printf("%s and %s differ at: %s (%s: %s, %s: %s)\n", animal1, animal2,
+               steps[0].question->text, animal1, steps[0].answer ? "yes" : "no",
+               animal2, steps[0].answer ? "no" : "yes");
+        for (int i = 1; i < count; i++) {
+            printf("  %s: %s %s\n", steps[i].side == 1 ? animal1 : animal2,
+                   steps[i].question->text, steps[i].answer ? "yes" : "no");
+        }
+    }
+    if (steps != local) {
+        free(steps);
+    }
+}
+
+/* ========== Question Index Maintenance ========== */
+
+/* g_index maps each canonicalized question to the IDs of the animals it
+ * directly distinguishes (its leaf children). That is exactly what a
+ * learning split changes, so the index can be kept current edit by edit
+ * and rebuilt from the tree alone after a load.
+ */
+
+/* Canonical keys are built in a caller's stack buffer when they fit, so
+ * a bulk rebuild doesn't malloc and free once per leaf. Returns buf, or
+ * a malloc'd key for very long questions (release with index_key_done).
+ */
+#define INDEX_KEY_BUF 256
+
+static char *index_key(const char *question, char *buf)
+{
+    if (strlen(question) < INDEX_KEY_BUF) {
+        canonicalize_into(question, buf);
+        return buf;
+    }
+    return canonicalize(question);
+}
+
+static void index_key_done(char *key, char *buf)
+{
+    if (key != buf) {
+        free(key);
+    }
+}
+
+/* Add (question, leaf->id) if leaf is an animal. unique is set when the
+ * caller knows the pair can't already be present (every leaf has one
+ * parent), which lets a bulk rebuild skip the duplicate scan.
+ */
+static void index_put_leaf(const char *question, const Node *leaf, int unique)
+{
+    if (leaf != NULL && !leaf->isQuestion) {
+        char buf[INDEX_KEY_BUF];
+        char *key = index_key(question, buf);
+        if (unique) {
+            h_add(&g_index, key, leaf->id);
+        } else {
+            h_put(&g_index, key, leaf->id);
+        }
+        index_key_done(key, buf);
+    }
+}
+
+static void index_remove_leaf(const char *question, const Node *leaf)
+{
+    if (leaf != NULL && !leaf->isQuestion) {
+        char buf[INDEX_KEY_BUF];
+        char *key = index_key(question, buf);
+        h_remove(&g_index, key, leaf->id);
+        index_key_done(key, buf);
+    }
+}
+
+/* Rebuild g_index from g_root in a single BFS pass */
+void index_rebuild() {
+    g_treeVersion++;
+    g_unlinkEpoch++;
+    h_free(&g_index);
+    h_init_seeded(&g_index, 31, g_index.seed);  // h_free keeps the seed
+    if (g_root == NULL) {
+        return;
+    }
+    
+    Queue q;
+    q_init(&q);
+    q_enqueue(&q, g_root, 0);
+    
+    while (!q_empty(&q)) {
+        Node *node;
+        int id;
+        q_dequeue(&q, &node, &id);
+        
+        if (node->isQuestion) {
+            // Index the animals this question tells apart, then descend
+            index_put_leaf(node->text, node->yes, 1);
+            index_put_leaf(node->text, node->no, 1);
+            if (node->yes != NULL) q_enqueue(&q, node->yes, 0);
+            if (node->no != NULL) q_enqueue(&q, node->no, 0);
+        }
+    }
+    q_free(&q);
+}
+
+/* Index a split that has just been linked into the tree: the old leaf
+ * moves from under the parent's question to under the new question.
+ */
+void index_apply_split(const Edit *e) {
+    g_treeVersion++;
+    if (e->parent != NULL) {
+        index_remove_leaf(e->parent->text, e->oldLeaf);
+    }
+    index_put_leaf(e->newQuestion->text, e->newLeaf, 0);
+    index_put_leaf(e->newQuestion->text, e->oldLeaf, 0);
+}
+
+/* Undo index_apply_split after the split has been unlinked */
+void index_revert_split(const Edit *e) {
+    g_treeVersion++;
+    g_unlinkEpoch++;
+    index_remove_leaf(e->newQuestion->text, e->newLeaf);
+    index_remove_leaf(e->newQuestion->text, e->oldLeaf);
+    if (e->parent != NULL) {
+        index_put_leaf(e->parent->text, e->oldLeaf, 0);
+    }
+}
+
+
+/* ========== Tree Statistics ========== */
+
+/* g_stats tracks node count, leaf count and max depth for g_root so the
+ * status panel never has to walk the tree. A histogram of leaf depths
+ * lets max depth shrink again on undo without a rescan.
+ */
+
+/* Make leafDepths[depth] addressable, zero-filling new entries */
+static int stats_reserve(int depth) {
+    if (depth < g_stats.depthCapacity) {
+        return 1;
+    }
+    int newCap = g_stats.depthCapacity ? g_stats.depthCapacity : 16;
+    while (newCap <= depth) {
+        newCap *= 2;
+    }
+    int *grown = realloc(g_stats.leafDepths, newCap * sizeof(int));
+    if (grown == NULL) {
+        return 0;
+    }
+    memset(grown + g_stats.depthCapacity, 0,
+           (newCap - g_stats.depthCapacity) * sizeof(int));
+    g_stats.leafDepths = grown;
+    g_stats.depthCapacity = newCap;
+    return 1;
+}
+
+/* Recompute g_stats from g_root in one BFS pass (the queue's id slot
+ * carries each node's depth)
+ */
+void stats_rebuild() {
+    g_stats.nodes = 0;
+    g_stats.leaves = 0;
+    g_stats.maxDepth = 0;
+    if (g_stats.leafDepths != NULL) {
+        memset(g_stats.leafDepths, 0, g_stats.depthCapacity * sizeof(int));
+    }
+    if (g_root == NULL) {
+        return;
+    }
+    
+    Queue q;
+    q_init(&q);
+    q_enqueue(&q, g_root, 0);
+    
+    while (!q_empty(&q)) {
+        Node *node;
+        int depth;
+        q_dequeue(&q, &node, &depth);
+        g_stats.nodes++;
+        
+        if (node->yes == NULL && node->no == NULL) {
+            // Leaf: record its depth
+            g_stats.leaves++;
+            if (stats_reserve(depth)) {
+                g_stats.leafDepths[depth]++;
+            }
+            if (depth > g_stats.maxDepth) {
+                g_stats.maxDepth = depth;
+            }
+        }
+        if (node->yes != NULL) q_enqueue(&q, node->yes, depth + 1);
+        if (node->no != NULL) q_enqueue(&q, node->no, depth + 1);
+    }
+    q_free(&q);
+}
+
+/* A leaf at depth became a question with two leaves one level down */
+void stats_apply_split(int depth) {
+    g_stats.nodes += 2;
+    g_stats.leaves += 1;
+    if (!stats_reserve(depth + 1)) {
+        return;
+    }
+    g_stats.leafDepths[depth]--;
+    g_stats.leafDepths[depth + 1] += 2;
+    if (depth + 1 > g_stats.maxDepth) {
+        g_stats.maxDepth = depth + 1;
+    }
+}
+
+/* Inverse of stats_apply_split. Max depth walks down past emptied
+ * levels, which is amortized O(1) against the splits that raised it.
+ */
+void stats_revert_split(int depth) {
+    g_stats.nodes -= 2;
+    g_stats.leaves -= 1;
+    g_stats.leafDepths[depth + 1] -= 2;
+    g_stats.leafDepths[depth]++;
+    while (g_stats.maxDepth > 0 && g_stats.leafDepths[g_stats.maxDepth] == 0) {
+        g_stats.maxDepth--;
+    }
+}
+
+void stats_free() {
+    free(g_stats.leafDepths);
+    g_stats.leafDepths = NULL;
+    g_stats.depthCapacity = 0;
+    g_stats.nodes = 0;
+    g_stats.leaves = 0;
+    g_stats.maxDepth = 0;
+}
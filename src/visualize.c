@@ -32,32 +32,65 @@ void add_display_line(const char *text, int indent, int isQuestion) {
     line_count++;
 }
 
+/* Pending node for the iterative pre-order walk in build_tree_display */
+typedef struct DisplayFrame {
+    Node *node;
+    int depth;
+    int isYesBranch;
+} DisplayFrame;
+
+/* Walk the tree pre-order (yes before no) with an explicit stack, so a
+ * long learned chain can't overflow the call stack. Each level indents
+ * by two spaces; the prefix stops growing once it fills a line.
+ */
 void build_tree_display(Node *node, int depth, const char *prefix, int isYesBranch) {
     if (node == NULL) return;
     
-    char line[256];
-    char branch[64];
-    
-    if (depth == 0) {
-        snprintf(line, sizeof(line), "ROOT: %s", node->text);
-    } else {
-        snprintf(branch, sizeof(branch), "%s", isYesBranch ? "[YES]" : "[NO]");
-        snprintf(line, sizeof(line), "%s%s %s", prefix, branch, node->text);
-    }
+    int stack_capacity = 64;
+    int stack_size = 0;
+    DisplayFrame *stack = malloc(stack_capacity * sizeof(DisplayFrame));
+    if (stack == NULL) return;
+    stack[stack_size++] = (DisplayFrame){node, depth, isYesBranch};
     
-    add_display_line(line, depth, node->isQuestion);
+    size_t base_len = strlen(prefix);
+    char line[256];
     
-    if (node->isQuestion) {
-        char new_prefix[256];
-        snprintf(new_prefix, sizeof(new_prefix), "%s  ", prefix);
+    while (stack_size > 0) {
+        DisplayFrame f = stack[--stack_size];
         
-        if (node->yes) {
-            build_tree_display(node->yes, depth + 1, new_prefix, 1);
+        if (f.depth == 0) {
+            snprintf(line, sizeof(line), "ROOT: %s", f.node->text);
+        } else {
+            /* prefix plus two spaces per level below the starting depth */
+            size_t len = base_len + 2 * (size_t)(f.depth - depth);
+            if (len > sizeof(line) - 1) len = sizeof(line) - 1;
+            size_t copied = base_len < len ? base_len : len;
+            memcpy(line, prefix, copied);
+            memset(line + copied, ' ', len - copied);
+            snprintf(line + len, sizeof(line) - len, "%s %s",
+                     f.isYesBranch ? "[YES]" : "[NO]", f.node->text);
         }
-        if (node->no) {
-            build_tree_display(node->no, depth + 1, new_prefix, 0);
+        
+        add_display_line(line, f.depth, f.node->isQuestion);
+        
+        if (f.node->isQuestion) {
+            if (stack_size + 2 > stack_capacity) {
+                stack_capacity *= 2;
+                DisplayFrame *grown = realloc(stack, stack_capacity * sizeof(DisplayFrame));
+                if (grown == NULL) break;
+                stack = grown;
+            }
+            /* Push no first so yes is displayed first */
+            if (f.node->no) {
+                stack[stack_size++] = (DisplayFrame){f.node->no, f.depth + 1, 0};
+            }
+            if (f.node->yes) {
+                stack[stack_size++] = (DisplayFrame){f.node->yes, f.depth + 1, 1};
+            }
         }
     }
+    
+    free(stack);
 }
 
 void draw_tree() {